@@ -143,10 +143,22 @@ SOURCE=..\..\src\lib\VSDParser.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\src\lib\VSDPath.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\src\lib\VSDRenderingOptions.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\src\lib\VSDShapeList.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\src\lib\VSDShapeTable.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\src\lib\VSDStencils.cpp
 # End Source File
 # Begin Source File
@@ -167,6 +179,10 @@ SOURCE=..\..\src\lib\VSDSVGGenerator.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\src\lib\VSDXCellScanner.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\src\lib\VSDXMLHelper.cpp
 # End Source File
 # Begin Source File
@@ -199,6 +215,10 @@ SOURCE=..\..\inc\libvisio\VisioDocument.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\inc\libvisio\VSDRenderingOptions.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\inc\libvisio\VSDStringVector.h
 # End Source File
 # Begin Source File
@@ -271,10 +291,18 @@ SOURCE=..\..\src\lib\VSDParser.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\src\lib\VSDPath.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\src\lib\VSDShapeList.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\src\lib\VSDShapeTable.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\src\lib\VSDStencils.h
 # End Source File
 # Begin Source File
@@ -299,6 +327,10 @@ SOURCE=..\..\src\lib\VSDTypes.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\src\lib\VSDXCellScanner.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\src\lib\VSDXMLHelper.h
 # End Source File
 # Begin Source File
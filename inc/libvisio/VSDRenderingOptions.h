@@ -0,0 +1,124 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* libvisio
+ * Version: MPL 1.1 / GPLv2+ / LGPLv2+
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License or as specified alternatively below. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * Major Contributor(s):
+ * Copyright (C) 2012 Fridrich Strba <fridrich.strba@bluewin.ch>
+ *
+ *
+ * All Rights Reserved.
+ *
+ * For minor contributions see the git repository.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPLv2+"), or
+ * the GNU Lesser General Public License Version 2 or later (the "LGPLv2+"),
+ * in which case the provisions of the GPLv2+ or the LGPLv2+ are applicable
+ * instead of those above.
+ */
+
+
+#ifndef __VSDRENDERINGOPTIONS_H__
+#define __VSDRENDERINGOPTIONS_H__
+
+namespace libvisio
+{
+class VSDRenderingOptionsImpl;
+
+class VSDRenderingOptions
+{
+public:
+  VSDRenderingOptions();
+  VSDRenderingOptions(const VSDRenderingOptions &options);
+  ~VSDRenderingOptions();
+
+  VSDRenderingOptions &operator=(const VSDRenderingOptions &options);
+
+  /* Maximal distance, in output units (inches), between a curve and the
+   * polyline it is flattened into. Zero, the default, keeps the fixed
+   * sampling of the curves. */
+  void setFlatteningTolerance(double tolerance);
+  double getFlatteningTolerance() const;
+
+  /* Maximal distance, in output units (inches), by which dropping points
+   * of straight line runs may move the paths. No point is dropped if the
+   * segment replacing it would cross another straight segment of the
+   * path. Zero, the default, leaves the paths as they are. */
+  void setSimplificationTolerance(double tolerance);
+  double getSimplificationTolerance() const;
+
+  /* Limits on the work done for one document, against files that would
+   * take unbounded time or memory to draw. Zero, the default, is no limit.
+   * What exceeds a limit is drawn in a simpler way or left out, in the
+   * same way on every run. */
+
+  /* NURBS of a higher degree are drawn as their control polygons. */
+  void setMaximalCurveDegree(unsigned degree);
+  unsigned getMaximalCurveDegree() const;
+
+  /* Path points past this count are left out of the paths. */
+  void setMaximalVertexCount(unsigned long count);
+  unsigned long getMaximalVertexCount() const;
+
+  /* Shapes nested deeper in groups are placed by their innermost groups
+   * only. */
+  void setMaximalGroupDepth(unsigned depth);
+  unsigned getMaximalGroupDepth() const;
+
+  /* Background pages of a page past this count are not drawn. Chains of
+   * background pages that loop are cut whatever the limit. */
+  void setMaximalBackgroundDepth(unsigned depth);
+  unsigned getMaximalBackgroundDepth() const;
+
+  /* Shapes whose output elements would go past this count are left out. */
+  void setMaximalElementCount(unsigned long count);
+  unsigned long getMaximalElementCount() const;
+
+  /* The limits above, as flags. */
+  enum Limit
+  {
+    LIMIT_CURVE_DEGREE = 0x1,
+    LIMIT_VERTEX_COUNT = 0x2,
+    LIMIT_GROUP_DEPTH = 0x4,
+    LIMIT_BACKGROUND_DEPTH = 0x8,
+    LIMIT_ELEMENT_COUNT = 0x10
+  };
+
+  /* The limits that the last document parsed with these options exceeded,
+   * as a combination of the flags above. Zero if none was. */
+  void setExceededLimits(unsigned limits);
+  unsigned getExceededLimits() const;
+
+  /* Leaves out the shapes that draw nothing inside the viewport, or the
+   * page if there is no viewport. Off by default, so that the content
+   * outside the pages is kept. */
+  void setShapeCulling(bool culling);
+  bool getShapeCulling() const;
+
+  /* The part of the pages, in output units (inches) from their top left
+   * corners, that the shape culling keeps the shapes of. A width or a
+   * height that is not positive sets no viewport. */
+  void setViewport(double x, double y, double width, double height);
+  double getViewportX() const;
+  double getViewportY() const;
+  double getViewportWidth() const;
+  double getViewportHeight() const;
+
+private:
+  VSDRenderingOptionsImpl *m_pImpl;
+};
+
+} // namespace libvisio
+
+#endif /* __VSDRENDERINGOPTIONS_H__ */
+/* vim:set shiftwidth=2 softtabstop=2 expandtab: */
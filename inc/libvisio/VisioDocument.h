@@ -33,6 +33,7 @@
 
 #include <libwpd/libwpd.h>
 #include <libwpg/libwpg.h>
+#include "VSDRenderingOptions.h"
 #include "VSDStringVector.h"
 
 class WPXInputStream;
@@ -53,6 +54,14 @@ public:
   static bool generateSVG(WPXInputStream *input, VSDStringVector &output);
 
   static bool generateSVGStencils(WPXInputStream *input, VSDStringVector &output);
+
+  static bool parse(WPXInputStream *input, libwpg::WPGPaintInterface *painter, VSDRenderingOptions &options);
+
+  static bool parseStencils(WPXInputStream *input, libwpg::WPGPaintInterface *painter, VSDRenderingOptions &options);
+
+  static bool generateSVG(WPXInputStream *input, VSDStringVector &output, VSDRenderingOptions &options);
+
+  static bool generateSVGStencils(WPXInputStream *input, VSDStringVector &output, VSDRenderingOptions &options);
 };
 
 } // namespace libvisio
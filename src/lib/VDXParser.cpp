@@ -40,9 +40,50 @@
 #include "VSDXMLHelper.h"
 #include "VSDXMLTokenMap.h"
 
+namespace
+{
+
+// Sections and document parts with nothing the parser reads
+bool isUnhandledSection(int tokenId)
+{
+  switch (tokenId)
+  {
+  case XML_ACT:
+  case XML_CONNECTION:
+  case XML_CONTROL:
+  case XML_DATA1:
+  case XML_DATA2:
+  case XML_DATA3:
+  case XML_DOCUMENTPROPERTIES:
+  case XML_DOCUMENTSETTINGS:
+  case XML_EMAILROUTINGDATA:
+  case XML_EVENT:
+  case XML_EVENTLIST:
+  case XML_FIELD:
+  case XML_GROUP:
+  case XML_HEADERFOOTER:
+  case XML_HELP:
+  case XML_HYPERLINK:
+  case XML_ICON:
+  case XML_LAYER:
+  case XML_LAYERMEM:
+  case XML_PROP:
+  case XML_PROTECTION:
+  case XML_SCRATCH:
+  case XML_USER:
+  case XML_VBPROJECTDATA:
+  case XML_WINDOWS:
+    return true;
+  default:
+    return false;
+  }
+}
+
+} // anonymous namespace
+
 
 libvisio::VDXParser::VDXParser(WPXInputStream *input, libwpg::WPGPaintInterface *painter)
-  : VSDXMLParserBase(), m_input(input), m_painter(painter)
+  : VSDXMLParserBase(), m_input(input), m_painter(painter), m_stringValue(), m_isStructurePass(false)
 {
 }
 
@@ -57,25 +98,26 @@ bool libvisio::VDXParser::parseMain()
 
   try
   {
-    std::vector<std::map<unsigned, XForm> > groupXFormsSequence;
-    std::vector<std::map<unsigned, unsigned> > groupMembershipsSequence;
-    std::vector<std::list<unsigned> > documentPageShapeOrders;
+    std::vector<VSDShapeTable> documentShapeTables;
 
-    VSDStylesCollector stylesCollector(groupXFormsSequence, groupMembershipsSequence, documentPageShapeOrders);
+    VSDStylesCollector stylesCollector(documentShapeTables);
     m_collector = &stylesCollector;
     m_input->seek(0, WPX_SEEK_SET);
-    if (!processXmlDocument(m_input))
+    // The first pass only gathers the page structure and the styles
+    m_isStructurePass = true;
+    bool ok = processXmlDocument(m_input);
+    m_isStructurePass = false;
+    if (!ok)
       return false;
 
     VSDStyles styles = stylesCollector.getStyleSheets();
 
-    VSDContentCollector contentCollector(m_painter, groupXFormsSequence, groupMembershipsSequence, documentPageShapeOrders, styles, m_stencils);
+    VSDContentCollector contentCollector(m_painter, documentShapeTables, styles, m_stencils, m_options);
     m_collector = &contentCollector;
     m_input->seek(0, WPX_SEEK_SET);
-    if (!processXmlDocument(m_input))
-      return false;
-
-    return true;
+    const bool isParsed = processXmlDocument(m_input);
+    m_options.setExceededLimits(contentCollector.getExceededLimits());
+    return isParsed;
   }
   catch (...)
   {
@@ -97,10 +139,37 @@ bool libvisio::VDXParser::processXmlDocument(WPXInputStream *input)
   xmlTextReaderPtr reader = xmlReaderForStream(input, 0, 0, XML_PARSE_NOBLANKS|XML_PARSE_NOENT|XML_PARSE_NONET|XML_PARSE_RECOVER);
   if (!reader)
     return false;
+  // a new reader may reuse the addresses of a freed one
+  m_tokenCache.reset();
+  bool mastersDone = false;
   int ret = xmlTextReaderRead(reader);
   while (1 == ret)
   {
-    processXmlNode(reader);
+    int tokenId = getElementToken(reader);
+    int tokenType = xmlTextReaderNodeType(reader);
+    if (isShapeContentSkipped(tokenId, tokenType)
+        || (XML_READER_TYPE_ELEMENT == tokenType && isUnhandledSection(tokenId)))
+    {
+      ret = xmlTextReaderNext(reader);
+      continue;
+    }
+    if (m_extractStencils)
+    {
+      if (XML_MASTERS == tokenId && XML_READER_TYPE_END_ELEMENT == tokenType)
+        mastersDone = true;
+      else if (XML_PAGES == tokenId && XML_READER_TYPE_ELEMENT == tokenType)
+      {
+        // Stencils are extracted from the masters alone. Once they are
+        // read, nothing from the pages on is needed; otherwise the whole
+        // Pages subtree is passed over without looking at its nodes.
+        if (mastersDone)
+          break;
+        ret = xmlTextReaderNext(reader);
+        continue;
+      }
+    }
+
+    processXmlNode(reader, tokenId, tokenType);
 
     ret = xmlTextReaderRead(reader);
   }
@@ -109,12 +178,33 @@ bool libvisio::VDXParser::processXmlDocument(WPXInputStream *input)
   return true;
 }
 
-void libvisio::VDXParser::processXmlNode(xmlTextReaderPtr reader)
+bool libvisio::VDXParser::isShapeContentSkipped(int tokenId, int tokenType)
+{
+  // The styles collector needs no more of a page shape than its identity,
+  // its transformation and its children. Geometry, text and embedded data
+  // are the bulk of a big drawing and are read only in the second pass.
+  // Masters are not read again in the second pass, so they are kept whole.
+  if (!m_isStructurePass || m_extractStencils || m_isStencilStarted || !m_isShapeStarted)
+    return false;
+  if (XML_READER_TYPE_ELEMENT != tokenType)
+    return false;
+  switch (tokenId)
+  {
+  case XML_GEOM:
+  case XML_TEXT:
+  case XML_FOREIGNDATA:
+  case XML_CHAR:
+  case XML_PARA:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void libvisio::VDXParser::processXmlNode(xmlTextReaderPtr reader, int tokenId, int tokenType)
 {
   if (!reader)
     return;
-  int tokenId = getElementToken(reader);
-  int tokenType = xmlTextReaderNodeType(reader);
   _handleLevelChange((unsigned)getElementDepth(reader));
   switch (tokenId)
   {
@@ -210,21 +300,10 @@ void libvisio::VDXParser::processXmlNode(xmlTextReaderPtr reader)
     }
     break;
   case XML_SOLUTIONXML:
+    // SolutionXML inside VDX file can have invalid namespace URIs;
+    // nothing in it is looked at.
     if (XML_READER_TYPE_ELEMENT == tokenType)
-    {
-      int ret = 0;
-      do
-      {
-        ret = xmlTextReaderRead(reader);
-#if 0
-        // SolutionXML inside VDX file can have invalid namespace URIs
-        xmlResetLastError();
-#endif
-        tokenId = getElementToken(reader);
-        tokenType = xmlTextReaderNodeType(reader);
-      }
-      while ((XML_SOLUTIONXML != tokenId || XML_READER_TYPE_END_ELEMENT != tokenType) && 1 == ret);
-    }
+      skipElement(reader);
     break;
   case XML_STYLESHEET:
     if (XML_READER_TYPE_ELEMENT == tokenType)
@@ -820,17 +899,21 @@ void libvisio::VDXParser::readTextBlock(xmlTextReaderPtr reader)
                                       verticalAlign, !!bgClrId, bgColour, defaultTabStop, textDirection));
 }
 
-xmlChar *libvisio::VDXParser::readStringData(xmlTextReaderPtr reader)
+const xmlChar *libvisio::VDXParser::readStringData(xmlTextReaderPtr reader)
 {
   int ret = xmlTextReaderRead(reader);
   if (1 == ret && XML_READER_TYPE_TEXT == xmlTextReaderNodeType(reader))
   {
-    xmlChar *stringValue = xmlTextReaderValue(reader);
+    // the text node does not survive the next read, so keep a copy of it
+    // in a buffer that is reused for every value
+    const xmlChar *stringValue = xmlTextReaderConstValue(reader);
+    if (stringValue)
+      m_stringValue.assign(stringValue, stringValue + xmlStrlen(stringValue) + 1);
     ret = xmlTextReaderRead(reader);
     if (1 == ret && stringValue)
     {
-      VSD_DEBUG_MSG(("VDXParser::readStringData stringValue %s\n", (const char *)stringValue));
-      return stringValue;
+      VSD_DEBUG_MSG(("VDXParser::readStringData stringValue %s\n", (const char *)&m_stringValue[0]));
+      return &m_stringValue[0];
     }
   }
   return 0;
@@ -838,7 +921,7 @@ xmlChar *libvisio::VDXParser::readStringData(xmlTextReaderPtr reader)
 
 int libvisio::VDXParser::getElementToken(xmlTextReaderPtr reader)
 {
-  return VSDXMLTokenMap::getTokenId(xmlTextReaderConstName(reader));
+  return m_tokenCache.getTokenId(reader);
 }
 
 int libvisio::VDXParser::getElementDepth(xmlTextReaderPtr reader)
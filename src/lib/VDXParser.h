@@ -30,6 +30,7 @@
 #ifndef __VDXPARSER_H__
 #define __VDXPARSER_H__
 
+#include <vector>
 #include <libwpd-stream/libwpd-stream.h>
 #include <libwpg/libwpg.h>
 #include "VSDXMLParserBase.h"
@@ -59,7 +60,7 @@ private:
 
   // Helper functions
 
-  xmlChar *readStringData(xmlTextReaderPtr reader);
+  const xmlChar *readStringData(xmlTextReaderPtr reader);
 
   int getElementToken(xmlTextReaderPtr reader);
   int getElementDepth(xmlTextReaderPtr reader);
@@ -67,7 +68,8 @@ private:
   // Functions to read the DatadiagramML document structure
 
   bool processXmlDocument(WPXInputStream *input);
-  void processXmlNode(xmlTextReaderPtr reader);
+  void processXmlNode(xmlTextReaderPtr reader, int tokenId, int tokenType);
+  bool isShapeContentSkipped(int tokenId, int tokenType);
 
   // Functions reading the DiagramML document content
 
@@ -87,6 +89,8 @@ private:
 
   WPXInputStream *m_input;
   libwpg::WPGPaintInterface *m_painter;
+  std::vector<xmlChar> m_stringValue;
+  bool m_isStructurePass;
 };
 
 } // namespace libvisio
@@ -31,6 +31,7 @@
 #ifndef VSDCOLLECTOR_H
 #define VSDCOLLECTOR_H
 
+#include <map>
 #include <vector>
 #include <boost/optional.hpp>
 #include "VSDParser.h"
@@ -65,15 +66,17 @@ public:
   virtual void collectLineTo(unsigned id, unsigned level, double x, double y) = 0;
   virtual void collectArcTo(unsigned id, unsigned level, double x2, double y2, double bow) = 0;
   virtual void collectNURBSTo(unsigned id, unsigned level, double x2, double y2, unsigned char xType, unsigned char yType, unsigned degree,
-                              std::vector<std::pair<double, double> > controlPoints, std::vector<double> knotVector, std::vector<double> weights) = 0;
+                              const std::vector<std::pair<double, double> > &controlPoints, const std::vector<double> &knotVector, const std::vector<double> &weights) = 0;
   virtual void collectNURBSTo(unsigned id, unsigned level, double x2, double y2, double knot, double knotPrev, double weight, double weightPrev, unsigned dataID) = 0;
   virtual void collectNURBSTo(unsigned id, unsigned level, double x2, double y2, double knot, double knotPrev, double weight, double weightPrev, const NURBSData &data) = 0;
   virtual void collectPolylineTo(unsigned id, unsigned level, double x, double y, unsigned char xType, unsigned char yType, const std::vector<std::pair<double, double> > &points) = 0;
   virtual void collectPolylineTo(unsigned id, unsigned level, double x, double y, unsigned dataID) = 0;
   virtual void collectPolylineTo(unsigned id, unsigned level, double x, double y, const PolylineData &data) = 0;
   virtual void collectShapeData(unsigned id, unsigned level, unsigned char xType, unsigned char yType, unsigned degree, double lastKnot,
-                                std::vector<std::pair<double, double> > controlPoints, std::vector<double> knotVector, std::vector<double> weights) = 0;
-  virtual void collectShapeData(unsigned id, unsigned level, unsigned char xType, unsigned char yType, std::vector<std::pair<double, double> > points) = 0;
+                                const std::vector<std::pair<double, double> > &controlPoints, const std::vector<double> &knotVector, const std::vector<double> &weights) = 0;
+  virtual void collectShapeData(unsigned id, unsigned level, unsigned char xType, unsigned char yType, const std::vector<std::pair<double, double> > &points) = 0;
+  virtual void collectShapeGeometries(unsigned level, const std::map<unsigned, VSDGeometryList> &geometries) = 0;
+  virtual void collectGeometryList(unsigned level, const VSDGeometryList &geometryList) = 0;
   virtual void collectXFormData(unsigned level, const XForm &xform) = 0;
   virtual void collectTxtXForm(unsigned level, const XForm &txtxform) = 0;
   virtual void collectShapesOrder(unsigned id, unsigned level, const std::vector<unsigned> &shapeIds) = 0;
@@ -28,9 +28,9 @@
  * instead of those above.
  */
 
+#include <ctype.h>
 #include <string.h> // for memcpy
-#include <stack>
-#include <boost/spirit/include/classic.hpp>
+#include <algorithm>
 #include <unicode/ucnv.h>
 #include <unicode/utypes.h>
 #include <unicode/utf8.h>
@@ -72,37 +72,525 @@ static void _appendUCS4(WPXString &text, UChar32 ucs4Character)
   text.append((char *)outbuf);
 }
 
+// Distance of the point (x, y) from the segment between (x0, y0) and (x1, y1)
+static double segmentDistance(double x, double y, double x0, double y0, double x1, double y1)
+{
+  const double dx = x1 - x0;
+  const double dy = y1 - y0;
+  const double length2 = dx*dx + dy*dy;
+  double t = 0.0;
+  if (length2 > 0.0)
+  {
+    t = ((x - x0)*dx + (y - y0)*dy) / length2;
+    if (t < 0.0)
+      t = 0.0;
+    else if (t > 1.0)
+      t = 1.0;
+  }
+  const double ex = x0 + t*dx - x;
+  const double ey = y0 + t*dy - y;
+  return sqrt(ex*ex + ey*ey);
+}
+
+// Tells whether the segment between (ax, ay) and (bx, by) and the one
+// between (cx, cy) and (dx, dy) cross at a point inside both
+static bool segmentsCross(double ax, double ay, double bx, double by, double cx, double cy, double dx, double dy)
+{
+  const double abc = (bx - ax)*(cy - ay) - (by - ay)*(cx - ax);
+  const double abd = (bx - ax)*(dy - ay) - (by - ay)*(dx - ax);
+  const double cda = (dx - cx)*(ay - cy) - (dy - cy)*(ax - cx);
+  const double cdb = (dx - cx)*(by - cy) - (dy - cy)*(bx - cx);
+  return ((abc > 0.0 && abd < 0.0) || (abc < 0.0 && abd > 0.0)) && ((cda > 0.0 && cdb < 0.0) || (cda < 0.0 && cdb > 0.0));
+}
+
+// A run of line-tos of a path: the point it starts from and the ends of
+// the line-tos, with the indices of the line-tos in the path and which of
+// the points are kept
+struct LineRun
+{
+  std::vector<std::pair<double, double> > points;
+  std::vector<size_t> elements;
+  std::vector<bool> keep;
+};
+
+// A straight segment of a path being simplified. Those of the runs join
+// the kept points first and last of the run; the closing ones belong to
+// no run.
+struct PathSegment
+{
+  double x0, y0, x1, y1;
+  size_t run, first, last;
+};
+
+// Returns the point of the run between first and last that lies farthest
+// from the segment joining them, and its distance. The distance is from
+// the segment, not from its line, so that a run turning back on itself
+// keeps its turning point.
+static size_t farthestRunPoint(const LineRun &run, size_t first, size_t last, double &distance)
+{
+  size_t farthest = first + 1;
+  distance = -1.0;
+  for (size_t i = first + 1; i < last; ++i)
+  {
+    const double pointDistance = segmentDistance(run.points[i].first, run.points[i].second,
+                                                 run.points[first].first, run.points[first].second,
+                                                 run.points[last].first, run.points[last].second);
+    if (pointDistance > distance)
+    {
+      distance = pointDistance;
+      farthest = i;
+    }
+  }
+  return farthest;
+}
+
+// Marks the points of the run that the Douglas-Peucker reduction keeps: it
+// leaves out the points within tolerance of the segment between the points
+// kept around them, so collinear ones merge. The ends of the run always
+// stay.
+static void reduceRun(LineRun &run, double tolerance)
+{
+  const size_t count = run.points.size();
+  run.keep.assign(count, false);
+  run.keep[0] = true;
+  run.keep[count - 1] = true;
+
+  std::vector<std::pair<size_t, size_t> > ranges;
+  ranges.push_back(std::make_pair((size_t)0, count - 1));
+  while (!ranges.empty())
+  {
+    const size_t first = ranges.back().first;
+    const size_t last = ranges.back().second;
+    ranges.pop_back();
+    if (last <= first + 1)
+      continue;
+
+    double maxDistance = 0.0;
+    const size_t farthest = farthestRunPoint(run, first, last, maxDistance);
+    if (maxDistance > tolerance)
+    {
+      run.keep[farthest] = true;
+      ranges.push_back(std::make_pair(first, farthest));
+      ranges.push_back(std::make_pair(farthest, last));
+    }
+  }
+}
+
+// Simplifies the runs of line-tos of the path. Moves, closes and curves
+// stay as they are, and so does every subpath. A point is only left out
+// if the segment replacing it crosses none of the other straight segments
+// of the path, those of the other runs and the closing ones included, so
+// the simplification adds no crossings among them; whether it crosses the
+// curves and arcs is not checked. Points are put back, the farthest of a
+// crossing segment first, until no segment crosses.
+static void simplifyPath(libvisio::VSDPath &path, double tolerance)
+{
+  std::vector<LineRun> runs;
+  std::vector<PathSegment> closes;
+  std::vector<bool> isDropped(path.size(), false);
+  bool isInRun = false;
+  double x = 0.0;
+  double y = 0.0;
+  double startX = 0.0;
+  double startY = 0.0;
+
+  for (size_t i = 0; i < path.size(); ++i)
+  {
+    if (path[i].action == libvisio::VSD_PATH_LINE_TO)
+    {
+      if (!isInRun)
+      {
+        runs.push_back(LineRun());
+        runs.back().points.push_back(std::make_pair(x, y));
+        runs.back().elements.push_back((size_t)-1);
+        isInRun = true;
+      }
+      // a zero length segment after others draws nothing
+      else if (runs.back().points.size() > 1 && path[i].x == x && path[i].y == y)
+      {
+        isDropped[i] = true;
+        continue;
+      }
+      runs.back().points.push_back(std::make_pair(path[i].x, path[i].y));
+      runs.back().elements.push_back(i);
+      x = path[i].x;
+      y = path[i].y;
+      continue;
+    }
+
+    isInRun = false;
+    if (path[i].action == libvisio::VSD_PATH_CLOSE)
+    {
+      PathSegment close = { x, y, startX, startY, (size_t)-1, 0, 0 };
+      closes.push_back(close);
+      x = startX;
+      y = startY;
+    }
+    else
+    {
+      x = path[i].x;
+      y = path[i].y;
+      if (path[i].action == libvisio::VSD_PATH_MOVE_TO)
+      {
+        startX = x;
+        startY = y;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < runs.size(); ++i)
+    reduceRun(runs[i], tolerance);
+
+  std::vector<PathSegment> segments;
+  bool isChanged = true;
+  while (isChanged)
+  {
+    isChanged = false;
+    segments = closes;
+    for (size_t i = 0; i < runs.size(); ++i)
+    {
+      size_t first = 0;
+      for (size_t j = 1; j < runs[i].points.size(); ++j)
+      {
+        if (!runs[i].keep[j])
+          continue;
+        PathSegment segment = { runs[i].points[first].first, runs[i].points[first].second,
+                                runs[i].points[j].first, runs[i].points[j].second, i, first, j
+                              };
+        segments.push_back(segment);
+        first = j;
+      }
+    }
+
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+      const PathSegment &segment = segments[i];
+      if (segment.last <= segment.first + 1)
+        continue;
+      for (size_t j = 0; j < segments.size(); ++j)
+      {
+        const PathSegment &other = segments[j];
+        if (j != i && segmentsCross(segment.x0, segment.y0, segment.x1, segment.y1, other.x0, other.y0, other.x1, other.y1))
+        {
+          double distance = 0.0;
+          runs[segment.run].keep[farthestRunPoint(runs[segment.run], segment.first, segment.last, distance)] = true;
+          isChanged = true;
+          break;
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < runs.size(); ++i)
+  {
+    for (size_t j = 1; j < runs[i].points.size(); ++j)
+      isDropped[runs[i].elements[j]] = !runs[i].keep[j];
+  }
+  libvisio::VSDPath simplified;
+  simplified.reserve(path.size());
+  for (size_t i = 0; i < path.size(); ++i)
+  {
+    if (!isDropped[i])
+      simplified.push_back(path[i]);
+  }
+  path.swap(simplified);
+}
+
+// A piece of a NURBS curve being flattened, with its end points in shape
+// co-ordinates
+struct NURBSPiece
+{
+  double start, end;
+  double startX, startY, endX, endY;
+  unsigned depth;
+};
+
+// The box around some points
+struct Bounds
+{
+  Bounds() : isEmpty(true), minX(0.0), minY(0.0), maxX(0.0), maxY(0.0) {}
+  void add(double x, double y, double margin = 0.0)
+  {
+    if (isEmpty || x - margin < minX)
+      minX = x - margin;
+    if (isEmpty || x + margin > maxX)
+      maxX = x + margin;
+    if (isEmpty || y - margin < minY)
+      minY = y - margin;
+    if (isEmpty || y + margin > maxY)
+      maxY = y + margin;
+    isEmpty = false;
+  }
+  bool isEmpty;
+  double minX, minY, maxX, maxY;
+};
+
+// Adds to bounds the points of the path, which include the control points
+// of the curves, so that the curves are within them. An arc is within the
+// diameter of its ellipse, or the distance of its ends if the ellipse is
+// too small to join them, of its end.
+static void addPathBounds(Bounds &bounds, const libvisio::VSDPath &path, double margin)
+{
+  double x = 0.0;
+  double y = 0.0;
+  for (size_t i = 0; i < path.size(); ++i)
+  {
+    const libvisio::VSDPathElement &element = path[i];
+    switch (element.action)
+    {
+    case libvisio::VSD_PATH_CLOSE:
+      continue;
+    case libvisio::VSD_PATH_CUBIC_TO:
+      bounds.add(element.x2, element.y2, margin);
+    // fall through
+    case libvisio::VSD_PATH_QUADRATIC_TO:
+      bounds.add(element.x1, element.y1, margin);
+      bounds.add(element.x, element.y, margin);
+      break;
+    case libvisio::VSD_PATH_ARC_TO:
+    {
+      const double diameter = 2.0 * (fabs(element.rx) > fabs(element.ry) ? fabs(element.rx) : fabs(element.ry));
+      const double distance = fabs(element.x - x) + fabs(element.y - y);
+      bounds.add(element.x, element.y, margin + (diameter > distance ? diameter : distance));
+      break;
+    }
+    default:
+      bounds.add(element.x, element.y, margin);
+      break;
+    }
+    x = element.x;
+    y = element.y;
+  }
+}
+
+// Tells whether the knots do not decrease and the weights are positive,
+// which keeps a NURBS curve within the hull of its control points.
+static bool isCurveInHull(const std::vector<double> &knots, const std::vector<double> &weights)
+{
+  for (size_t i = 1; i < knots.size(); ++i)
+  {
+    if (knots[i] < knots[i-1])
+      return false;
+  }
+  for (size_t i = 0; i < weights.size(); ++i)
+  {
+    if (!(weights[i] > 0.0))
+      return false;
+  }
+  return true;
+}
+
+// Adds to bounds, in shape co-ordinates, points that the rows of a
+// geometry section stay within: the ends of the segments, the control
+// points of the curves, the ends of the arcs grown by their bows and the
+// points of the ellipses grown by their diameters. The curves are also
+// bound by the origin of the shape, to which their points fall if their
+// weights vanish. Tells false if a row draws something that cannot be
+// bound from its cells alone.
+static bool addGeometryExtents(Bounds &bounds, const std::vector<const libvisio::VSDGeometryListElement *> &rows, double width, double height)
+{
+  // the point the next segment starts at, which the arcs and the Bezier
+  // curves need
+  bool isPointKnown = false;
+  double x = 0.0;
+  double y = 0.0;
+  for (size_t i = 0; i < rows.size(); ++i)
+  {
+    switch (rows[i]->getType())
+    {
+    case libvisio::VSD_ROW_GEOMETRY:
+    case libvisio::VSD_ROW_EMPTY:
+      continue;
+    case libvisio::VSD_ROW_MOVE_TO:
+    {
+      const libvisio::VSDMoveTo *moveTo = static_cast<const libvisio::VSDMoveTo *>(rows[i]);
+      x = moveTo->m_x;
+      y = moveTo->m_y;
+      break;
+    }
+    case libvisio::VSD_ROW_LINE_TO:
+    {
+      const libvisio::VSDLineTo *lineTo = static_cast<const libvisio::VSDLineTo *>(rows[i]);
+      x = lineTo->m_x;
+      y = lineTo->m_y;
+      break;
+    }
+    case libvisio::VSD_ROW_REL_MOVE_TO:
+    {
+      const libvisio::VSDRelMoveTo *relMoveTo = static_cast<const libvisio::VSDRelMoveTo *>(rows[i]);
+      x = relMoveTo->m_x * width;
+      y = relMoveTo->m_y * height;
+      break;
+    }
+    case libvisio::VSD_ROW_REL_LINE_TO:
+    {
+      const libvisio::VSDRelLineTo *relLineTo = static_cast<const libvisio::VSDRelLineTo *>(rows[i]);
+      x = relLineTo->m_x * width;
+      y = relLineTo->m_y * height;
+      break;
+    }
+    case libvisio::VSD_ROW_ARC_TO:
+    {
+      if (!isPointKnown)
+        return false;
+      const libvisio::VSDArcTo *arcTo = static_cast<const libvisio::VSDArcTo *>(rows[i]);
+      // the arc, even the larger one, keeps within its bow of its chord
+      const double bow = fabs(arcTo->m_bow);
+      bounds.add(x, y, bow);
+      x = arcTo->m_x2;
+      y = arcTo->m_y2;
+      bounds.add(x, y, bow);
+      continue;
+    }
+    case libvisio::VSD_ROW_ELLIPSE:
+    {
+      const libvisio::VSDEllipse *ellipse = static_cast<const libvisio::VSDEllipse *>(rows[i]);
+      const double rx = sqrt(pow(ellipse->m_xleft - ellipse->m_cx, 2) + pow(ellipse->m_yleft - ellipse->m_cy, 2));
+      const double ry = sqrt(pow(ellipse->m_xtop - ellipse->m_cx, 2) + pow(ellipse->m_ytop - ellipse->m_cy, 2));
+      const double diameter = 2.0 * (rx > ry ? rx : ry);
+      // the ellipse does not move the current point
+      bounds.add(ellipse->m_xleft, ellipse->m_yleft, diameter);
+      bounds.add(ellipse->m_xtop, ellipse->m_ytop, diameter);
+      continue;
+    }
+    case libvisio::VSD_ROW_NURBS_TO_1:
+    {
+      const libvisio::VSDNURBSTo1 *nurbsTo = static_cast<const libvisio::VSDNURBSTo1 *>(rows[i]);
+      if (!isCurveInHull(nurbsTo->m_knotVector, nurbsTo->m_weights))
+        return false;
+      for (size_t j = 0; j < nurbsTo->m_controlPoints.size(); ++j)
+        bounds.add(nurbsTo->m_controlPoints[j].first * (nurbsTo->m_xType == 0 ? width : 1.0),
+                   nurbsTo->m_controlPoints[j].second * (nurbsTo->m_yType == 0 ? height : 1.0));
+      bounds.add(0.0, 0.0);
+      x = nurbsTo->m_x2;
+      y = nurbsTo->m_y2;
+      break;
+    }
+    case libvisio::VSD_ROW_NURBS_TO_3:
+    {
+      const libvisio::VSDNURBSTo3 *nurbsTo = static_cast<const libvisio::VSDNURBSTo3 *>(rows[i]);
+      const libvisio::NURBSData &data = nurbsTo->m_data;
+      if (!isCurveInHull(data.knots, data.weights) || !(nurbsTo->m_weight > 0.0) || !(nurbsTo->m_weightPrev > 0.0)
+          || (!data.knots.empty() && (data.knots.front() < nurbsTo->m_knotPrev || data.knots.back() > nurbsTo->m_knot))
+          || nurbsTo->m_knotPrev > nurbsTo->m_knot || nurbsTo->m_knot > data.lastKnot)
+        return false;
+      for (size_t j = 0; j < data.points.size(); ++j)
+        bounds.add(data.points[j].first * (data.xType == 0 ? width : 1.0), data.points[j].second * (data.yType == 0 ? height : 1.0));
+      bounds.add(0.0, 0.0);
+      x = nurbsTo->m_x2;
+      y = nurbsTo->m_y2;
+      break;
+    }
+    case libvisio::VSD_ROW_POLYLINE_TO_1:
+    {
+      const libvisio::VSDPolylineTo1 *polylineTo = static_cast<const libvisio::VSDPolylineTo1 *>(rows[i]);
+      for (size_t j = 0; j < polylineTo->m_points.size(); ++j)
+        bounds.add(polylineTo->m_points[j].first * (polylineTo->m_xType == 0 ? width : 1.0),
+                   polylineTo->m_points[j].second * (polylineTo->m_yType == 0 ? height : 1.0));
+      x = polylineTo->m_x;
+      y = polylineTo->m_y;
+      break;
+    }
+    case libvisio::VSD_ROW_POLYLINE_TO_3:
+    {
+      const libvisio::VSDPolylineTo3 *polylineTo = static_cast<const libvisio::VSDPolylineTo3 *>(rows[i]);
+      const libvisio::PolylineData &data = polylineTo->m_data;
+      for (size_t j = 0; j < data.points.size(); ++j)
+        bounds.add(data.points[j].first * (data.xType == 0 ? width : 1.0), data.points[j].second * (data.yType == 0 ? height : 1.0));
+      x = polylineTo->m_x;
+      y = polylineTo->m_y;
+      break;
+    }
+    case libvisio::VSD_ROW_REL_CUB_BEZ_TO:
+    {
+      if (!isPointKnown)
+        return false;
+      const libvisio::VSDRelCubBezTo *relCubBezTo = static_cast<const libvisio::VSDRelCubBezTo *>(rows[i]);
+      bounds.add(x, y);
+      bounds.add(relCubBezTo->m_a * width, relCubBezTo->m_b * height);
+      bounds.add(relCubBezTo->m_c * width, relCubBezTo->m_d * height);
+      x = relCubBezTo->m_x * width;
+      y = relCubBezTo->m_y * height;
+      break;
+    }
+    case libvisio::VSD_ROW_REL_QUAD_BEZ_TO:
+    {
+      if (!isPointKnown)
+        return false;
+      const libvisio::VSDRelQuadBezTo *relQuadBezTo = static_cast<const libvisio::VSDRelQuadBezTo *>(rows[i]);
+      bounds.add(x, y);
+      bounds.add(relQuadBezTo->m_a * width, relQuadBezTo->m_b * height);
+      x = relQuadBezTo->m_x * width;
+      y = relQuadBezTo->m_y * height;
+      break;
+    }
+    default:
+      // elliptical arcs, infinite lines, splines and rows whose data
+      // is held elsewhere
+      return false;
+    }
+    isPointKnown = true;
+    bounds.add(x, y);
+  }
+  return true;
+}
+
+static bool isSameDouble(double a, double b)
+{
+  return !memcmp(&a, &b, sizeof(double));
+}
+
+static bool isSameDoubles(const std::vector<double> &a, const std::vector<double> &b)
+{
+  return a.size() == b.size() && (a.empty() || !memcmp(&a[0], &b[0], a.size() * sizeof(double)));
+}
+
+static bool isSamePoints(const std::vector<std::pair<double, double> > &a, const std::vector<std::pair<double, double> > &b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); ++i)
+  {
+    if (!isSameDouble(a[i].first, b[i].first) || !isSameDouble(a[i].second, b[i].second))
+      return false;
+  }
+  return true;
+}
+
 } // anonymous namespace
 
 
 libvisio::VSDContentCollector::VSDContentCollector(
   libwpg::WPGPaintInterface *painter,
-  std::vector<std::map<unsigned, XForm> > &groupXFormsSequence,
-  std::vector<std::map<unsigned, unsigned> > &groupMembershipsSequence,
-  std::vector<std::list<unsigned> > &documentPageShapeOrders,
-  VSDStyles &styles, VSDStencils &stencils
+  std::vector<VSDShapeTable> &documentShapeTables,
+  VSDStyles &styles, VSDStencils &stencils, const VSDRenderingOptions &options
 ) :
-  m_painter(painter), m_isPageStarted(false), m_pageWidth(0.0), m_pageHeight(0.0),
+  m_painter(painter), m_flatteningTolerance(options.getFlatteningTolerance()),
+  m_simplificationTolerance(options.getSimplificationTolerance()), m_maxCurveDegree(options.getMaximalCurveDegree()),
+  m_maxVertexCount(options.getMaximalVertexCount()), m_maxGroupDepth(options.getMaximalGroupDepth()),
+  m_maxElementCount(options.getMaximalElementCount()), m_vertexCount(0), m_shapeVertexCount(0), m_elementCount(0), m_exceededLimits(0),
+  m_shapeCulling(options.getShapeCulling()), m_isShapeCulled(false), m_viewportX(options.getViewportX()), m_viewportY(options.getViewportY()),
+  m_viewportWidth(options.getViewportWidth()), m_viewportHeight(options.getViewportHeight()), m_geometryRows(),
+  m_isPageStarted(false), m_pageWidth(0.0), m_pageHeight(0.0),
   m_shadowOffsetX(0.0), m_shadowOffsetY(0.0),
   m_scale(1.0), m_x(0.0), m_y(0.0), m_originalX(0.0), m_originalY(0.0), m_xform(), m_txtxform(0), m_misc(),
-  m_currentFillGeometry(), m_currentLineGeometry(), m_groupXForms(groupXFormsSequence.empty() ? 0 : &groupXFormsSequence[0]),
-  m_currentForeignData(), m_currentOLEData(), m_currentForeignProps(), m_currentShapeId(0), m_foreignType((unsigned)-1),
+  m_currentFillGeometry(), m_currentLineGeometry(),
+  m_currentForeignData(), m_currentOLEData(), m_currentForeignProps(), m_currentShapeId(0), m_currentShapeIndex(MINUS_ONE), m_foreignType((unsigned)-1),
   m_foreignFormat(0), m_foreignOffsetX(0.0), m_foreignOffsetY(0.0), m_foreignWidth(0.0), m_foreignHeight(0.0),
   m_noLine(false), m_noFill(false), m_noShow(false), m_fonts(),
   m_currentLevel(0), m_isShapeStarted(false),
-  m_groupXFormsSequence(groupXFormsSequence), m_groupMembershipsSequence(groupMembershipsSequence),
-  m_groupMemberships(m_groupMembershipsSequence.begin()),
+  m_documentShapeTables(documentShapeTables), m_shapeTable(documentShapeTables.empty() ? 0 : &documentShapeTables[0]),
   m_currentPageNumber(0), m_shapeOutputDrawing(0), m_shapeOutputText(0),
-  m_pageOutputDrawing(), m_pageOutputText(), m_documentPageShapeOrders(documentPageShapeOrders),
-  m_pageShapeOrder(m_documentPageShapeOrders.begin()), m_isFirstGeometry(true), m_NURBSData(), m_polylineData(),
+  m_pageOutputDrawing(), m_pageOutputText(), m_unlistedOutputDrawing(), m_unlistedOutputText(), m_isFirstGeometry(true), m_NURBSData(), m_polylineData(),
   m_textStream(), m_names(), m_stencilNames(), m_fields(), m_stencilFields(), m_fieldIndex(0),
   m_textFormat(VSD_TEXT_ANSI), m_charFormats(), m_paraFormats(), m_lineStyle(), m_fillStyle(),
   m_textBlockStyle(), m_defaultCharStyle(), m_defaultParaStyle(), m_currentStyleSheet(0), m_styles(styles),
-  m_stencils(stencils), m_stencilShape(0), m_isStencilStarted(false), m_currentGeometryCount(0),
-  m_backgroundPageID(MINUS_ONE), m_currentPageID(0), m_currentPage(), m_pages(),
+  m_stencils(stencils), m_stencilShape(0), m_isStencilStarted(false), m_stencilCurves(), m_stencilCurveOrder(), m_stencilCurveSize(0), m_currentGeometryCount(0),
+  m_backgroundPageID(MINUS_ONE), m_currentPageID(0), m_currentPage(), m_pages(options.getMaximalBackgroundDepth()),
   m_splineControlPoints(), m_splineKnotVector(), m_splineX(0.0), m_splineY(0.0),
   m_splineLastKnot(0.0), m_splineDegree(0), m_splineLevel(0), m_currentShapeLevel(0),
-  m_isBackgroundPage(false)
+  m_isBackgroundPage(false), m_isShapeTransformValid(false), m_shapeTransform(),
+  m_shapeFlipX(false), m_shapeFlipY(false)
 {
 }
 
@@ -224,6 +712,21 @@ void libvisio::VSDContentCollector::_flushShape()
   if (m_textStream.size())
     numTextElements++;
 
+  if (m_isShapeCulled || (m_shapeCulling && _isShapeOutsideView(0)))
+  {
+    // A shape culled before it was built has no paths, text or foreign
+    // data; the others are tested again on their paths, which are dropped
+    m_currentFillGeometry.clear();
+    m_currentLineGeometry.clear();
+    m_currentForeignData.clear();
+    m_currentForeignProps.clear();
+    m_textStream.clear();
+    m_shapeVertexCount = 0;
+    m_isShapeCulled = false;
+    m_isShapeStarted = false;
+    return;
+  }
+
   if (numPathElements+numForeignElements+numTextElements > 1)
     m_shapeOutputDrawing->addStartLayer(WPXPropertyList());
 
@@ -243,6 +746,29 @@ void libvisio::VSDContentCollector::_flushShape()
       m_shapeOutputDrawing->addEndLayer();
   }
 
+  if (m_maxElementCount)
+  {
+    // A shape that does not fit is left out; the shapes after it that
+    // still fit are drawn
+    const unsigned long count = m_shapeOutputDrawing->size() + m_shapeOutputText->size();
+    if (count > m_maxElementCount - m_elementCount)
+    {
+      if (_exceedLimit(VSDRenderingOptions::LIMIT_ELEMENT_COUNT))
+      {
+        VSD_DEBUG_MSG(("VSDContentCollector: more than %lu output elements, leaving out the shapes that do not fit\n", m_maxElementCount));
+      }
+      *m_shapeOutputDrawing = VSDOutputElementList();
+      *m_shapeOutputText = VSDOutputElementList();
+      m_shapeVertexCount = 0;
+    }
+    else
+      m_elementCount += count;
+  }
+
+  // only the points of the paths drawn count against the vertex limit
+  if (numPathElements)
+    m_vertexCount += m_shapeVertexCount;
+  m_shapeVertexCount = 0;
   m_isShapeStarted = false;
 }
 
@@ -256,7 +782,7 @@ void libvisio::VSDContentCollector::_flushCurrentPath()
   WPXPropertyList linePathProps(styleProps);
   linePathProps.insert("draw:fill", "none");
 
-  std::vector<WPXPropertyList> tmpPath;
+  VSDPath tmpPath;
   if (m_fillStyle.pattern && !m_currentFillGeometry.empty())
   {
     bool firstPoint = true;
@@ -268,17 +794,15 @@ void libvisio::VSDContentCollector::_flushCurrentPath()
         firstPoint = false;
         wasMove = true;
       }
-      else if (m_currentFillGeometry[i]["libwpg:path-action"]->getStr() == "M")
+      else if (m_currentFillGeometry[i].action == VSD_PATH_MOVE_TO)
       {
         if (!tmpPath.empty())
         {
           if (!wasMove)
           {
-            if (tmpPath.back()["libwpg:path-action"]->getStr() != "Z")
+            if (tmpPath.back().action != VSD_PATH_CLOSE)
             {
-              WPXPropertyList closedPath;
-              closedPath.insert("libwpg:path-action", "Z");
-              tmpPath.push_back(closedPath);
+              tmpPath.push_back(VSDPathElement(VSD_PATH_CLOSE));
             }
           }
           else
@@ -296,23 +820,20 @@ void libvisio::VSDContentCollector::_flushCurrentPath()
     {
       if (!wasMove)
       {
-        if (tmpPath.back()["libwpg:path-action"]->getStr() != "Z")
+        if (tmpPath.back().action != VSD_PATH_CLOSE)
         {
-          WPXPropertyList closedPath;
-          closedPath.insert("libwpg:path-action", "Z");
-          tmpPath.push_back(closedPath);
+          tmpPath.push_back(VSDPathElement(VSD_PATH_CLOSE));
         }
       }
       else
         tmpPath.pop_back();
     }
+    if (!tmpPath.empty() && m_simplificationTolerance > 0.0)
+      simplifyPath(tmpPath, m_simplificationTolerance);
     if (!tmpPath.empty())
     {
-      WPXPropertyListVector path;
-      for (unsigned i = 0; i < tmpPath.size(); ++i)
-        path.append(tmpPath[i]);
       m_shapeOutputDrawing->addStyle(fillPathProps, WPXPropertyListVector());
-      m_shapeOutputDrawing->addPath(path);
+      m_shapeOutputDrawing->addPath(tmpPath);
     }
   }
   m_currentFillGeometry.clear();
@@ -332,10 +853,10 @@ void libvisio::VSDContentCollector::_flushCurrentPath()
       {
         firstPoint = false;
         wasMove = true;
-        x = m_currentLineGeometry[i]["svg:x"]->getDouble();
-        y = m_currentLineGeometry[i]["svg:y"]->getDouble();
+        x = m_currentLineGeometry[i].x;
+        y = m_currentLineGeometry[i].y;
       }
-      else if (m_currentLineGeometry[i]["libwpg:path-action"]->getStr() == "M")
+      else if (m_currentLineGeometry[i].action == VSD_PATH_MOVE_TO)
       {
         if (!tmpPath.empty())
         {
@@ -343,11 +864,9 @@ void libvisio::VSDContentCollector::_flushCurrentPath()
           {
             if ((x == prevX) && (y == prevY))
             {
-              if (tmpPath.back()["libwpg:path-action"]->getStr() != "Z")
+              if (tmpPath.back().action != VSD_PATH_CLOSE)
               {
-                WPXPropertyList closedPath;
-                closedPath.insert("libwpg:path-action", "Z");
-                tmpPath.push_back(closedPath);
+                tmpPath.push_back(VSDPathElement(VSD_PATH_CLOSE));
               }
             }
           }
@@ -356,17 +875,18 @@ void libvisio::VSDContentCollector::_flushCurrentPath()
             tmpPath.pop_back();
           }
         }
-        x = m_currentLineGeometry[i]["svg:x"]->getDouble();
-        y = m_currentLineGeometry[i]["svg:y"]->getDouble();
+        x = m_currentLineGeometry[i].x;
+        y = m_currentLineGeometry[i].y;
         wasMove = true;
       }
       else
         wasMove = false;
       tmpPath.push_back(m_currentLineGeometry[i]);
-      if (m_currentLineGeometry[i]["svg:x"])
-        prevX = m_currentLineGeometry[i]["svg:x"]->getDouble();
-      if (m_currentLineGeometry[i]["svg:y"])
-        prevY = m_currentLineGeometry[i]["svg:y"]->getDouble();
+      if (m_currentLineGeometry[i].action != VSD_PATH_CLOSE)
+      {
+        prevX = m_currentLineGeometry[i].x;
+        prevY = m_currentLineGeometry[i].y;
+      }
     }
     if (!tmpPath.empty())
     {
@@ -374,11 +894,9 @@ void libvisio::VSDContentCollector::_flushCurrentPath()
       {
         if ((x == prevX) && (y == prevY))
         {
-          if (tmpPath.back()["libwpg:path-action"]->getStr() != "Z")
+          if (tmpPath.back().action != VSD_PATH_CLOSE)
           {
-            WPXPropertyList closedPath;
-            closedPath.insert("libwpg:path-action", "Z");
-            tmpPath.push_back(closedPath);
+            tmpPath.push_back(VSDPathElement(VSD_PATH_CLOSE));
           }
         }
       }
@@ -387,18 +905,151 @@ void libvisio::VSDContentCollector::_flushCurrentPath()
         tmpPath.pop_back();
       }
     }
+    if (!tmpPath.empty() && m_simplificationTolerance > 0.0)
+      simplifyPath(tmpPath, m_simplificationTolerance);
     if (!tmpPath.empty())
     {
-      WPXPropertyListVector path;
-      for (unsigned i = 0; i < tmpPath.size(); ++i)
-        path.append(tmpPath[i]);
       m_shapeOutputDrawing->addStyle(linePathProps, WPXPropertyListVector());
-      m_shapeOutputDrawing->addPath(path);
+      m_shapeOutputDrawing->addPath(tmpPath);
     }
   }
   m_currentLineGeometry.clear();
 }
 
+void libvisio::VSDContentCollector::_appendPathElement(const VSDPathElement &element)
+{
+  if (m_noShow || (m_noFill && m_noLine))
+    return;
+  if (m_maxVertexCount)
+  {
+    if (_isVertexCountReached())
+    {
+      if (_exceedLimit(VSDRenderingOptions::LIMIT_VERTEX_COUNT))
+      {
+        VSD_DEBUG_MSG(("VSDContentCollector: more than %lu path points, leaving out the rest\n", m_maxVertexCount));
+      }
+      return;
+    }
+    ++m_shapeVertexCount;
+  }
+  if (!m_noFill)
+    m_currentFillGeometry.push_back(element);
+  if (!m_noLine)
+    m_currentLineGeometry.push_back(element);
+}
+
+// Tells whether the shape draws nothing inside the viewport, or the page
+// if there is no viewport. Before the shape is built, the bounds of its
+// geometry come from the extents of the given sections and of those of its
+// master, and the shape is kept if they are not known; the boxes of the
+// text and of the foreign data then count whether the shape has any or not.
+// Once it is built, the bounds come from its paths. The geometry is grown
+// by the width of the lines and the whole by the shadow.
+bool libvisio::VSDContentCollector::_isShapeOutsideView(const std::map<unsigned, VSDGeometryList> *geometries)
+{
+  // enough for the joins of the lines up to the usual miter limit
+  const double lineMargin = 2.0 * fabs(m_scale * m_lineStyle.width);
+  Bounds bounds;
+  if (geometries && (m_fillStyle.pattern || m_lineStyle.pattern))
+  {
+    const std::map<unsigned, VSDGeometryList> *sections[2] = { geometries, m_stencilShape ? &m_stencilShape->m_geometries : 0 };
+    Bounds extents;
+    for (unsigned i = 0; i < 2 && sections[i]; ++i)
+    {
+      for (std::map<unsigned, VSDGeometryList>::const_iterator iter = sections[i]->begin(); iter != sections[i]->end(); ++iter)
+      {
+        iter->second.getRows(m_geometryRows);
+        if (!addGeometryExtents(extents, m_geometryRows, m_xform.width, m_xform.height))
+          return false;
+      }
+    }
+    // the corners of the extents, which may be turned on the page
+    for (unsigned i = 0; i < 4 && !extents.isEmpty; ++i)
+    {
+      double x = i & 1 ? extents.maxX : extents.minX;
+      double y = i & 2 ? extents.maxY : extents.minY;
+      transformPoint(x, y);
+      bounds.add(m_scale * x, m_scale * y, m_lineStyle.pattern ? lineMargin : 0.0);
+    }
+  }
+  else if (!geometries)
+  {
+    if (m_fillStyle.pattern)
+      addPathBounds(bounds, m_currentFillGeometry, 0.0);
+    if (m_lineStyle.pattern)
+      addPathBounds(bounds, m_currentLineGeometry, lineMargin);
+  }
+
+  // the corners of the boxes, which may be turned on the page
+  if ((geometries || m_textStream.size()) && !m_misc.m_hideText)
+  {
+    const double width = m_txtxform ? m_txtxform->width : m_xform.width;
+    const double height = m_txtxform ? m_txtxform->height : m_xform.height;
+    for (unsigned i = 0; i < 4; ++i)
+    {
+      double x = i & 1 ? width : 0.0;
+      double y = i & 2 ? height : 0.0;
+      transformPoint(x, y, m_txtxform);
+      bounds.add(m_scale * x, m_scale * y);
+    }
+  }
+  if ((geometries || m_currentForeignData.size()) && m_foreignWidth != 0.0 && m_foreignHeight != 0.0)
+  {
+    for (unsigned i = 0; i < 4; ++i)
+    {
+      double x = m_foreignOffsetX + (i & 1 ? m_foreignWidth : 0.0);
+      double y = m_foreignOffsetY + (i & 2 ? m_foreignHeight : 0.0);
+      transformPoint(x, y);
+      bounds.add(m_scale * x, m_scale * y);
+    }
+  }
+
+  // a shape that cannot be measured is kept
+  if (bounds.isEmpty)
+    return false;
+
+  if (m_fillStyle.shadowPattern)
+  {
+    double shadow = fabs(m_fillStyle.shadowOffsetX) > fabs(m_shadowOffsetX) ? fabs(m_fillStyle.shadowOffsetX) : fabs(m_shadowOffsetX);
+    if (fabs(m_fillStyle.shadowOffsetY) > shadow)
+      shadow = fabs(m_fillStyle.shadowOffsetY);
+    if (fabs(m_shadowOffsetY) > shadow)
+      shadow = fabs(m_shadowOffsetY);
+    bounds.add(bounds.minX, bounds.minY, shadow);
+    bounds.add(bounds.maxX, bounds.maxY, shadow);
+  }
+
+  double left = m_viewportX;
+  double top = m_viewportY;
+  double right = m_viewportX + m_viewportWidth;
+  double bottom = m_viewportY + m_viewportHeight;
+  if (m_viewportWidth <= 0.0 || m_viewportHeight <= 0.0)
+  {
+    left = 0.0;
+    top = 0.0;
+    right = fabs(m_scale * m_pageWidth);
+    bottom = fabs(m_scale * m_pageHeight);
+  }
+  return bounds.maxX < left || bounds.minX > right || bounds.maxY < top || bounds.minY > bottom;
+}
+
+// Tells whether the paths drawn so far and those of the current shape hold
+// as many points as the rendering options allow.
+bool libvisio::VSDContentCollector::_isVertexCountReached() const
+{
+  return m_maxVertexCount && m_vertexCount + m_shapeVertexCount >= m_maxVertexCount;
+}
+
+// Records that a limit of the rendering options was exceeded and tells
+// whether it is the first time, so that it is reported only once.
+bool libvisio::VSDContentCollector::_exceedLimit(unsigned limit)
+{
+  if (m_exceededLimits & limit)
+    return false;
+  m_exceededLimits |= limit;
+  return true;
+}
+
 void libvisio::VSDContentCollector::_flushText()
 {
   if (!m_textStream.size() || m_misc.m_hideText)
@@ -714,44 +1365,39 @@ void libvisio::VSDContentCollector::_flushCurrentForeignData()
 
 void libvisio::VSDContentCollector::_flushCurrentPage()
 {
-  if (m_pageShapeOrder != m_documentPageShapeOrders.end() && !m_pageShapeOrder->empty() &&
-      m_groupMemberships != m_groupMembershipsSequence.end())
+  if (m_shapeTable && m_pageOutputDrawing.size() == m_shapeTable->size())
   {
-    std::stack<std::pair<unsigned, VSDOutputElementList> > groupTextStack;
-    for (std::list<unsigned>::iterator iterList = m_pageShapeOrder->begin(); iterList != m_pageShapeOrder->end(); ++iterList)
+    // The text of a group goes above all of its shapes, so it waits on the
+    // stack, as the index of the group, until the group is left.
+    const std::vector<unsigned> &order = m_shapeTable->getShapesOrder();
+    std::vector<unsigned> groupTextStack;
+    for (std::vector<unsigned>::const_iterator iterOrder = order.begin(); iterOrder != order.end(); ++iterOrder)
     {
-      std::map<unsigned, unsigned>::iterator iterGroup = m_groupMemberships->find(*iterList);
-      if (iterGroup == m_groupMemberships->end())
+      const unsigned parent = m_shapeTable->getParent(*iterOrder);
+      if (parent == MINUS_ONE)
       {
         while (!groupTextStack.empty())
         {
-          m_currentPage.append(groupTextStack.top().second);
-          groupTextStack.pop();
+          m_currentPage.append(m_pageOutputText[groupTextStack.back()]);
+          groupTextStack.pop_back();
         }
       }
-      else if (!groupTextStack.empty() && iterGroup->second != groupTextStack.top().first)
+      else
       {
-        while (!groupTextStack.empty() && groupTextStack.top().first != iterGroup->second)
+        while (!groupTextStack.empty() && groupTextStack.back() != parent)
         {
-          m_currentPage.append(groupTextStack.top().second);
-          groupTextStack.pop();
+          m_currentPage.append(m_pageOutputText[groupTextStack.back()]);
+          groupTextStack.pop_back();
         }
       }
 
-      std::map<unsigned, VSDOutputElementList>::iterator iter;
-      iter = m_pageOutputDrawing.find(*iterList);
-      if (iter != m_pageOutputDrawing.end())
-        m_currentPage.append(iter->second);
-      iter = m_pageOutputText.find(*iterList);
-      if (iter != m_pageOutputText.end())
-        groupTextStack.push(std::make_pair(*iterList, iter->second));
-      else
-        groupTextStack.push(std::make_pair(*iterList, VSDOutputElementList()));
+      m_currentPage.append(m_pageOutputDrawing[*iterOrder]);
+      groupTextStack.push_back(*iterOrder);
     }
     while (!groupTextStack.empty())
     {
-      m_currentPage.append(groupTextStack.top().second);
-      groupTextStack.pop();
+      m_currentPage.append(m_pageOutputText[groupTextStack.back()]);
+      groupTextStack.pop_back();
     }
   }
   m_pageOutputDrawing.clear();
@@ -762,7 +1408,11 @@ void libvisio::VSDContentCollector::_flushCurrentPage()
 void libvisio::VSDContentCollector::collectEllipticalArcTo(unsigned /* id */, unsigned level, double x3, double y3, double x2, double y2, double angle, double ecc)
 {
   _handleLevelChange(level);
+  _collectEllipticalArcTo(x3, y3, x2, y2, angle, ecc);
+}
 
+void libvisio::VSDContentCollector::_collectEllipticalArcTo(double x3, double y3, double x2, double y2, double angle, double ecc)
+{
   m_originalX = x3;
   m_originalY = y3;
   transformPoint(x2, y2);
@@ -782,14 +1432,7 @@ void libvisio::VSDContentCollector::collectEllipticalArcTo(unsigned /* id */, un
   if (fabs(((x1-x2n)*(y2n-y3n) - (x2n-x3n)*(y1-y2n))) <= LIBVISIO_EPSILON || fabs(((x2n-x3n)*(y1-y2n) - (x1-x2n)*(y2n-y3n))) <= LIBVISIO_EPSILON)
     // most probably all of the points lie on the same line, so use lineTo instead
   {
-    WPXPropertyList end;
-    end.insert("svg:x", m_scale*m_x);
-    end.insert("svg:y", m_scale*m_y);
-    end.insert("libwpg:path-action", "L");
-    if (!m_noFill && !m_noShow)
-      m_currentFillGeometry.push_back(end);
-    if (!m_noLine && !m_noShow)
-      m_currentLineGeometry.push_back(end);
+    _appendPathElement(VSDPathElement(VSD_PATH_LINE_TO, m_scale*m_x, m_scale*m_y));
     return;
   }
 
@@ -804,38 +1447,36 @@ void libvisio::VSDContentCollector::collectEllipticalArcTo(unsigned /* id */, un
 
   double rx = sqrt(pow(x1-x0, 2) + pow(y1-y0, 2));
   double ry = rx / ecc;
-  WPXPropertyList arc;
-  int largeArc = 0;
-  int sweep = 1;
+  bool largeArc = false;
+  bool sweep = true;
 
   // Calculate side of chord that ellipse centre and control point fall on
   double centreSide = (x3n-x1)*(y0-y1) - (y3n-y1)*(x0-x1);
   double midSide = (x3n-x1)*(y2n-y1) - (y3n-y1)*(x2n-x1);
   // Large arc if centre and control point are on the same side
   if ((centreSide > 0 && midSide > 0) || (centreSide < 0 && midSide < 0))
-    largeArc = 1;
+    largeArc = true;
   // Change direction depending of side of control point
   if (midSide > 0)
-    sweep = 0;
-
-  arc.insert("svg:rx", m_scale*rx);
-  arc.insert("svg:ry", m_scale*ry);
-  arc.insert("libwpg:rotate", angle * 180 / M_PI, WPX_GENERIC);
-  arc.insert("libwpg:large-arc", largeArc);
-  arc.insert("libwpg:sweep", sweep);
-  arc.insert("svg:x", m_scale*m_x);
-  arc.insert("svg:y", m_scale*m_y);
-  arc.insert("libwpg:path-action", "A");
-  if (!m_noFill && !m_noShow)
-    m_currentFillGeometry.push_back(arc);
-  if (!m_noLine && !m_noShow)
-    m_currentLineGeometry.push_back(arc);
+    sweep = false;
+
+  VSDPathElement arc(VSD_PATH_ARC_TO, m_scale*m_x, m_scale*m_y);
+  arc.rx = m_scale*rx;
+  arc.ry = m_scale*ry;
+  arc.rotate = angle * 180 / M_PI;
+  arc.largeArc = largeArc;
+  arc.sweep = sweep;
+  _appendPathElement(arc);
 }
 
 void libvisio::VSDContentCollector::collectEllipse(unsigned /* id */, unsigned level, double cx, double cy, double xleft, double yleft, double xtop, double ytop)
 {
   _handleLevelChange(level);
-  WPXPropertyList ellipse;
+  _collectEllipse(cx, cy, xleft, yleft, xtop, ytop);
+}
+
+void libvisio::VSDContentCollector::_collectEllipse(double cx, double cy, double xleft, double yleft, double xtop, double ytop)
+{
   double angle = fmod(2.0*M_PI + (cy > yleft ? 1.0 : -1.0)*acos((cx-xleft) / sqrt((xleft - cx)*(xleft - cx) + (yleft - cy)*(yleft - cy))), 2.0*M_PI);
   transformPoint(cx, cy);
   transformPoint(xleft, yleft);
@@ -845,48 +1486,35 @@ void libvisio::VSDContentCollector::collectEllipse(unsigned /* id */, unsigned l
   double rx = sqrt((xleft - cx)*(xleft - cx) + (yleft - cy)*(yleft - cy));
   double ry = sqrt((xtop - cx)*(xtop - cx) + (ytop - cy)*(ytop - cy));
 
-  int largeArc = 0;
+  bool largeArc = false;
   double centreSide = (xleft-xtop)*(cy-ytop) - (yleft-ytop)*(cx-xtop);
   if (centreSide > 0)
   {
-    largeArc = 1;
-  }
-  ellipse.insert("svg:x",m_scale*xleft);
-  ellipse.insert("svg:y",m_scale*yleft);
-  ellipse.insert("libwpg:path-action", "M");
-  if (!m_noFill && !m_noShow)
-    m_currentFillGeometry.push_back(ellipse);
-  if (!m_noLine && !m_noShow)
-    m_currentLineGeometry.push_back(ellipse);
-  ellipse.insert("svg:rx",m_scale*rx);
-  ellipse.insert("svg:ry",m_scale*ry);
-  ellipse.insert("svg:x",m_scale*xtop);
-  ellipse.insert("svg:y",m_scale*ytop);
-  ellipse.insert("libwpg:large-arc", largeArc?1:0);
-  ellipse.insert("libwpg:path-action", "A");
-  ellipse.insert("libwpg:rotate", angle * 180/M_PI, WPX_GENERIC);
-  if (!m_noFill && !m_noShow)
-    m_currentFillGeometry.push_back(ellipse);
-  if (!m_noLine && !m_noShow)
-    m_currentLineGeometry.push_back(ellipse);
-  ellipse.insert("svg:x",m_scale*xleft);
-  ellipse.insert("svg:y",m_scale*yleft);
-  ellipse.insert("libwpg:large-arc", largeArc?0:1);
-  if (!m_noFill && !m_noShow)
-    m_currentFillGeometry.push_back(ellipse);
-  if (!m_noLine && !m_noShow)
-    m_currentLineGeometry.push_back(ellipse);
-  ellipse.clear();
-  ellipse.insert("libwpg:path-action", "Z");
-  if (!m_noFill && !m_noShow)
-    m_currentFillGeometry.push_back(ellipse);
-  if (!m_noLine && !m_noShow)
-    m_currentLineGeometry.push_back(ellipse);
+    largeArc = true;
+  }
+  _appendPathElement(VSDPathElement(VSD_PATH_MOVE_TO, m_scale*xleft, m_scale*yleft));
+  VSDPathElement ellipse(VSD_PATH_ARC_TO, m_scale*xtop, m_scale*ytop);
+  ellipse.rx = m_scale*rx;
+  ellipse.ry = m_scale*ry;
+  ellipse.rotate = angle * 180/M_PI;
+  ellipse.largeArc = largeArc;
+  ellipse.sweep = true;
+  _appendPathElement(ellipse);
+  ellipse.x = m_scale*xleft;
+  ellipse.y = m_scale*yleft;
+  ellipse.largeArc = !largeArc;
+  _appendPathElement(ellipse);
+  _appendPathElement(VSDPathElement(VSD_PATH_CLOSE));
 }
 
 void libvisio::VSDContentCollector::collectInfiniteLine(unsigned /* id */, unsigned level, double x1, double y1, double x2, double y2)
 {
   _handleLevelChange(level);
+  _collectInfiniteLine(x1, y1, x2, y2);
+}
+
+void libvisio::VSDContentCollector::_collectInfiniteLine(double x1, double y1, double x2, double y2)
+{
   transformPoint(x1, y1);
   transformPoint(x2, y2);
 
@@ -956,26 +1584,18 @@ void libvisio::VSDContentCollector::collectInfiniteLine(unsigned /* id */, unsig
     }
   }
 
-  WPXPropertyList infLine;
-  infLine.insert("svg:x",m_scale*xmove);
-  infLine.insert("svg:y",m_scale*ymove);
-  infLine.insert("libwpg:path-action", "M");
-  if (!m_noFill && !m_noShow)
-    m_currentFillGeometry.push_back(infLine);
-  if (!m_noLine && !m_noShow)
-    m_currentLineGeometry.push_back(infLine);
-  infLine.insert("svg:x",m_scale*xline);
-  infLine.insert("svg:y",m_scale*yline);
-  infLine.insert("libwpg:path-action", "L");
-  if (!m_noFill && !m_noShow)
-    m_currentFillGeometry.push_back(infLine);
-  if (!m_noLine && !m_noShow)
-    m_currentLineGeometry.push_back(infLine);
+  _appendPathElement(VSDPathElement(VSD_PATH_MOVE_TO, m_scale*xmove, m_scale*ymove));
+  _appendPathElement(VSDPathElement(VSD_PATH_LINE_TO, m_scale*xline, m_scale*yline));
 }
 
 void libvisio::VSDContentCollector::collectRelCubBezTo(unsigned /* id */, unsigned level, double x, double y, double x1, double y1, double x2, double y2)
 {
   _handleLevelChange(level);
+  _collectRelCubBezTo(x, y, x1, y1, x2, y2);
+}
+
+void libvisio::VSDContentCollector::_collectRelCubBezTo(double x, double y, double x1, double y1, double x2, double y2)
+{
   x *= m_xform.width;
   y *= m_xform.height;
   x1 *= m_xform.width;
@@ -989,46 +1609,63 @@ void libvisio::VSDContentCollector::collectRelCubBezTo(unsigned /* id */, unsign
   transformPoint(x, y);
   m_x = x;
   m_y = y;
-  WPXPropertyList node;
-  node.insert("libwpg:path-action", "C");
-  node.insert("svg:x",m_scale*x);
-  node.insert("svg:y",m_scale*y);
-  node.insert("svg:x1",m_scale*x1);
-  node.insert("svg:y1",m_scale*y1);
-  node.insert("svg:x2",m_scale*x2);
-  node.insert("svg:y2",m_scale*y2);
-  if (!m_noFill && !m_noShow)
-    m_currentFillGeometry.push_back(node);
-  if (!m_noLine && !m_noShow)
-    m_currentLineGeometry.push_back(node);
-}
-
-void libvisio::VSDContentCollector::collectRelEllipticalArcTo(unsigned id, unsigned level, double x, double y, double a, double b, double c, double d)
+  VSDPathElement node(VSD_PATH_CUBIC_TO, m_scale*x, m_scale*y);
+  node.x1 = m_scale*x1;
+  node.y1 = m_scale*y1;
+  node.x2 = m_scale*x2;
+  node.y2 = m_scale*y2;
+  _appendPathElement(node);
+}
+
+void libvisio::VSDContentCollector::collectRelEllipticalArcTo(unsigned /* id */, unsigned level, double x, double y, double a, double b, double c, double d)
+{
+  _handleLevelChange(level);
+  _collectRelEllipticalArcTo(x, y, a, b, c, d);
+}
+
+void libvisio::VSDContentCollector::_collectRelEllipticalArcTo(double x, double y, double a, double b, double c, double d)
 {
   x *= m_xform.width;
   y *= m_xform.height;
   a *= m_xform.width;
   b *= m_xform.height;
-  collectEllipticalArcTo(id, level, x, y, a, b, c, d);
+  _collectEllipticalArcTo(x, y, a, b, c, d);
 }
 
-void libvisio::VSDContentCollector::collectRelLineTo(unsigned id, unsigned level, double x, double y)
+void libvisio::VSDContentCollector::collectRelLineTo(unsigned /* id */, unsigned level, double x, double y)
+{
+  _handleLevelChange(level);
+  _collectRelLineTo(x, y);
+}
+
+void libvisio::VSDContentCollector::_collectRelLineTo(double x, double y)
 {
   x *= m_xform.width;
   y *= m_xform.height;
-  collectLineTo(id, level, x, y);
+  _collectLineTo(x, y);
+}
+
+void libvisio::VSDContentCollector::collectRelMoveTo(unsigned /* id */, unsigned level, double x, double y)
+{
+  _handleLevelChange(level);
+  _collectRelMoveTo(x, y);
 }
 
-void libvisio::VSDContentCollector::collectRelMoveTo(unsigned id, unsigned level, double x, double y)
+void libvisio::VSDContentCollector::_collectRelMoveTo(double x, double y)
 {
   x *= m_xform.width;
   y *= m_xform.height;
-  collectMoveTo(id, level, x, y);
+  _collectMoveTo(x, y);
 }
 
 void libvisio::VSDContentCollector::collectRelQuadBezTo(unsigned /* id */, unsigned level, double x, double y, double x1, double y1)
 {
   _handleLevelChange(level);
+  _collectRelQuadBezTo(x, y, x1, y1);
+}
+
+void libvisio::VSDContentCollector::_collectRelQuadBezTo(double x, double y, double x1, double y1)
+{
   x *= m_xform.width;
   y *= m_xform.height;
   x1 *= m_xform.width;
@@ -1039,16 +1676,10 @@ void libvisio::VSDContentCollector::collectRelQuadBezTo(unsigned /* id */, unsig
   transformPoint(x, y);
   m_x = x;
   m_y = y;
-  WPXPropertyList node;
-  node.insert("libwpg:path-action", "Q");
-  node.insert("svg:x",m_scale*x);
-  node.insert("svg:y",m_scale*y);
-  node.insert("svg:x1",m_scale*x1);
-  node.insert("svg:y1",m_scale*y1);
-  if (!m_noFill && !m_noShow)
-    m_currentFillGeometry.push_back(node);
-  if (!m_noLine && !m_noShow)
-    m_currentLineGeometry.push_back(node);
+  VSDPathElement node(VSD_PATH_QUADRATIC_TO, m_scale*x, m_scale*y);
+  node.x1 = m_scale*x1;
+  node.y1 = m_scale*y1;
+  _appendPathElement(node);
 }
 
 void libvisio::VSDContentCollector::collectLine(unsigned level, const boost::optional<double> &strokeWidth, const boost::optional<Colour> &c, const boost::optional<unsigned char> &linePattern,
@@ -1077,7 +1708,8 @@ void libvisio::VSDContentCollector::collectFillAndShadow(unsigned level, const b
 void libvisio::VSDContentCollector::collectForeignData(unsigned level, const WPXBinaryData &binaryData)
 {
   _handleLevelChange(level);
-  _handleForeignData(binaryData);
+  if (!m_isShapeCulled)
+    _handleForeignData(binaryData);
 }
 
 void libvisio::VSDContentCollector::collectOLEList(unsigned /* id */, unsigned level)
@@ -1215,6 +1847,11 @@ void libvisio::VSDContentCollector::_handleForeignData(const WPXBinaryData &bina
 void libvisio::VSDContentCollector::collectGeometry(unsigned /* id */, unsigned level, bool noFill, bool noLine, bool noShow)
 {
   _handleLevelChange(level);
+  _collectGeometry(noFill, noLine, noShow);
+}
+
+void libvisio::VSDContentCollector::_collectGeometry(bool noFill, bool noLine, bool noShow)
+{
   m_x = 0.0;
   m_y = 0.0;
   m_originalX = 0.0;
@@ -1230,42 +1867,43 @@ void libvisio::VSDContentCollector::collectGeometry(unsigned /* id */, unsigned
 void libvisio::VSDContentCollector::collectMoveTo(unsigned /* id */, unsigned level, double x, double y)
 {
   _handleLevelChange(level);
+  _collectMoveTo(x, y);
+}
+
+void libvisio::VSDContentCollector::_collectMoveTo(double x, double y)
+{
   m_originalX = x;
   m_originalY = y;
   transformPoint(x, y);
   m_x = x;
   m_y = y;
-  WPXPropertyList end;
-  end.insert("svg:x", m_scale*m_x);
-  end.insert("svg:y", m_scale*m_y);
-  end.insert("libwpg:path-action", "M");
-  if (!m_noFill && !m_noShow)
-    m_currentFillGeometry.push_back(end);
-  if (!m_noLine && !m_noShow)
-    m_currentLineGeometry.push_back(end);
+  _appendPathElement(VSDPathElement(VSD_PATH_MOVE_TO, m_scale*m_x, m_scale*m_y));
 }
 
 void libvisio::VSDContentCollector::collectLineTo(unsigned /* id */, unsigned level, double x, double y)
 {
   _handleLevelChange(level);
+  _collectLineTo(x, y);
+}
+
+void libvisio::VSDContentCollector::_collectLineTo(double x, double y)
+{
   m_originalX = x;
   m_originalY = y;
   transformPoint(x, y);
   m_x = x;
   m_y = y;
-  WPXPropertyList end;
-  end.insert("svg:x", m_scale*m_x);
-  end.insert("svg:y", m_scale*m_y);
-  end.insert("libwpg:path-action", "L");
-  if (!m_noFill && !m_noShow)
-    m_currentFillGeometry.push_back(end);
-  if (!m_noLine && !m_noShow)
-    m_currentLineGeometry.push_back(end);
+  _appendPathElement(VSDPathElement(VSD_PATH_LINE_TO, m_scale*m_x, m_scale*m_y));
 }
 
 void libvisio::VSDContentCollector::collectArcTo(unsigned /* id */, unsigned level, double x2, double y2, double bow)
 {
   _handleLevelChange(level);
+  _collectArcTo(x2, y2, bow);
+}
+
+void libvisio::VSDContentCollector::_collectArcTo(double x2, double y2, double bow)
+{
   m_originalX = x2;
   m_originalY = y2;
   transformPoint(x2, y2);
@@ -1276,51 +1914,153 @@ void libvisio::VSDContentCollector::collectArcTo(unsigned /* id */, unsigned lev
   {
     m_x = x2;
     m_y = y2;
-    WPXPropertyList end;
-    end.insert("svg:x", m_scale*m_x);
-    end.insert("svg:y", m_scale*m_y);
-    end.insert("libwpg:path-action", "L");
-    if (!m_noFill && !m_noShow)
-      m_currentFillGeometry.push_back(end);
-    if (!m_noLine && !m_noShow)
-      m_currentLineGeometry.push_back(end);
+    _appendPathElement(VSDPathElement(VSD_PATH_LINE_TO, m_scale*m_x, m_scale*m_y));
   }
   else
   {
-    WPXPropertyList arc;
     double chord = sqrt(pow((y2 - m_y),2) + pow((x2 - m_x),2));
     double radius = (4 * bow * bow + chord * chord) / (8 * fabs(bow));
-    int largeArc = fabs(bow) > radius ? 1 : 0;
+    bool largeArc = fabs(bow) > radius;
     bool sweep = (bow < 0);
     transformFlips(sweep, sweep);
 
     m_x = x2;
     m_y = y2;
-    arc.insert("svg:rx", m_scale*radius);
-    arc.insert("svg:ry", m_scale*radius);
-    arc.insert("libwpg:rotate", angle*180/M_PI, WPX_GENERIC);
-    arc.insert("libwpg:large-arc", largeArc);
-    arc.insert("libwpg:sweep", sweep);
-    arc.insert("svg:x", m_scale*m_x);
-    arc.insert("svg:y", m_scale*m_y);
-    arc.insert("libwpg:path-action", "A");
-    if (!m_noFill && !m_noShow)
-      m_currentFillGeometry.push_back(arc);
-    if (!m_noLine && !m_noShow)
-      m_currentLineGeometry.push_back(arc);
+    VSDPathElement arc(VSD_PATH_ARC_TO, m_scale*m_x, m_scale*m_y);
+    arc.rx = m_scale*radius;
+    arc.ry = m_scale*radius;
+    arc.rotate = angle*180/M_PI;
+    arc.largeArc = largeArc;
+    arc.sweep = sweep;
+    _appendPathElement(arc);
   }
 }
 
 #define VSD_NUM_POLYLINES_PER_NURBS 200
+// the number of doubles the curve cache may hold, 8 MB
+#define VSD_MAX_CACHED_CURVE_SIZE 0x100000
 
-void libvisio::VSDContentCollector::collectNURBSTo(unsigned /* id */, unsigned level, double x2, double y2, unsigned char xType, unsigned char yType, unsigned degree, std::vector<std::pair<double, double> > controlPoints, std::vector<double> knotVector, std::vector<double> weights)
+void libvisio::VSDContentCollector::collectNURBSTo(unsigned id, unsigned level, double x2, double y2, unsigned char xType, unsigned char yType, unsigned degree,
+                                                   const std::vector<std::pair<double, double> > &controlPoints, const std::vector<double> &knotVector, const std::vector<double> &weights)
 {
   _handleLevelChange(level);
+  std::vector<std::pair<double, double> > tmpControlPoints(controlPoints);
+  std::vector<double> tmpKnotVector(knotVector);
+  _collectNURBSTo(id, x2, y2, xType, yType, degree, tmpControlPoints, tmpKnotVector, weights);
+}
 
+// Draws the NURBS of the row id, completing the control points and the
+// knot vector in place; callers that own the vectors pass them here to
+// save the copies. The curves of instances of masters are kept in shape
+// co-ordinates, so that the other instances drawing the same curve only
+// transform them. Rows that are not in a geometry section pass MINUS_ONE.
+void libvisio::VSDContentCollector::_collectNURBSTo(unsigned id, double x2, double y2, unsigned char xType, unsigned char yType, unsigned degree,
+                                                    std::vector<std::pair<double, double> > &controlPoints, std::vector<double> &knotVector, const std::vector<double> &weights)
+{
   if (knotVector.empty() || controlPoints.empty() || weights.empty())
     // Here, maybe we should just draw line to (x2,y2)
     return;
 
+  if (m_maxCurveDegree && degree > m_maxCurveDegree)
+  {
+    if (_exceedLimit(VSDRenderingOptions::LIMIT_CURVE_DEGREE))
+    {
+      VSD_DEBUG_MSG(("VSDContentCollector: NURBS of degree %u drawn as control polygons\n", degree));
+    }
+    _collectPolylineTo(x2, y2, xType, yType, controlPoints);
+    return;
+  }
+
+  // the points are not computed when none of them would be drawn
+  const bool isDrawn = !_isVertexCountReached();
+  std::vector<std::pair<double, double> > curvePoints;
+  // only the rows of masters may be drawn again by other instances
+  if (isDrawn && m_stencilShape && id != MINUS_ONE)
+    _cachedNURBSCurvePoints(id, x2, y2, xType, yType, degree, controlPoints, knotVector, weights, curvePoints);
+  else if (isDrawn)
+    _NURBSCurvePoints(x2, y2, xType, yType, degree, controlPoints, knotVector, weights, curvePoints);
+  transformPoints(curvePoints);
+
+  for (unsigned i = 0; i < curvePoints.size(); i++)
+    _appendPathElement(VSDPathElement(VSD_PATH_LINE_TO, m_scale*curvePoints[i].first, m_scale*curvePoints[i].second));
+
+  m_originalX = x2;
+  m_originalY = y2;
+  m_x = x2;
+  m_y = y2;
+  transformPoint(m_x, m_y);
+  _appendPathElement(VSDPathElement(VSD_PATH_LINE_TO, m_scale*m_x, m_scale*m_y));
+}
+
+// Computes the points of the NURBS of the row id of the master, through
+// the curve cache. The cache holds the curves of the whole document, so
+// that the instances on all pages share them. When it is full, the least
+// recently used curves are dropped one at a time.
+void libvisio::VSDContentCollector::_cachedNURBSCurvePoints(unsigned id, double x2, double y2, unsigned char xType, unsigned char yType, unsigned degree,
+                                                            std::vector<std::pair<double, double> > &controlPoints, std::vector<double> &knotVector,
+                                                            const std::vector<double> &weights, std::vector<std::pair<double, double> > &curvePoints)
+{
+  CurveCacheKey key;
+  key.master = m_stencilShape;
+  key.geometry = m_currentGeometryCount;
+  key.row = id;
+  // co-ordinates given as percentages depend on the size of the shape
+  key.width = xType == 0 ? m_xform.width : 0.0;
+  key.height = yType == 0 ? m_xform.height : 0.0;
+  // the adaptive flattening depends on the output scale too
+  key.scale = m_flatteningTolerance > 0.0 ? fabs(m_scale) : 0.0;
+
+  std::map<CurveCacheKey, CurveCacheEntry>::iterator iter = m_stencilCurves.find(key);
+  if (iter != m_stencilCurves.end())
+  {
+    const CurveCacheEntry &entry = iter->second;
+    if (isSameDouble(entry.x2, x2) && isSameDouble(entry.y2, y2)
+        && isSameDouble(entry.startX, m_originalX) && isSameDouble(entry.startY, m_originalY)
+        && entry.xType == xType && entry.yType == yType && entry.degree == degree
+        && isSamePoints(entry.controlPoints, controlPoints)
+        && isSameDoubles(entry.knots, knotVector) && isSameDoubles(entry.weights, weights))
+    {
+      m_stencilCurveOrder.splice(m_stencilCurveOrder.begin(), m_stencilCurveOrder, entry.order);
+      curvePoints = entry.points;
+      return;
+    }
+    // an instance overrode the row
+    m_stencilCurveSize -= entry.size();
+    m_stencilCurveOrder.erase(entry.order);
+    m_stencilCurves.erase(iter);
+  }
+
+  CurveCacheEntry &entry = m_stencilCurves[key];
+  entry.x2 = x2;
+  entry.y2 = y2;
+  entry.startX = m_originalX;
+  entry.startY = m_originalY;
+  entry.xType = xType;
+  entry.yType = yType;
+  entry.degree = degree;
+  entry.controlPoints = controlPoints;
+  entry.knots = knotVector;
+  entry.weights = weights;
+  _NURBSCurvePoints(x2, y2, xType, yType, degree, controlPoints, knotVector, weights, curvePoints);
+  entry.points = curvePoints;
+  entry.order = m_stencilCurveOrder.insert(m_stencilCurveOrder.begin(), key);
+  m_stencilCurveSize += entry.size();
+
+  while (m_stencilCurveSize > VSD_MAX_CACHED_CURVE_SIZE && !m_stencilCurveOrder.empty())
+  {
+    iter = m_stencilCurves.find(m_stencilCurveOrder.back());
+    m_stencilCurveSize -= iter->second.size();
+    m_stencilCurves.erase(iter);
+    m_stencilCurveOrder.pop_back();
+  }
+}
+
+// Computes the points of the NURBS that ends at (x2, y2), in shape
+// co-ordinates.
+void libvisio::VSDContentCollector::_NURBSCurvePoints(double x2, double y2, unsigned char xType, unsigned char yType, unsigned degree,
+                                                      std::vector<std::pair<double, double> > &controlPoints, std::vector<double> &knotVector,
+                                                      const std::vector<double> &weights, std::vector<std::pair<double, double> > &curvePoints)
+{
   // Fill in end knots
   while (knotVector.size() < (controlPoints.size() + degree + 2))
   {
@@ -1342,73 +2082,192 @@ void libvisio::VSDContentCollector::collectNURBSTo(unsigned /* id */, unsigned l
   controlPoints.push_back(std::pair<double,double>(x2, y2));
   controlPoints.insert(controlPoints.begin(), std::pair<double, double>(m_originalX, m_originalY));
 
-  // Generate NURBS using VSD_NUM_POLYLINES_PER_NURBS polylines
-  WPXPropertyList NURBS;
   double step = (knotVector.back() - knotVector[0]) / VSD_NUM_POLYLINES_PER_NURBS;
+  std::vector<double> basis(degree + 1);
 
-  for (unsigned i = 0; i < VSD_NUM_POLYLINES_PER_NURBS; i++)
+  if (m_flatteningTolerance > 0.0)
+    // Subdivide the curve until it is flat enough on the output
+    _flattenNURBS(degree, knotVector[0], knotVector[0] + (VSD_NUM_POLYLINES_PER_NURBS - 1) * step,
+                  controlPoints, knotVector, weights, basis, curvePoints);
+  else
   {
-    NURBS.clear();
-    NURBS.insert("libwpg:path-action", "L");
-    double nextX = 0;
-    double nextY = 0;
-    double denominator = LIBVISIO_EPSILON;
-
-    for (unsigned p = 0; p < controlPoints.size() && p < weights.size(); p++)
+    // Generate NURBS using VSD_NUM_POLYLINES_PER_NURBS polylines
+    curvePoints.reserve(VSD_NUM_POLYLINES_PER_NURBS);
+    for (unsigned i = 0; i < VSD_NUM_POLYLINES_PER_NURBS; i++)
     {
-      double basis = _NURBSBasis(p, degree, knotVector[0] + i * step, knotVector);
-      nextX += basis * controlPoints[p].first * weights[p];
-      nextY += basis * controlPoints[p].second * weights[p];
-      denominator += weights[p] * basis;
+      double nextX = 0;
+      double nextY = 0;
+      _NURBSPoint(degree, knotVector[0] + i * step, controlPoints, knotVector, weights, basis, nextX, nextY);
+      curvePoints.push_back(std::make_pair(nextX, nextY));
     }
-    nextX = (nextX/denominator);
-    nextY = (nextY/denominator);
-    transformPoint(nextX, nextY);
-    NURBS.insert("svg:x", m_scale*nextX);
-    NURBS.insert("svg:y", m_scale*nextY);
-    if (!m_noFill && !m_noShow)
-      m_currentFillGeometry.push_back(NURBS);
-    if (!m_noLine && !m_noShow)
-      m_currentLineGeometry.push_back(NURBS);
   }
-
-  m_originalX = x2;
-  m_originalY = y2;
-  m_x = x2;
-  m_y = y2;
-  transformPoint(m_x, m_y);
-  NURBS.clear();
-  NURBS.insert("libwpg:path-action", "L");
-  NURBS.insert("svg:x", m_scale*m_x);
-  NURBS.insert("svg:y", m_scale*m_y);
-  if (!m_noFill && !m_noShow)
-    m_currentFillGeometry.push_back(NURBS);
-  if (!m_noLine && !m_noShow)
-    m_currentLineGeometry.push_back(NURBS);
 }
 
-double libvisio::VSDContentCollector::_NURBSBasis(unsigned knot, unsigned degree, double point, const std::vector<double> &knotVector)
+// Evaluates at point the degree+1 B-spline basis functions of the given
+// degree that may not vanish there, into basis, and returns the index of
+// the first of them, as in de Boor's algorithm. Those are the functions
+// over the knot span holding point; the span is found by a binary search
+// of the non-decreasing knots and the Cox-de Boor recurrence is then only
+// run over the triangle of functions above it. Terms that need knots
+// missing from the vector count as zero. All the functions vanish when
+// point lies outside of the knots.
+int libvisio::VSDContentCollector::_NURBSBasis(unsigned degree, double point, const std::vector<double> &knotVector, std::vector<double> &basis)
 {
-  double basis = 0;
-  if (knotVector.empty())
-    return basis;
-  if (degree == 0)
+  const int size = (int)knotVector.size();
+  basis.assign(degree + 1, 0.0);
+  std::vector<double>::const_iterator upper = std::upper_bound(knotVector.begin(), knotVector.end(), point);
+  if (upper == knotVector.begin() || upper == knotVector.end())
+    return 0;
+
+  const int span = (int)(upper - knotVector.begin()) - 1;
+  const int first = span - (int)degree;
+  basis[degree] = 1.0;
+  for (unsigned k = 1; k <= degree; ++k)
   {
-    if (knotVector[knot] <= point && point < knotVector[knot+1])
-      return 1;
-    else
-      return 0;
+    // basis[j+1] still holds the function of degree k-1 when basis[j] is
+    // updated to degree k
+    for (unsigned j = degree - k; j <= degree; ++j)
+    {
+      const int i = first + (int)j;
+      double value = 0.0;
+      if (i >= 0 && size > i+(int)k && fabs(knotVector[i+k]-knotVector[i]) > LIBVISIO_EPSILON)
+        value = (point-knotVector[i])/(knotVector[i+k]-knotVector[i]) * basis[j];
+      if (j < degree && i+1 >= 0 && size > i+(int)k+1 && fabs(knotVector[i+k+1] - knotVector[i+1]) > LIBVISIO_EPSILON)
+        value += (knotVector[i+k+1]-point)/(knotVector[i+k+1]-knotVector[i+1]) * basis[j+1];
+      basis[j] = value;
+    }
   }
-  if (knotVector.size() > knot+degree && fabs(knotVector[knot+degree]-knotVector[knot]) > LIBVISIO_EPSILON)
-    basis = (point-knotVector[knot])/(knotVector[knot+degree]-knotVector[knot]) * _NURBSBasis(knot, degree-1, point, knotVector);
+  return first;
+}
+
+// Evaluates the NURBS curve at point, in shape co-ordinates, from the
+// degree+1 control points whose basis functions may not vanish there. The
+// basis vector is scratch space.
+void libvisio::VSDContentCollector::_NURBSPoint(unsigned degree, double point, const std::vector<std::pair<double, double> > &controlPoints,
+                                                const std::vector<double> &knotVector, const std::vector<double> &weights,
+                                                std::vector<double> &basis, double &x, double &y)
+{
+  const int count = (int)(controlPoints.size() < weights.size() ? controlPoints.size() : weights.size());
+  double nextX = 0;
+  double nextY = 0;
+  double denominator = LIBVISIO_EPSILON;
+
+  const int first = _NURBSBasis(degree, point, knotVector, basis);
+  for (unsigned j = 0; j <= degree; j++)
+  {
+    const int p = first + (int)j;
+    if (p < 0 || p >= count || basis[j] == 0.0)
+      continue;
+    nextX += basis[j] * controlPoints[p].first * weights[p];
+    nextY += basis[j] * controlPoints[p].second * weights[p];
+    denominator += weights[p] * basis[j];
+  }
+  x = nextX/denominator;
+  y = nextY/denominator;
+}
+
+#define VSD_MAX_NURBS_SUBDIVISION_DEPTH 12
+
+// Flattens the NURBS curve between the parameters start and end into shape
+// co-ordinates. The curve is split at its knots, where it may bend sharply,
+// and every piece is then halved until the points at its
+// quarters lie within the flattening tolerance of its chord on the output.
+// Flat or small pieces thus get few points and tight bends many. The shape
+// transforms only rotate, flip and move, so distances here are those on
+// the output but for the scale.
+void libvisio::VSDContentCollector::_flattenNURBS(unsigned degree, double start, double end,
+                                                  const std::vector<std::pair<double, double> > &controlPoints,
+                                                  const std::vector<double> &knotVector, const std::vector<double> &weights,
+                                                  std::vector<double> &basis, std::vector<std::pair<double, double> > &curvePoints)
+{
+  std::vector<double> breaks;
+  breaks.push_back(start);
+  for (std::vector<double>::const_iterator it = knotVector.begin(); it != knotVector.end(); ++it)
+  {
+    if (*it > breaks.back() + LIBVISIO_EPSILON && *it < end - LIBVISIO_EPSILON)
+      breaks.push_back(*it);
+  }
+  if (end > start)
+    breaks.push_back(end);
+
+  double x = 0.0;
+  double y = 0.0;
+  _NURBSPoint(degree, start, controlPoints, knotVector, weights, basis, x, y);
+  curvePoints.push_back(std::make_pair(x, y));
+
+  std::vector<NURBSPiece> pieces;
+  for (size_t i = 1; i < breaks.size(); ++i)
+  {
+    NURBSPiece piece;
+    piece.start = breaks[i-1];
+    piece.end = breaks[i];
+    piece.startX = curvePoints.back().first;
+    piece.startY = curvePoints.back().second;
+    _NURBSPoint(degree, piece.end, controlPoints, knotVector, weights, basis, piece.endX, piece.endY);
+    piece.depth = 0;
+
+    // The pieces still to split are on a stack, the right half below the
+    // left one, so that the points come out in order.
+    pieces.push_back(piece);
+    while (!pieces.empty())
+    {
+      const NURBSPiece current = pieces.back();
+      pieces.pop_back();
+
+      const double chordX = current.endX - current.startX;
+      const double chordY = current.endY - current.startY;
+      const double chordLength = sqrt(chordX*chordX + chordY*chordY);
+      double midX = 0.0;
+      double midY = 0.0;
+      bool isFlat = true;
+      for (unsigned quarter = 1; quarter < 4; ++quarter)
+      {
+        double qX = 0.0;
+        double qY = 0.0;
+        _NURBSPoint(degree, current.start + quarter * (current.end - current.start) / 4, controlPoints, knotVector, weights, basis, qX, qY);
+        if (quarter == 2)
+        {
+          midX = qX;
+          midY = qY;
+        }
+        double distance = 0.0;
+        if (chordLength > LIBVISIO_EPSILON)
+          distance = fabs(chordX*(qY - current.startY) - chordY*(qX - current.startX)) / chordLength;
+        else
+          distance = sqrt((qX - current.startX)*(qX - current.startX) + (qY - current.startY)*(qY - current.startY));
+        if (distance * fabs(m_scale) > m_flatteningTolerance)
+          isFlat = false;
+      }
 
-  if (knotVector.size() > knot+degree+1 && fabs(knotVector[knot+degree+1] - knotVector[knot+1]) > LIBVISIO_EPSILON)
-    basis += (knotVector[knot+degree+1]-point)/(knotVector[knot+degree+1]-knotVector[knot+1]) * _NURBSBasis(knot+1, degree-1, point, knotVector);
+      if (isFlat || current.depth >= VSD_MAX_NURBS_SUBDIVISION_DEPTH)
+      {
+        curvePoints.push_back(std::make_pair(current.endX, current.endY));
+        continue;
+      }
 
-  return basis;
+      NURBSPiece half = current;
+      half.start = (current.start + current.end) / 2;
+      half.startX = midX;
+      half.startY = midY;
+      half.depth = current.depth + 1;
+      pieces.push_back(half);
+      half = current;
+      half.end = (current.start + current.end) / 2;
+      half.endX = midX;
+      half.endY = midY;
+      half.depth = current.depth + 1;
+      pieces.push_back(half);
+    }
+  }
 }
 
 void libvisio::VSDContentCollector::collectNURBSTo(unsigned id, unsigned level, double x2, double y2, double knot, double knotPrev, double weight, double weightPrev, const NURBSData &data)
+{
+  _handleLevelChange(level);
+  _collectNURBSTo(id, x2, y2, knot, knotPrev, weight, weightPrev, data);
+}
+
+void libvisio::VSDContentCollector::_collectNURBSTo(unsigned id, double x2, double y2, double knot, double knotPrev, double weight, double weightPrev, const NURBSData &data)
 {
   NURBSData newData(data);
   newData.knots.push_back(knot);
@@ -1416,132 +2275,130 @@ void libvisio::VSDContentCollector::collectNURBSTo(unsigned id, unsigned level,
   newData.knots.insert(newData.knots.begin(), knotPrev);
   newData.weights.push_back(weight);
   newData.weights.insert(newData.weights.begin(), weightPrev);
-  collectNURBSTo(id, level, x2, y2, newData.xType, newData.yType, newData.degree, newData.points, newData.knots, newData.weights);
+  _collectNURBSTo(id, x2, y2, newData.xType, newData.yType, newData.degree, newData.points, newData.knots, newData.weights);
 }
 
 /* NURBS with incomplete data */
 void libvisio::VSDContentCollector::collectNURBSTo(unsigned id, unsigned level, double x2, double y2, double knot, double knotPrev, double weight, double weightPrev, unsigned dataID)
+{
+  _handleLevelChange(level);
+  _collectNURBSTo(id, x2, y2, knot, knotPrev, weight, weightPrev, dataID);
+}
+
+void libvisio::VSDContentCollector::_collectNURBSTo(unsigned id, double x2, double y2, double knot, double knotPrev, double weight, double weightPrev, unsigned dataID)
 {
   std::map<unsigned, NURBSData>::const_iterator iter;
   std::map<unsigned, NURBSData>::const_iterator iterEnd;
-  NURBSData data;
   if (dataID == 0xFFFFFFFE) // Use stencil NURBS data
   {
     if (!m_stencilShape)
-    {
-      _handleLevelChange(level);
       return;
-    }
 
     // Get stencil geometry so as to find stencil NURBS data ID
     std::map<unsigned, VSDGeometryList>::const_iterator cstiter = m_stencilShape->m_geometries.find(m_currentGeometryCount-1);
     VSDGeometryListElement *element = 0;
     if (cstiter == m_stencilShape->m_geometries.end())
-    {
-      _handleLevelChange(level);
       return;
-    }
     element = cstiter->second.getElement(id);
     iter = m_stencilShape->m_nurbsData.find(element ? element->getDataID() : MINUS_ONE);
     iterEnd =  m_stencilShape->m_nurbsData.end();
   }
   else // No stencils involved, directly get dataID and fill in missing parts
   {
-    iter = m_NURBSData.find(dataID);
-    iterEnd = m_NURBSData.end();
+    // master geometry refers to the master's own data
+    const std::map<unsigned, NURBSData> &nurbsData = m_isStencilStarted ? m_stencilShape->m_nurbsData : m_NURBSData;
+    iter = nurbsData.find(dataID);
+    iterEnd = nurbsData.end();
   }
 
   if (iter != iterEnd)
-    collectNURBSTo(id, level, x2, y2, knot, knotPrev, weight, weightPrev, iter->second);
-  else
-    _handleLevelChange(level);
+    _collectNURBSTo(id, x2, y2, knot, knotPrev, weight, weightPrev, iter->second);
 }
 
 void libvisio::VSDContentCollector::collectPolylineTo(unsigned /* id */ , unsigned level, double x, double y, unsigned char xType, unsigned char yType, const std::vector<std::pair<double, double> > &points)
 {
   _handleLevelChange(level);
+  _collectPolylineTo(x, y, xType, yType, points);
+}
 
-  WPXPropertyList polyline;
-  std::vector<std::pair<double, double> > tmpPoints(points);
-  for (unsigned i = 0; i< points.size(); i++)
+void libvisio::VSDContentCollector::_collectPolylineTo(double x, double y, unsigned char xType, unsigned char yType, const std::vector<std::pair<double, double> > &points)
+{
+  std::vector<std::pair<double, double> > tmpPoints;
+  // the points are not copied when none of them would be drawn
+  if (!_isVertexCountReached())
+    tmpPoints = points;
+  if (xType == 0 || yType == 0)
   {
-    polyline.clear();
-    if (xType == 0)
-      tmpPoints[i].first *= m_xform.width;
-    if (yType == 0)
-      tmpPoints[i].second *= m_xform.height;
-
-    transformPoint(tmpPoints[i].first, tmpPoints[i].second);
-    polyline.insert("libwpg:path-action", "L");
-    polyline.insert("svg:x", m_scale*tmpPoints[i].first);
-    polyline.insert("svg:y", m_scale*tmpPoints[i].second);
-    if (!m_noFill && !m_noShow)
-      m_currentFillGeometry.push_back(polyline);
-    if (!m_noLine && !m_noShow)
-      m_currentLineGeometry.push_back(polyline);
+    for (unsigned i = 0; i < tmpPoints.size(); i++)
+    {
+      if (xType == 0)
+        tmpPoints[i].first *= m_xform.width;
+      if (yType == 0)
+        tmpPoints[i].second *= m_xform.height;
+    }
   }
+  transformPoints(tmpPoints);
+
+  for (unsigned i = 0; i< tmpPoints.size(); i++)
+    _appendPathElement(VSDPathElement(VSD_PATH_LINE_TO, m_scale*tmpPoints[i].first, m_scale*tmpPoints[i].second));
 
   m_originalX = x;
   m_originalY = y;
   m_x = x;
   m_y = y;
   transformPoint(m_x, m_y);
-  polyline.insert("libwpg:path-action", "L");
-  polyline.insert("svg:x", m_scale*m_x);
-  polyline.insert("svg:y", m_scale*m_y);
-  if (!m_noFill && !m_noShow)
-    m_currentFillGeometry.push_back(polyline);
-  if (!m_noLine && !m_noShow)
-    m_currentLineGeometry.push_back(polyline);
+  _appendPathElement(VSDPathElement(VSD_PATH_LINE_TO, m_scale*m_x, m_scale*m_y));
 }
 
-void libvisio::VSDContentCollector::collectPolylineTo(unsigned id, unsigned level, double x, double y, const PolylineData &data)
+void libvisio::VSDContentCollector::collectPolylineTo(unsigned /* id */, unsigned level, double x, double y, const PolylineData &data)
 {
-  collectPolylineTo(id, level, x, y, data.xType, data.yType, data.points);
+  _handleLevelChange(level);
+  _collectPolylineTo(x, y, data.xType, data.yType, data.points);
 }
 
 /* Polyline with incomplete data */
 void libvisio::VSDContentCollector::collectPolylineTo(unsigned id, unsigned level, double x, double y, unsigned dataID)
+{
+  _handleLevelChange(level);
+  _collectPolylineTo(id, x, y, dataID);
+}
+
+void libvisio::VSDContentCollector::_collectPolylineTo(unsigned id, double x, double y, unsigned dataID)
 {
   std::map<unsigned, PolylineData>::const_iterator iter;
   std::map<unsigned, PolylineData>::const_iterator iterEnd;
   if (dataID == 0xFFFFFFFE) // Use stencil polyline data
   {
     if (!m_stencilShape || m_stencilShape->m_geometries.size() < m_currentGeometryCount)
-    {
-      _handleLevelChange(level);
       return;
-    }
 
     // Get stencil geometry so as to find stencil polyline data ID
     std::map<unsigned, VSDGeometryList>::const_iterator cstiter = m_stencilShape->m_geometries.find(m_currentGeometryCount-1);
     VSDGeometryListElement *element = 0;
     if (cstiter == m_stencilShape->m_geometries.end())
-    {
-      _handleLevelChange(level);
       return;
-    }
     element = cstiter->second.getElement(id);
     iter = m_stencilShape->m_polylineData.find(element ? element->getDataID() : MINUS_ONE);
     iterEnd = m_stencilShape->m_polylineData.end();
   }
   else // No stencils involved, directly get dataID
   {
-    iter = m_polylineData.find(dataID);
-    iterEnd = m_polylineData.end();
+    // master geometry refers to the master's own data
+    const std::map<unsigned, PolylineData> &polylineData = m_isStencilStarted ? m_stencilShape->m_polylineData : m_polylineData;
+    iter = polylineData.find(dataID);
+    iterEnd = polylineData.end();
   }
 
   if (iter != iterEnd)
-    collectPolylineTo(id, level, x, y, iter->second);
-  else
-    _handleLevelChange(level);
+    _collectPolylineTo(x, y, iter->second.xType, iter->second.yType, iter->second.points);
 }
 
 /* NURBS shape data */
-void libvisio::VSDContentCollector::collectShapeData(unsigned id, unsigned level, unsigned char xType, unsigned char yType, unsigned degree, double lastKnot, std::vector<std::pair<double, double> > controlPoints, std::vector<double> knotVector, std::vector<double> weights)
+void libvisio::VSDContentCollector::collectShapeData(unsigned id, unsigned level, unsigned char xType, unsigned char yType, unsigned degree, double lastKnot,
+                                                     const std::vector<std::pair<double, double> > &controlPoints, const std::vector<double> &knotVector, const std::vector<double> &weights)
 {
   _handleLevelChange(level);
-  NURBSData data;
+  NURBSData &data = m_NURBSData[id];
   data.xType = xType;
   data.yType = yType;
   data.degree = degree;
@@ -1549,18 +2406,178 @@ void libvisio::VSDContentCollector::collectShapeData(unsigned id, unsigned level
   data.points = controlPoints;
   data.knots = knotVector;
   data.weights = weights;
-  m_NURBSData[id] = data;
 }
 
 /* Polyline shape data */
-void libvisio::VSDContentCollector::collectShapeData(unsigned id, unsigned level, unsigned char xType, unsigned char yType, std::vector<std::pair<double, double> > points)
+void libvisio::VSDContentCollector::collectShapeData(unsigned id, unsigned level, unsigned char xType, unsigned char yType, const std::vector<std::pair<double, double> > &points)
 {
   _handleLevelChange(level);
-  PolylineData data;
+  PolylineData &data = m_polylineData[id];
   data.xType = xType;
   data.yType = yType;
   data.points = points;
-  m_polylineData[id] = data;
+}
+
+// The rows of a geometry section are all at the level of the section, so
+// the level is handled once and the rows are drawn without going through
+// the collector interface row by row.
+void libvisio::VSDContentCollector::collectShapeGeometries(unsigned level, const std::map<unsigned, VSDGeometryList> &geometries)
+{
+  _handleLevelChange(level);
+  // shapes outside of the view are left out before their geometry, foreign
+  // data and text are built
+  m_isShapeCulled = m_shapeCulling && _isShapeOutsideView(&geometries);
+}
+
+void libvisio::VSDContentCollector::collectGeometryList(unsigned level, const VSDGeometryList &geometryList)
+{
+  _handleLevelChange(level);
+  if (geometryList.empty() || m_isShapeCulled)
+    return;
+
+  geometryList.getRows(m_geometryRows);
+  for (std::vector<const VSDGeometryListElement *>::const_iterator iter = m_geometryRows.begin(); iter != m_geometryRows.end(); ++iter)
+  {
+    const VSDGeometryListElement *row = *iter;
+    const VSDGeometryRowType type = row->getType();
+    if (type != VSD_ROW_SPLINE_START && type != VSD_ROW_SPLINE_KNOT)
+      _collectSplineEnd();
+    switch (type)
+    {
+    case VSD_ROW_GEOMETRY:
+    {
+      const VSDGeometry *geometry = static_cast<const VSDGeometry *>(row);
+      _collectGeometry(geometry->m_noFill, geometry->m_noLine, geometry->m_noShow);
+      break;
+    }
+    case VSD_ROW_EMPTY:
+      break;
+    case VSD_ROW_MOVE_TO:
+    {
+      const VSDMoveTo *moveTo = static_cast<const VSDMoveTo *>(row);
+      _collectMoveTo(moveTo->m_x, moveTo->m_y);
+      break;
+    }
+    case VSD_ROW_LINE_TO:
+    {
+      const VSDLineTo *lineTo = static_cast<const VSDLineTo *>(row);
+      _collectLineTo(lineTo->m_x, lineTo->m_y);
+      break;
+    }
+    case VSD_ROW_ARC_TO:
+    {
+      const VSDArcTo *arcTo = static_cast<const VSDArcTo *>(row);
+      _collectArcTo(arcTo->m_x2, arcTo->m_y2, arcTo->m_bow);
+      break;
+    }
+    case VSD_ROW_ELLIPSE:
+    {
+      const VSDEllipse *ellipse = static_cast<const VSDEllipse *>(row);
+      _collectEllipse(ellipse->m_cx, ellipse->m_cy, ellipse->m_xleft, ellipse->m_yleft, ellipse->m_xtop, ellipse->m_ytop);
+      break;
+    }
+    case VSD_ROW_ELLIPTICAL_ARC_TO:
+    {
+      const VSDEllipticalArcTo *arcTo = static_cast<const VSDEllipticalArcTo *>(row);
+      _collectEllipticalArcTo(arcTo->m_x3, arcTo->m_y3, arcTo->m_x2, arcTo->m_y2, arcTo->m_angle, arcTo->m_ecc);
+      break;
+    }
+    case VSD_ROW_NURBS_TO_1:
+    {
+      const VSDNURBSTo1 *nurbsTo = static_cast<const VSDNURBSTo1 *>(row);
+      std::vector<std::pair<double, double> > controlPoints(nurbsTo->m_controlPoints);
+      std::vector<double> knotVector(nurbsTo->m_knotVector);
+      _collectNURBSTo(nurbsTo->getID(), nurbsTo->m_x2, nurbsTo->m_y2, nurbsTo->m_xType, nurbsTo->m_yType, nurbsTo->m_degree,
+                      controlPoints, knotVector, nurbsTo->m_weights);
+      break;
+    }
+    case VSD_ROW_NURBS_TO_2:
+    {
+      const VSDNURBSTo2 *nurbsTo = static_cast<const VSDNURBSTo2 *>(row);
+      _collectNURBSTo(nurbsTo->getID(), nurbsTo->m_x2, nurbsTo->m_y2, nurbsTo->m_knot, nurbsTo->m_knotPrev,
+                      nurbsTo->m_weight, nurbsTo->m_weightPrev, nurbsTo->m_dataID);
+      break;
+    }
+    case VSD_ROW_NURBS_TO_3:
+    {
+      const VSDNURBSTo3 *nurbsTo = static_cast<const VSDNURBSTo3 *>(row);
+      _collectNURBSTo(nurbsTo->getID(), nurbsTo->m_x2, nurbsTo->m_y2, nurbsTo->m_knot, nurbsTo->m_knotPrev,
+                      nurbsTo->m_weight, nurbsTo->m_weightPrev, nurbsTo->m_data);
+      break;
+    }
+    case VSD_ROW_POLYLINE_TO_1:
+    {
+      const VSDPolylineTo1 *polylineTo = static_cast<const VSDPolylineTo1 *>(row);
+      _collectPolylineTo(polylineTo->m_x, polylineTo->m_y, polylineTo->m_xType, polylineTo->m_yType, polylineTo->m_points);
+      break;
+    }
+    case VSD_ROW_POLYLINE_TO_2:
+    {
+      const VSDPolylineTo2 *polylineTo = static_cast<const VSDPolylineTo2 *>(row);
+      _collectPolylineTo(polylineTo->getID(), polylineTo->m_x, polylineTo->m_y, polylineTo->m_dataID);
+      break;
+    }
+    case VSD_ROW_POLYLINE_TO_3:
+    {
+      const VSDPolylineTo3 *polylineTo = static_cast<const VSDPolylineTo3 *>(row);
+      _collectPolylineTo(polylineTo->m_x, polylineTo->m_y, polylineTo->m_data.xType, polylineTo->m_data.yType, polylineTo->m_data.points);
+      break;
+    }
+    case VSD_ROW_SPLINE_START:
+    {
+      const VSDSplineStart *splineStart = static_cast<const VSDSplineStart *>(row);
+      m_splineLevel = level;
+      _collectSplineStart(splineStart->m_x, splineStart->m_y, splineStart->m_secondKnot, splineStart->m_firstKnot,
+                          splineStart->m_lastKnot, splineStart->m_degree);
+      break;
+    }
+    case VSD_ROW_SPLINE_KNOT:
+    {
+      const VSDSplineKnot *splineKnot = static_cast<const VSDSplineKnot *>(row);
+      _collectSplineKnot(splineKnot->m_x, splineKnot->m_y, splineKnot->m_knot);
+      break;
+    }
+    case VSD_ROW_INFINITE_LINE:
+    {
+      const VSDInfiniteLine *infiniteLine = static_cast<const VSDInfiniteLine *>(row);
+      _collectInfiniteLine(infiniteLine->m_x1, infiniteLine->m_y1, infiniteLine->m_x2, infiniteLine->m_y2);
+      break;
+    }
+    case VSD_ROW_REL_CUB_BEZ_TO:
+    {
+      const VSDRelCubBezTo *relCubBezTo = static_cast<const VSDRelCubBezTo *>(row);
+      _collectRelCubBezTo(relCubBezTo->m_x, relCubBezTo->m_y, relCubBezTo->m_a, relCubBezTo->m_b, relCubBezTo->m_c, relCubBezTo->m_d);
+      break;
+    }
+    case VSD_ROW_REL_ELLIPTICAL_ARC_TO:
+    {
+      const VSDRelEllipticalArcTo *arcTo = static_cast<const VSDRelEllipticalArcTo *>(row);
+      _collectRelEllipticalArcTo(arcTo->m_x3, arcTo->m_y3, arcTo->m_x2, arcTo->m_y2, arcTo->m_angle, arcTo->m_ecc);
+      break;
+    }
+    case VSD_ROW_REL_MOVE_TO:
+    {
+      const VSDRelMoveTo *relMoveTo = static_cast<const VSDRelMoveTo *>(row);
+      _collectRelMoveTo(relMoveTo->m_x, relMoveTo->m_y);
+      break;
+    }
+    case VSD_ROW_REL_LINE_TO:
+    {
+      const VSDRelLineTo *relLineTo = static_cast<const VSDRelLineTo *>(row);
+      _collectRelLineTo(relLineTo->m_x, relLineTo->m_y);
+      break;
+    }
+    case VSD_ROW_REL_QUAD_BEZ_TO:
+    {
+      const VSDRelQuadBezTo *relQuadBezTo = static_cast<const VSDRelQuadBezTo *>(row);
+      _collectRelQuadBezTo(relQuadBezTo->m_x, relQuadBezTo->m_y, relQuadBezTo->m_a, relQuadBezTo->m_b);
+      break;
+    }
+    default:
+      break;
+    }
+  }
+  _collectSplineEnd();
 }
 
 void libvisio::VSDContentCollector::collectXFormData(unsigned level, const XForm &xform)
@@ -1598,6 +2615,66 @@ void libvisio::VSDContentCollector::applyXForm(double &x, double &y, const XForm
   y += xform.pinY;
 }
 
+void libvisio::VSDContentCollector::composeShapeTransform()
+{
+  m_shapeTransform = XFormMatrix();
+  m_shapeFlipX = false;
+  m_shapeFlipY = false;
+
+  unsigned index = m_currentShapeIndex;
+
+  // the walk up the groups is bounded in case they form a cycle
+  for (unsigned depth = 0; m_shapeTable && index != MINUS_ONE && depth < m_shapeTable->size(); ++depth)
+  {
+    if (m_maxGroupDepth && depth > m_maxGroupDepth)
+    {
+      if (_exceedLimit(VSDRenderingOptions::LIMIT_GROUP_DEPTH))
+      {
+        VSD_DEBUG_MSG(("VSDContentCollector: shapes nested in more than %u groups\n", m_maxGroupDepth));
+      }
+      break;
+    }
+    const XForm *pXForm = m_shapeTable->getXForm(index);
+    if (pXForm)
+    {
+      // The same steps as applyXForm, as a matrix applied after the ones
+      // of the shape and of the groups within this one
+      const XForm &xform = *pXForm;
+      const double sx = xform.flipX ? -1.0 : 1.0;
+      const double sy = xform.flipY ? -1.0 : 1.0;
+      const double c = xform.angle != 0.0 ? cos(xform.angle) : 1.0;
+      const double s = xform.angle != 0.0 ? sin(xform.angle) : 0.0;
+      XFormMatrix step;
+      step.xx = c*sx;
+      step.xy = -s*sy;
+      step.yx = s*sx;
+      step.yy = c*sy;
+      step.x0 = xform.pinX - step.xx*xform.pinLocX - step.xy*xform.pinLocY;
+      step.y0 = xform.pinY - step.yx*xform.pinLocX - step.yy*xform.pinLocY;
+
+      const XFormMatrix m = m_shapeTransform;
+      m_shapeTransform.xx = step.xx*m.xx + step.xy*m.yx;
+      m_shapeTransform.xy = step.xx*m.xy + step.xy*m.yy;
+      m_shapeTransform.yx = step.yx*m.xx + step.yy*m.yx;
+      m_shapeTransform.yy = step.yx*m.xy + step.yy*m.yy;
+      m_shapeTransform.x0 = step.xx*m.x0 + step.xy*m.y0 + step.x0;
+      m_shapeTransform.y0 = step.yx*m.x0 + step.yy*m.y0 + step.y0;
+
+      if (xform.flipX)
+        m_shapeFlipX = !m_shapeFlipX;
+      if (xform.flipY)
+        m_shapeFlipY = !m_shapeFlipY;
+    }
+    else
+      break;
+    const unsigned parent = m_shapeTable->getParent(index);
+    if (parent == index)
+      break;
+    index = parent;
+  }
+  m_isShapeTransformValid = true;
+}
+
 void libvisio::VSDContentCollector::transformPoint(double &x, double &y, XForm *txtxform)
 {
   // We are interested for the while in shapes xforms only
@@ -1607,35 +2684,44 @@ void libvisio::VSDContentCollector::transformPoint(double &x, double &y, XForm *
   if (!m_currentShapeId)
     return;
 
-  unsigned shapeId = m_currentShapeId;
-
   if (txtxform)
     applyXForm(x, y, *txtxform);
 
-  while (true && m_groupXForms)
+  if (!m_isShapeTransformValid)
+    composeShapeTransform();
+  const double tmpX = m_shapeTransform.xx*x + m_shapeTransform.xy*y + m_shapeTransform.x0;
+  const double tmpY = m_shapeTransform.yx*x + m_shapeTransform.yy*y + m_shapeTransform.y0;
+  x = tmpX;
+  y = m_pageHeight - tmpY;
+}
+
+void libvisio::VSDContentCollector::transformPoints(std::vector<std::pair<double, double> > &points)
+{
+  if (!m_isShapeStarted)
+    return;
+
+  if (!m_currentShapeId)
+    return;
+
+  if (!m_isShapeTransformValid)
+    composeShapeTransform();
+  // a plain loop over local copies, which the compiler can vectorize
+  const double xx = m_shapeTransform.xx;
+  const double xy = m_shapeTransform.xy;
+  const double yx = m_shapeTransform.yx;
+  const double yy = m_shapeTransform.yy;
+  const double x0 = m_shapeTransform.x0;
+  const double y0 = m_shapeTransform.y0;
+  const double pageHeight = m_pageHeight;
+  const size_t count = points.size();
+  std::pair<double, double> *const p = count ? &points[0] : 0;
+  for (size_t i = 0; i < count; ++i)
   {
-    std::map<unsigned, XForm>::iterator iterX = m_groupXForms->find(shapeId);
-    if (iterX != m_groupXForms->end())
-    {
-      XForm xform = iterX->second;
-      applyXForm(x, y, xform);
-    }
-    else
-      break;
-    bool shapeFound = false;
-    if (m_groupMemberships != m_groupMembershipsSequence.end())
-    {
-      std::map<unsigned, unsigned>::iterator iter = m_groupMemberships->find(shapeId);
-      if (iter != m_groupMemberships->end() && shapeId != iter->second)
-      {
-        shapeId = iter->second;
-        shapeFound = true;
-      }
-    }
-    if (!shapeFound)
-      break;
+    const double x = p[i].first;
+    const double y = p[i].second;
+    p[i].first = xx*x + xy*y + x0;
+    p[i].second = pageHeight - (yx*x + yy*y + y0);
   }
-  y = m_pageHeight - y;
 }
 
 void libvisio::VSDContentCollector::transformAngle(double &angle, XForm *txtxform)
@@ -1664,34 +2750,12 @@ void libvisio::VSDContentCollector::transformFlips(bool &flipX, bool &flipY)
   if (!m_currentShapeId)
     return;
 
-  unsigned shapeId = m_currentShapeId;
-
-  while (true && m_groupXForms)
-  {
-    std::map<unsigned, XForm>::iterator iterX = m_groupXForms->find(shapeId);
-    if (iterX != m_groupXForms->end())
-    {
-      XForm xform = iterX->second;
-      if (xform.flipX)
-        flipX = !flipX;
-      if (xform.flipY)
-        flipY = !flipY;
-    }
-    else
-      break;
-    bool shapeFound = false;
-    if (m_groupMemberships != m_groupMembershipsSequence.end())
-    {
-      std::map<unsigned, unsigned>::iterator iter = m_groupMemberships->find(shapeId);
-      if (iter != m_groupMemberships->end() && shapeId != iter->second)
-      {
-        shapeId = iter->second;
-        shapeFound = true;
-      }
-    }
-    if (!shapeFound)
-      break;
-  }
+  if (!m_isShapeTransformValid)
+    composeShapeTransform();
+  if (m_shapeFlipX)
+    flipX = !flipX;
+  if (m_shapeFlipY)
+    flipY = !flipY;
 }
 
 void libvisio::VSDContentCollector::collectShapesOrder(unsigned /* id */, unsigned level, const std::vector<unsigned> & /* shapeIds */)
@@ -1764,11 +2828,27 @@ void libvisio::VSDContentCollector::collectShape(unsigned id, unsigned level, un
   m_paraFormats.clear();
 
   m_currentShapeId = id;
-  m_pageOutputDrawing[m_currentShapeId] = VSDOutputElementList();
-  m_pageOutputText[m_currentShapeId] = VSDOutputElementList();
-  m_shapeOutputDrawing = &m_pageOutputDrawing[m_currentShapeId];
-  m_shapeOutputText = &m_pageOutputText[m_currentShapeId];
+  m_currentShapeIndex = m_shapeTable ? m_shapeTable->getIndex(id) : MINUS_ONE;
+  m_isShapeTransformValid = false;
+  if (m_currentShapeIndex != MINUS_ONE)
+  {
+    if (m_pageOutputDrawing.size() != m_shapeTable->size())
+    {
+      m_pageOutputDrawing.resize(m_shapeTable->size());
+      m_pageOutputText.resize(m_shapeTable->size());
+    }
+    m_shapeOutputDrawing = &m_pageOutputDrawing[m_currentShapeIndex];
+    m_shapeOutputText = &m_pageOutputText[m_currentShapeIndex];
+  }
+  else
+  {
+    m_shapeOutputDrawing = &m_unlistedOutputDrawing;
+    m_shapeOutputText = &m_unlistedOutputText;
+  }
+  *m_shapeOutputDrawing = VSDOutputElementList();
+  *m_shapeOutputText = VSDOutputElementList();
   m_isShapeStarted = true;
+  m_isShapeCulled = false;
   m_isFirstGeometry = true;
 
   m_names.clear();
@@ -1865,6 +2945,11 @@ void libvisio::VSDContentCollector::collectUnhandledChunk(unsigned /* id */, uns
 void libvisio::VSDContentCollector::collectSplineStart(unsigned /* id */, unsigned level, double x, double y, double secondKnot, double firstKnot, double lastKnot, unsigned degree)
 {
   m_splineLevel = level;
+  _collectSplineStart(x, y, secondKnot, firstKnot, lastKnot, degree);
+}
+
+void libvisio::VSDContentCollector::_collectSplineStart(double x, double y, double secondKnot, double firstKnot, double lastKnot, unsigned degree)
+{
   m_splineKnotVector.push_back(firstKnot);
   m_splineKnotVector.push_back(secondKnot);
   m_splineLastKnot = lastKnot;
@@ -1875,6 +2960,11 @@ void libvisio::VSDContentCollector::collectSplineStart(unsigned /* id */, unsign
 
 
 void libvisio::VSDContentCollector::collectSplineKnot(unsigned /* id */, unsigned /* level */, double x, double y, double knot)
+{
+  _collectSplineKnot(x, y, knot);
+}
+
+void libvisio::VSDContentCollector::_collectSplineKnot(double x, double y, double knot)
 {
   m_splineKnotVector.push_back(knot);
   m_splineControlPoints.push_back(std::pair<double,double>(m_splineX,m_splineY));
@@ -1884,6 +2974,13 @@ void libvisio::VSDContentCollector::collectSplineKnot(unsigned /* id */, unsigne
 
 
 void libvisio::VSDContentCollector::collectSplineEnd()
+{
+  if (!m_splineKnotVector.empty() && !m_splineControlPoints.empty())
+    _handleLevelChange(m_splineLevel);
+  _collectSplineEnd();
+}
+
+void libvisio::VSDContentCollector::_collectSplineEnd()
 {
   if (m_splineKnotVector.empty() || m_splineControlPoints.empty())
   {
@@ -1895,7 +2992,7 @@ void libvisio::VSDContentCollector::collectSplineEnd()
   std::vector<double> weights;
   for (unsigned i=0; i < m_splineControlPoints.size()+2; i++)
     weights.push_back(1.0);
-  collectNURBSTo(0, m_splineLevel, m_splineX, m_splineY, 1, 1, m_splineDegree, m_splineControlPoints, m_splineKnotVector, weights);
+  _collectNURBSTo(MINUS_ONE, m_splineX, m_splineY, 1, 1, m_splineDegree, m_splineControlPoints, m_splineKnotVector, weights);
   m_splineKnotVector.clear();
   m_splineControlPoints.clear();
 }
@@ -1904,6 +3001,8 @@ void libvisio::VSDContentCollector::collectSplineEnd()
 void libvisio::VSDContentCollector::collectText(unsigned level, const WPXBinaryData &textStream, TextFormat format)
 {
   _handleLevelChange(level);
+  if (m_isShapeCulled)
+    return;
 
   m_textStream = textStream;
   m_textFormat = format;
@@ -2502,11 +3601,9 @@ void libvisio::VSDContentCollector::_handleLevelChange(unsigned level)
   {
     if (m_isShapeStarted)
     {
-      if (m_stencilShape && !m_isStencilStarted)
+      if (m_stencilShape && !m_isStencilStarted && !m_isShapeCulled)
       {
         m_isStencilStarted = true;
-        m_NURBSData = m_stencilShape->m_nurbsData;
-        m_polylineData = m_stencilShape->m_polylineData;
 
         if (m_currentFillGeometry.empty() && m_currentLineGeometry.empty() && !m_noShow)
         {
@@ -2550,12 +3647,15 @@ void libvisio::VSDContentCollector::startPage(unsigned pageId)
   m_x = 0;
   m_y = 0;
   m_currentPageNumber++;
-  if (m_groupXFormsSequence.size() >= m_currentPageNumber)
-    m_groupXForms = m_groupXFormsSequence.size() > m_currentPageNumber-1 ? &m_groupXFormsSequence[m_currentPageNumber-1] : 0;
-  if (m_groupMembershipsSequence.size() >= m_currentPageNumber)
-    m_groupMemberships = m_groupMembershipsSequence.begin() + (m_currentPageNumber-1);
-  if (m_documentPageShapeOrders.size() >= m_currentPageNumber)
-    m_pageShapeOrder = m_documentPageShapeOrders.begin() + (m_currentPageNumber-1);
+  m_isShapeTransformValid = false;
+  m_shapeTable = m_documentShapeTables.size() >= m_currentPageNumber ? &m_documentShapeTables[m_currentPageNumber-1] : 0;
+  m_pageOutputDrawing.clear();
+  m_pageOutputText.clear();
+  if (m_shapeTable)
+  {
+    m_pageOutputDrawing.resize(m_shapeTable->size());
+    m_pageOutputText.resize(m_shapeTable->size());
+  }
   m_currentPage = libvisio::VSDPage();
   m_currentPage.m_currentPageID = pageId;
   m_isPageStarted = true;
@@ -2581,34 +3681,56 @@ void libvisio::VSDContentCollector::endPages()
   m_pages.draw(m_painter);
 }
 
-bool libvisio::VSDContentCollector::parseFormatId( const char *formatString, unsigned short &result )
+unsigned libvisio::VSDContentCollector::getExceededLimits() const
 {
-  using namespace ::boost::spirit::classic;
+  unsigned limits = m_exceededLimits;
+  if (m_pages.isBackgroundDepthExceeded())
+    limits |= VSDRenderingOptions::LIMIT_BACKGROUND_DEPTH;
+  return limits;
+}
 
+bool libvisio::VSDContentCollector::parseFormatId( const char *formatString, unsigned short &result )
+{
+  // "{<id>}" or "esc(id)", with blanks allowed around each part
   result = 0xffff;
 
-  uint_parser<unsigned short,10,1,5> ushort_p;
-  if (parse(formatString,
-            // Begin grammar
-            (
-              (
-                str_p("{<") >>
-                ushort_p[assign_a(result)]
-                >> str_p(">}")
-              )
-              |
-              (
-                str_p("esc(") >>
-                ushort_p[assign_a(result)]
-                >> ')'
-              )
-            )>> end_p,
-            // End grammar
-            space_p).full )
-  {
-    return true;
-  }
-  return false;
+  const char *p = formatString;
+  while (isspace((unsigned char)*p))
+    ++p;
+  const char *closing = 0;
+  if (!strncmp(p, "{<", 2))
+  {
+    closing = ">}";
+    p += 2;
+  }
+  else if (!strncmp(p, "esc(", 4))
+  {
+    closing = ")";
+    p += 4;
+  }
+  else
+    return false;
+
+  while (isspace((unsigned char)*p))
+    ++p;
+  // at most five digits, as much as an unsigned short takes
+  unsigned value = 0;
+  const char *first = p;
+  for (; *p >= '0' && *p <= '9' && p - first < 5; ++p)
+    value = value * 10 + (unsigned)(*p - '0');
+  if (p == first || value > 0xffff)
+    return false;
+  result = (unsigned short)value;
+
+  while (isspace((unsigned char)*p))
+    ++p;
+  const size_t closingLength = strlen(closing);
+  if (strncmp(p, closing, closingLength))
+    return false;
+  p += closingLength;
+  while (isspace((unsigned char)*p))
+    ++p;
+  return !*p;
 }
 
 void libvisio::VSDContentCollector::appendCharacters(WPXString &text, const std::vector<unsigned char> &characters, TextFormat format)
@@ -39,10 +39,13 @@
 #include <list>
 #include <vector>
 #include <libwpg/libwpg.h>
+#include <libvisio/libvisio.h>
 #include "libvisio_utils.h"
 #include "VSDCollector.h"
 #include "VSDParser.h"
 #include "VSDOutputElementList.h"
+#include "VSDPath.h"
+#include "VSDShapeTable.h"
 #include "VSDStyles.h"
 #include "VSDPages.h"
 
@@ -54,10 +57,8 @@ class VSDContentCollector : public VSDCollector
 public:
   VSDContentCollector(
     libwpg::WPGPaintInterface *painter,
-    std::vector<std::map<unsigned, XForm> > &groupXFormsSequence,
-    std::vector<std::map<unsigned, unsigned> > &groupMembershipsSequence,
-    std::vector<std::list<unsigned> > &documentPageShapeOrders,
-    VSDStyles &styles, VSDStencils &stencils
+    std::vector<VSDShapeTable> &documentShapeTables,
+    VSDStyles &styles, VSDStencils &stencils, const VSDRenderingOptions &options
   );
   virtual ~VSDContentCollector()
   {
@@ -85,7 +86,7 @@ public:
   void collectLineTo(unsigned id, unsigned level, double x, double y);
   void collectArcTo(unsigned id, unsigned level, double x2, double y2, double bow);
   void collectNURBSTo(unsigned id, unsigned level, double x2, double y2, unsigned char xType, unsigned char yType, unsigned degree,
-                      std::vector<std::pair<double, double> > controlPoints, std::vector<double> knotVector, std::vector<double> weights);
+                      const std::vector<std::pair<double, double> > &controlPoints, const std::vector<double> &knotVector, const std::vector<double> &weights);
   void collectNURBSTo(unsigned id, unsigned level, double x2, double y2, double knot, double knotPrev, double weight, double weightPrev, unsigned dataID);
   void collectNURBSTo(unsigned id, unsigned level, double x2, double y2, double knot, double knotPrev, double weight, double weightPrev, const NURBSData &data);
   void collectPolylineTo(unsigned id, unsigned level, double x, double y, unsigned char xType, unsigned char yType,
@@ -93,8 +94,10 @@ public:
   void collectPolylineTo(unsigned id, unsigned level, double x, double y, unsigned dataID);
   void collectPolylineTo(unsigned id, unsigned level, double x, double y, const PolylineData &data);
   void collectShapeData(unsigned id, unsigned level, unsigned char xType, unsigned char yType, unsigned degree, double lastKnot,
-                        std::vector<std::pair<double, double> > controlPoints, std::vector<double> knotVector, std::vector<double> weights);
-  void collectShapeData(unsigned id, unsigned level, unsigned char xType, unsigned char yType, std::vector<std::pair<double, double> > points);
+                        const std::vector<std::pair<double, double> > &controlPoints, const std::vector<double> &knotVector, const std::vector<double> &weights);
+  void collectShapeData(unsigned id, unsigned level, unsigned char xType, unsigned char yType, const std::vector<std::pair<double, double> > &points);
+  void collectShapeGeometries(unsigned level, const std::map<unsigned, VSDGeometryList> &geometries);
+  void collectGeometryList(unsigned level, const VSDGeometryList &geometryList);
   void collectXFormData(unsigned level, const XForm &xform);
   void collectTxtXForm(unsigned level, const XForm &txtxform);
   void collectShapesOrder(unsigned id, unsigned level, const std::vector<unsigned> &shapeIds);
@@ -182,22 +185,85 @@ public:
   void endPage();
   void endPages();
 
+  // the limits of the rendering options that the document exceeded
+  unsigned getExceededLimits() const;
+
 
 private:
   VSDContentCollector(const VSDContentCollector &);
   VSDContentCollector &operator=(const VSDContentCollector &);
   libwpg::WPGPaintInterface *m_painter;
+  double m_flatteningTolerance;
+  double m_simplificationTolerance;
+  unsigned m_maxCurveDegree;
+  unsigned long m_maxVertexCount;
+  unsigned m_maxGroupDepth;
+  unsigned long m_maxElementCount;
+  // what the document used up of the limits above
+  unsigned long m_vertexCount;
+  // the path points that the current shape holds
+  unsigned long m_shapeVertexCount;
+  unsigned long m_elementCount;
+  unsigned m_exceededLimits;
+  bool m_shapeCulling;
+  // the current shape is outside the view and none of it is built
+  bool m_isShapeCulled;
+  double m_viewportX, m_viewportY, m_viewportWidth, m_viewportHeight;
+  // the rows of the geometry section being drawn, kept to reuse the storage
+  std::vector<const VSDGeometryListElement *> m_geometryRows;
 
   void applyXForm(double &x, double &y, const XForm &xform);
 
   void transformPoint(double &x, double &y, XForm *txtxform = 0);
+  void transformPoints(std::vector<std::pair<double, double> > &points);
   void transformAngle(double &angle, XForm *txtxform = 0);
   void transformFlips(bool &flipX, bool &flipY);
-
-  double _NURBSBasis(unsigned knot, unsigned degree, double point, const std::vector<double> &knotVector);
+  void composeShapeTransform();
+
+  int _NURBSBasis(unsigned degree, double point, const std::vector<double> &knotVector, std::vector<double> &basis);
+  void _NURBSPoint(unsigned degree, double point, const std::vector<std::pair<double, double> > &controlPoints,
+                   const std::vector<double> &knotVector, const std::vector<double> &weights,
+                   std::vector<double> &basis, double &x, double &y);
+  void _flattenNURBS(unsigned degree, double start, double end, const std::vector<std::pair<double, double> > &controlPoints,
+                     const std::vector<double> &knotVector, const std::vector<double> &weights,
+                     std::vector<double> &basis, std::vector<std::pair<double, double> > &curvePoints);
+  void _cachedNURBSCurvePoints(unsigned id, double x2, double y2, unsigned char xType, unsigned char yType, unsigned degree,
+                               std::vector<std::pair<double, double> > &controlPoints, std::vector<double> &knotVector,
+                               const std::vector<double> &weights, std::vector<std::pair<double, double> > &curvePoints);
+  void _NURBSCurvePoints(double x2, double y2, unsigned char xType, unsigned char yType, unsigned degree,
+                         std::vector<std::pair<double, double> > &controlPoints, std::vector<double> &knotVector,
+                         const std::vector<double> &weights, std::vector<std::pair<double, double> > &curvePoints);
+  void _collectNURBSTo(unsigned id, double x2, double y2, unsigned char xType, unsigned char yType, unsigned degree,
+                       std::vector<std::pair<double, double> > &controlPoints, std::vector<double> &knotVector, const std::vector<double> &weights);
+  void _collectNURBSTo(unsigned id, double x2, double y2, double knot, double knotPrev, double weight, double weightPrev, const NURBSData &data);
+  void _collectNURBSTo(unsigned id, double x2, double y2, double knot, double knotPrev, double weight, double weightPrev, unsigned dataID);
+
+  // The geometry rows without the level change, so that a whole geometry
+  // section is drawn after handling its level once.
+  void _collectGeometry(bool noFill, bool noLine, bool noShow);
+  void _collectMoveTo(double x, double y);
+  void _collectLineTo(double x, double y);
+  void _collectArcTo(double x2, double y2, double bow);
+  void _collectEllipse(double cx, double cy, double xleft, double yleft, double xtop, double ytop);
+  void _collectEllipticalArcTo(double x3, double y3, double x2, double y2, double angle, double ecc);
+  void _collectPolylineTo(double x, double y, unsigned char xType, unsigned char yType, const std::vector<std::pair<double, double> > &points);
+  void _collectPolylineTo(unsigned id, double x, double y, unsigned dataID);
+  void _collectSplineStart(double x, double y, double secondKnot, double firstKnot, double lastKnot, unsigned degree);
+  void _collectSplineKnot(double x, double y, double knot);
+  void _collectSplineEnd();
+  void _collectInfiniteLine(double x1, double y1, double x2, double y2);
+  void _collectRelCubBezTo(double x, double y, double x1, double y1, double x2, double y2);
+  void _collectRelEllipticalArcTo(double x, double y, double a, double b, double c, double d);
+  void _collectRelMoveTo(double x, double y);
+  void _collectRelLineTo(double x, double y);
+  void _collectRelQuadBezTo(double x, double y, double x1, double y1);
 
   void _flushShape();
   void _flushCurrentPath();
+  void _appendPathElement(const VSDPathElement &element);
+  bool _exceedLimit(unsigned limit);
+  bool _isVertexCountReached() const;
+  bool _isShapeOutsideView(const std::map<unsigned, VSDGeometryList> *geometries);
   void _flushText();
   void _flushCurrentForeignData();
   void _flushCurrentPage();
@@ -233,13 +299,14 @@ private:
   XForm m_xform;
   XForm *m_txtxform;
   VSDMisc m_misc;
-  std::vector<WPXPropertyList> m_currentFillGeometry;
-  std::vector<WPXPropertyList> m_currentLineGeometry;
-  std::map<unsigned, XForm> *m_groupXForms;
+  VSDPath m_currentFillGeometry;
+  VSDPath m_currentLineGeometry;
   WPXBinaryData m_currentForeignData;
   WPXBinaryData m_currentOLEData;
   WPXPropertyList m_currentForeignProps;
   unsigned m_currentShapeId;
+  // the index of the current shape in the shape table of the page
+  unsigned m_currentShapeIndex;
   unsigned m_foreignType;
   unsigned m_foreignFormat;
   double m_foreignOffsetX;
@@ -252,15 +319,15 @@ private:
   std::map<unsigned short, VSDFont> m_fonts;
   unsigned m_currentLevel;
   bool m_isShapeStarted;
-  std::vector<std::map<unsigned, XForm> > &m_groupXFormsSequence;
-  std::vector<std::map<unsigned, unsigned> > &m_groupMembershipsSequence;
-  std::vector<std::map<unsigned, unsigned> >::iterator m_groupMemberships;
+  std::vector<VSDShapeTable> &m_documentShapeTables;
+  const VSDShapeTable *m_shapeTable;
   unsigned m_currentPageNumber;
   VSDOutputElementList *m_shapeOutputDrawing, *m_shapeOutputText;
-  std::map<unsigned, VSDOutputElementList> m_pageOutputDrawing;
-  std::map<unsigned, VSDOutputElementList> m_pageOutputText;
-  std::vector<std::list<unsigned> > &m_documentPageShapeOrders;
-  std::vector<std::list<unsigned> >::iterator m_pageShapeOrder;
+  // the output of the shapes of the page, by their indices in the table
+  std::vector<VSDOutputElementList> m_pageOutputDrawing;
+  std::vector<VSDOutputElementList> m_pageOutputText;
+  // the output of a shape missing from the table, which is never drawn
+  VSDOutputElementList m_unlistedOutputDrawing, m_unlistedOutputText;
   bool m_isFirstGeometry;
 
   std::map<unsigned, NURBSData> m_NURBSData;
@@ -287,6 +354,10 @@ private:
   VSDStencils m_stencils;
   const VSDShape *m_stencilShape;
   bool m_isStencilStarted;
+  std::map<CurveCacheKey, CurveCacheEntry> m_stencilCurves;
+  // the keys of the cached curves, the most recently used first
+  std::list<CurveCacheKey> m_stencilCurveOrder;
+  unsigned long m_stencilCurveSize;
 
   unsigned m_currentGeometryCount;
 
@@ -303,6 +374,12 @@ private:
   unsigned m_splineLevel;
   unsigned m_currentShapeLevel;
   bool m_isBackgroundPage;
+
+  // the xforms of the current shape and of its groups, composed
+  bool m_isShapeTransformValid;
+  XFormMatrix m_shapeTransform;
+  bool m_shapeFlipX;
+  bool m_shapeFlipY;
 };
 
 } // namespace libvisio
@@ -32,299 +32,6 @@
 #include "VSDGeometryList.h"
 #include "libvisio_utils.h"
 
-namespace libvisio
-{
-
-
-class VSDGeometry : public VSDGeometryListElement
-{
-public:
-  VSDGeometry(unsigned id, unsigned level, const boost::optional<bool> &noFill,
-              const boost::optional<bool> &noLine, const boost::optional<bool> &noShow) :
-    VSDGeometryListElement(id, level), m_noFill(FROM_OPTIONAL(noFill, false)),
-    m_noLine(FROM_OPTIONAL(noLine, false)), m_noShow(FROM_OPTIONAL(noShow, false)) {}
-  virtual ~VSDGeometry() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-  bool m_noFill;
-  bool m_noLine;
-  bool m_noShow;
-};
-
-class VSDEmpty : public VSDGeometryListElement
-{
-public:
-  VSDEmpty(unsigned id, unsigned level) :
-    VSDGeometryListElement(id, level) {}
-  virtual ~VSDEmpty() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-};
-
-class VSDMoveTo : public VSDGeometryListElement
-{
-public:
-  VSDMoveTo(unsigned id, unsigned level, const boost::optional<double> &x, const boost::optional<double> &y) :
-    VSDGeometryListElement(id, level), m_x(FROM_OPTIONAL(x, 0.0)), m_y(FROM_OPTIONAL(y, 0.0)) {}
-  virtual ~VSDMoveTo() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-  double m_x, m_y;
-};
-
-class VSDLineTo : public VSDGeometryListElement
-{
-public:
-  VSDLineTo(unsigned id, unsigned level, const boost::optional<double> &x, const boost::optional<double> &y) :
-    VSDGeometryListElement(id, level), m_x(FROM_OPTIONAL(x, 0.0)), m_y(FROM_OPTIONAL(y, 0.0)) {}
-  virtual ~VSDLineTo() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-  double m_x, m_y;
-};
-
-class VSDArcTo : public VSDGeometryListElement
-{
-public:
-  VSDArcTo(unsigned id, unsigned level, const boost::optional<double> &x2, const boost::optional<double> &y2, const boost::optional<double> &bow) :
-    VSDGeometryListElement(id, level), m_x2(FROM_OPTIONAL(x2, 0.0)), m_y2(FROM_OPTIONAL(y2, 0.0)), m_bow(FROM_OPTIONAL(bow, 0.0)) {}
-  virtual ~VSDArcTo() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-  double m_x2, m_y2, m_bow;
-};
-
-class VSDEllipse : public VSDGeometryListElement
-{
-public:
-  VSDEllipse(unsigned id, unsigned level, const boost::optional<double> &cx, const boost::optional<double> &cy,
-             const boost::optional<double> &xleft, const boost::optional<double> &yleft,
-             const boost::optional<double> &xtop, const boost::optional<double> &ytop) :
-    VSDGeometryListElement(id, level), m_cx(FROM_OPTIONAL(cx, 0.0)), m_cy(FROM_OPTIONAL(cy, 0.0)),
-    m_xleft(FROM_OPTIONAL(xleft, 0.0)), m_yleft(FROM_OPTIONAL(yleft, 0.0)), m_xtop(FROM_OPTIONAL(xtop, 0.0)),
-    m_ytop(FROM_OPTIONAL(ytop, 0.0)) {}
-  virtual ~VSDEllipse() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-  double m_cx, m_cy, m_xleft, m_yleft, m_xtop, m_ytop;
-};
-
-class VSDEllipticalArcTo : public VSDGeometryListElement
-{
-public:
-  VSDEllipticalArcTo(unsigned id, unsigned level, const boost::optional<double> &x3, const boost::optional<double> &y3,
-                     const boost::optional<double> &x2, const boost::optional<double> &y2,
-                     const boost::optional<double> &angle, const boost::optional<double> &ecc) :
-    VSDGeometryListElement(id, level), m_x3(FROM_OPTIONAL(x3, 0.0)), m_y3(FROM_OPTIONAL(y3, 0.0)), m_x2(FROM_OPTIONAL(x2, 0.0)),
-    m_y2(FROM_OPTIONAL(y2, 0.0)), m_angle(FROM_OPTIONAL(angle, 0.0)), m_ecc(FROM_OPTIONAL(ecc, 1.0)) {}
-  virtual ~VSDEllipticalArcTo() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-  double m_x3, m_y3, m_x2, m_y2, m_angle, m_ecc;
-};
-
-class VSDNURBSTo1 : public VSDGeometryListElement
-{
-public:
-  VSDNURBSTo1(unsigned id, unsigned level, double x2, double y2, unsigned char xType, unsigned char yType, unsigned degree,
-              std::vector<std::pair<double, double> > controlPoints, std::vector<double> knotVector, std::vector<double> weights) :
-    VSDGeometryListElement(id, level), m_x2(x2), m_y2(y2), m_xType(xType), m_yType(yType), m_degree(degree), m_controlPoints(controlPoints), m_knotVector(knotVector), m_weights(weights) {}
-  virtual ~VSDNURBSTo1() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-
-  double m_x2, m_y2;
-  unsigned m_xType, m_yType;
-  unsigned m_degree;
-  std::vector<std::pair<double, double> > m_controlPoints;
-  std::vector<double> m_knotVector, m_weights;
-};
-
-class VSDNURBSTo2 : public VSDGeometryListElement
-{
-public:
-  VSDNURBSTo2(unsigned id, unsigned level, double x2, double y2, double knot, double knotPrev, double weight, double weightPrev, unsigned dataID) :
-    VSDGeometryListElement(id, level), m_dataID(dataID), m_x2(x2), m_y2(y2), m_knot(knot), m_knotPrev(knotPrev), m_weight(weight), m_weightPrev(weightPrev) {}
-  virtual ~VSDNURBSTo2() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-
-  unsigned getDataID() const;
-  unsigned m_dataID;
-  double m_x2, m_y2;
-  double m_knot, m_knotPrev;
-  double m_weight, m_weightPrev;
-};
-
-class VSDNURBSTo3 : public VSDGeometryListElement
-{
-public:
-  VSDNURBSTo3(unsigned id, unsigned level, const boost::optional<double> &x2, const boost::optional<double> &y2, const boost::optional<double> &knot,
-              const boost::optional<double> &knotPrev, const boost::optional<double> &weight, const boost::optional<double> &weightPrev,
-              const boost::optional<NURBSData> &data) :
-    VSDGeometryListElement(id, level), m_data(FROM_OPTIONAL(data, NURBSData())), m_x2(FROM_OPTIONAL(x2, 0.0)), m_y2(FROM_OPTIONAL(y2, 0.0)),
-    m_knot(FROM_OPTIONAL(knot, 0.0)), m_knotPrev(FROM_OPTIONAL(knotPrev, 0.0)), m_weight(FROM_OPTIONAL(weight, 0.0)), m_weightPrev(FROM_OPTIONAL(weightPrev, 0.0)) {}
-  virtual ~VSDNURBSTo3() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-
-  NURBSData m_data;
-  double m_x2, m_y2;
-  double m_knot, m_knotPrev;
-  double m_weight, m_weightPrev;
-};
-
-class VSDPolylineTo1 : public VSDGeometryListElement
-{
-public:
-  VSDPolylineTo1(unsigned id , unsigned level, double x, double y, unsigned char xType, unsigned char yType, std::vector<std::pair<double, double> > points) :
-    VSDGeometryListElement(id, level), m_x(x), m_y(y), m_xType(xType), m_yType(yType), m_points(points) {}
-  virtual ~VSDPolylineTo1() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-
-  double m_x, m_y;
-  unsigned m_xType, m_yType;
-  std::vector<std::pair<double, double> > m_points;
-};
-
-class VSDPolylineTo2 : public VSDGeometryListElement
-{
-public:
-  VSDPolylineTo2(unsigned id , unsigned level, double x, double y, unsigned dataID) :
-    VSDGeometryListElement(id, level), m_dataID(dataID), m_x(x), m_y(y) {}
-  virtual ~VSDPolylineTo2() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-  unsigned getDataID() const;
-
-  unsigned m_dataID;
-  double m_x, m_y;
-};
-
-class VSDPolylineTo3 : public VSDGeometryListElement
-{
-public:
-  VSDPolylineTo3(unsigned id , unsigned level, const boost::optional<double> &x, const boost::optional<double> &y,
-                 const boost::optional<PolylineData> &data) :
-    VSDGeometryListElement(id, level), m_data(FROM_OPTIONAL(data, PolylineData())), m_x(FROM_OPTIONAL(x, 0.0)), m_y(FROM_OPTIONAL(y, 0.0)) {}
-  virtual ~VSDPolylineTo3() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-
-  PolylineData m_data;
-  double m_x, m_y;
-};
-
-class VSDSplineStart : public VSDGeometryListElement
-{
-public:
-  VSDSplineStart(unsigned id, unsigned level, const boost::optional<double> &x, const boost::optional<double> &y,
-                 const boost::optional<double> &secondKnot, const boost::optional<double> &firstKnot,
-                 const boost::optional<double> &lastKnot, const boost::optional<unsigned> &degree) :
-    VSDGeometryListElement(id, level), m_x(FROM_OPTIONAL(x, 0.0)), m_y(FROM_OPTIONAL(y, 0.0)), m_secondKnot(FROM_OPTIONAL(secondKnot, 0.0)),
-    m_firstKnot(FROM_OPTIONAL(firstKnot, 0.0)), m_lastKnot(FROM_OPTIONAL(lastKnot, 0.0)), m_degree(FROM_OPTIONAL(degree, 0)) {}
-  virtual ~VSDSplineStart() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-
-  double m_x, m_y;
-  double m_secondKnot, m_firstKnot, m_lastKnot;
-  unsigned m_degree;
-};
-
-class VSDSplineKnot : public VSDGeometryListElement
-{
-public:
-  VSDSplineKnot(unsigned id, unsigned level, const boost::optional<double> &x, const boost::optional<double> &y,
-                const boost::optional<double> &knot) :
-    VSDGeometryListElement(id, level), m_x(FROM_OPTIONAL(x, 0.0)), m_y(FROM_OPTIONAL(y, 0.0)), m_knot(FROM_OPTIONAL(knot, 0.0)) {}
-  virtual ~VSDSplineKnot() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-  double m_x, m_y;
-  double m_knot;
-};
-
-class VSDInfiniteLine : public VSDGeometryListElement
-{
-public:
-  VSDInfiniteLine(unsigned id, unsigned level, const boost::optional<double> &x1, const boost::optional<double> &y1,
-                  const boost::optional<double> &x2, const boost::optional<double> &y2) :
-    VSDGeometryListElement(id, level), m_x1(FROM_OPTIONAL(x1, 0.0)), m_y1(FROM_OPTIONAL(y1, 0.0)),
-    m_x2(FROM_OPTIONAL(x2, 0.0)), m_y2(FROM_OPTIONAL(y2, 0.0)) {}
-  virtual ~VSDInfiniteLine() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-  double m_x1, m_y1, m_x2, m_y2;
-};
-
-class VSDRelCubBezTo : public VSDGeometryListElement
-{
-public:
-  VSDRelCubBezTo(unsigned id, unsigned level, const boost::optional<double> &x, const boost::optional<double> &y, const boost::optional<double> &a,
-                 const boost::optional<double> &b, const boost::optional<double> &c, const boost::optional<double> &d) :
-    VSDGeometryListElement(id, level), m_x(FROM_OPTIONAL(x, 0.0)), m_y(FROM_OPTIONAL(y, 0.0)),
-    m_a(FROM_OPTIONAL(a, 0.0)), m_b(FROM_OPTIONAL(b, 0.0)), m_c(FROM_OPTIONAL(c, 0.0)), m_d(FROM_OPTIONAL(d, 0.0)) {}
-  virtual ~VSDRelCubBezTo() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-  double m_x, m_y, m_a, m_b, m_c, m_d;
-};
-
-class VSDRelEllipticalArcTo : public VSDGeometryListElement
-{
-public:
-  VSDRelEllipticalArcTo(unsigned id, unsigned level, const boost::optional<double> &x3, const boost::optional<double> &y3,
-                        const boost::optional<double> &x2, const boost::optional<double> &y2, const boost::optional<double> &angle,
-                        const boost::optional<double> &ecc) :
-    VSDGeometryListElement(id, level), m_x3(FROM_OPTIONAL(x3, 0.0)), m_y3(FROM_OPTIONAL(y3, 0.0)),
-    m_x2(FROM_OPTIONAL(x2, 0.0)), m_y2(FROM_OPTIONAL(y2, 0.0)), m_angle(FROM_OPTIONAL(angle, 0.0)),
-    m_ecc(FROM_OPTIONAL(ecc, 1.0)) {}
-  virtual ~VSDRelEllipticalArcTo() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-  double m_x3, m_y3, m_x2, m_y2, m_angle, m_ecc;
-};
-
-class VSDRelMoveTo : public VSDGeometryListElement
-{
-public:
-  VSDRelMoveTo(unsigned id, unsigned level, const boost::optional<double> &x, const boost::optional<double> &y) :
-    VSDGeometryListElement(id, level), m_x(FROM_OPTIONAL(x, 0.0)), m_y(FROM_OPTIONAL(y, 0.0)) {}
-  virtual ~VSDRelMoveTo() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-  double m_x, m_y;
-};
-
-class VSDRelLineTo : public VSDGeometryListElement
-{
-public:
-  VSDRelLineTo(unsigned id, unsigned level, const boost::optional<double> &x, const boost::optional<double> &y) :
-    VSDGeometryListElement(id, level), m_x(FROM_OPTIONAL(x, 0.0)), m_y(FROM_OPTIONAL(y, 0.0)) {}
-  virtual ~VSDRelLineTo() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-  double m_x, m_y;
-};
-
-class VSDRelQuadBezTo : public VSDGeometryListElement
-{
-public:
-  VSDRelQuadBezTo(unsigned id, unsigned level, const boost::optional<double> &x, const boost::optional<double> &y,
-                  const boost::optional<double> &a, const boost::optional<double> &b) :
-    VSDGeometryListElement(id, level), m_x(FROM_OPTIONAL(x, 0.0)),
-    m_y(FROM_OPTIONAL(y, 0.0)), m_a(FROM_OPTIONAL(a, 0.0)), m_b(FROM_OPTIONAL(b, 0.0)) {}
-  virtual ~VSDRelQuadBezTo() {}
-  void handle(VSDCollector *collector) const;
-  VSDGeometryListElement *clone();
-  double m_x, m_y, m_a, m_b;
-};
-
-} // namespace libvisio
-
-
 void libvisio::VSDGeometry::handle(VSDCollector *collector) const
 {
   collector->collectSplineEnd();
@@ -958,20 +665,31 @@ void libvisio::VSDGeometryList::handle(VSDCollector *collector) const
   }
   else
   {
-    std::vector<unsigned> tmpVector;
-
+    // the map already keeps the rows sorted by their ids
     for (iter = m_elements.begin(); iter != m_elements.end(); ++iter)
-      tmpVector.push_back(iter->first);
-    std::sort(tmpVector.begin(), tmpVector.end());
+      iter->second->handle(collector);
+  }
+  collector->collectSplineEnd();
+}
 
-    for (unsigned i = 0; i < tmpVector.size(); i++)
+void libvisio::VSDGeometryList::getRows(std::vector<const VSDGeometryListElement *> &rows) const
+{
+  rows.clear();
+  std::map<unsigned, VSDGeometryListElement *>::const_iterator iter;
+  if (!m_elementsOrder.empty())
+  {
+    for (unsigned i = 0; i < m_elementsOrder.size(); i++)
     {
-      iter = m_elements.find(tmpVector[i]);
+      iter = m_elements.find(m_elementsOrder[i]);
       if (iter != m_elements.end())
-        iter->second->handle(collector);
+        rows.push_back(iter->second);
     }
   }
-  collector->collectSplineEnd();
+  else
+  {
+    for (iter = m_elements.begin(); iter != m_elements.end(); ++iter)
+      rows.push_back(iter->second);
+  }
 }
 
 void libvisio::VSDGeometryList::clear()
@@ -36,23 +36,47 @@
 VSDInternalStream::VSDInternalStream(const std::vector<unsigned char> &buffer) :
   WPXInputStream(),
   m_offset(0),
-  m_buffer(buffer)
+  m_buffer(buffer),
+  m_data(0),
+  m_size(0)
 {
+  _setData();
 }
 
 VSDInternalStream::VSDInternalStream(const unsigned char *buffer, size_t bufferLength) :
   WPXInputStream(),
   m_offset(0),
-  m_buffer(bufferLength)
+  m_buffer(bufferLength),
+  m_data(0),
+  m_size(0)
 {
-  memcpy(&m_buffer[0], buffer, bufferLength);
+  if (bufferLength)
+    memcpy(&m_buffer[0], buffer, bufferLength);
+  _setData();
+}
+
+VSDInternalStream::VSDInternalStream(const std::vector<unsigned char> *buffer) :
+  WPXInputStream(),
+  m_offset(0),
+  m_buffer(),
+  m_data(buffer && !buffer->empty() ? &(*buffer)[0] : 0),
+  m_size(buffer ? buffer->size() : 0)
+{
+}
+
+void VSDInternalStream::_setData()
+{
+  m_data = m_buffer.empty() ? 0 : &m_buffer[0];
+  m_size = m_buffer.size();
 }
 
 
 VSDInternalStream::VSDInternalStream(WPXInputStream *input, unsigned long size, bool compressed) :
   WPXInputStream(),
   m_offset(0),
-  m_buffer()
+  m_buffer(),
+  m_data(0),
+  m_size(0)
 {
   unsigned long tmpNumBytesRead = 0;
 
@@ -112,6 +136,7 @@ VSDInternalStream::VSDInternalStream(WPXInputStream *input, unsigned long size,
       }
     }
   }
+  _setData();
 }
 
 const unsigned char *VSDInternalStream::read(unsigned long numBytes, unsigned long &numBytesRead)
@@ -123,10 +148,10 @@ const unsigned char *VSDInternalStream::read(unsigned long numBytes, unsigned lo
 
   int numBytesToRead;
 
-  if ((m_offset+numBytes) < m_buffer.size())
+  if ((m_offset+numBytes) < m_size)
     numBytesToRead = numBytes;
   else
-    numBytesToRead = m_buffer.size() - m_offset;
+    numBytesToRead = m_size - m_offset;
 
   numBytesRead = numBytesToRead; // about as paranoid as we can be..
 
@@ -136,7 +161,7 @@ const unsigned char *VSDInternalStream::read(unsigned long numBytes, unsigned lo
   long oldOffset = m_offset;
   m_offset += numBytesToRead;
 
-  return &m_buffer[oldOffset];
+  return m_data + oldOffset;
 }
 
 int VSDInternalStream::seek(long offset, WPX_SEEK_TYPE seekType)
@@ -151,9 +176,9 @@ int VSDInternalStream::seek(long offset, WPX_SEEK_TYPE seekType)
     m_offset = 0;
     return 1;
   }
-  if ((long)m_offset > (long)m_buffer.size())
+  if ((long)m_offset > (long)m_size)
   {
-    m_offset = m_buffer.size();
+    m_offset = m_size;
     return 1;
   }
 
@@ -167,7 +192,7 @@ long VSDInternalStream::tell()
 
 bool VSDInternalStream::atEOS()
 {
-  if ((long)m_offset >= (long)m_buffer.size())
+  if ((long)m_offset >= (long)m_size)
     return true;
 
   return false;
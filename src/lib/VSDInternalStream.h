@@ -42,6 +42,8 @@ public:
   VSDInternalStream(WPXInputStream *input, unsigned long size, bool compressed=false);
   VSDInternalStream(const std::vector<unsigned char> &buffer);
   VSDInternalStream(const unsigned char *buffer, size_t bufferLength);
+  // Reads the buffer in place, which must outlive the stream
+  VSDInternalStream(const std::vector<unsigned char> *buffer);
   ~VSDInternalStream() {}
 
   bool isOLEStream()
@@ -59,12 +61,16 @@ public:
   bool atEOS();
   unsigned long getSize() const
   {
-    return m_buffer.size();
+    return m_size;
   };
 
 private:
+  void _setData();
   volatile long m_offset;
   std::vector<unsigned char> m_buffer;
+  // the data read, in m_buffer or in a borrowed buffer
+  const unsigned char *m_data;
+  unsigned long m_size;
   VSDInternalStream(const VSDInternalStream &);
   VSDInternalStream &operator=(const VSDInternalStream &);
 };
@@ -62,15 +62,15 @@ private:
 class VSDPathOutputElement : public VSDOutputElement
 {
 public:
-  VSDPathOutputElement(const WPXPropertyListVector &propListVec);
+  VSDPathOutputElement(const VSDPath &path);
   virtual ~VSDPathOutputElement() {}
   virtual void draw(libwpg::WPGPaintInterface *painter);
   virtual VSDOutputElement *clone()
   {
-    return new VSDPathOutputElement(m_propListVec);
+    return new VSDPathOutputElement(m_path);
   }
 private:
-  WPXPropertyListVector m_propListVec;
+  VSDPath m_path;
 };
 
 
@@ -229,13 +229,23 @@ void libvisio::VSDStyleOutputElement::draw(libwpg::WPGPaintInterface *painter)
 }
 
 
-libvisio::VSDPathOutputElement::VSDPathOutputElement(const WPXPropertyListVector &propListVec) :
-  m_propListVec(propListVec) {}
+libvisio::VSDPathOutputElement::VSDPathOutputElement(const VSDPath &path) :
+  m_path(path) {}
 
 void libvisio::VSDPathOutputElement::draw(libwpg::WPGPaintInterface *painter)
 {
-  if (painter)
-    painter->drawPath(m_propListVec);
+  if (!painter)
+    return;
+  // The property lists are built only for painters that need them
+  VSDPathPainter *pathPainter = dynamic_cast<VSDPathPainter *>(painter);
+  if (pathPainter)
+    pathPainter->drawPath(m_path);
+  else
+  {
+    WPXPropertyListVector propListVec;
+    convertPath(m_path, propListVec);
+    painter->drawPath(propListVec);
+  }
 }
 
 
@@ -383,9 +393,9 @@ void libvisio::VSDOutputElementList::addStyle(const WPXPropertyList &propList, c
   m_elements.push_back(new VSDStyleOutputElement(propList, propListVec));
 }
 
-void libvisio::VSDOutputElementList::addPath(const WPXPropertyListVector &propListVec)
+void libvisio::VSDOutputElementList::addPath(const VSDPath &path)
 {
-  m_elements.push_back(new VSDPathOutputElement(propListVec));
+  m_elements.push_back(new VSDPathOutputElement(path));
 }
 
 void libvisio::VSDOutputElementList::addGraphicObject(const WPXPropertyList &propList, const ::WPXBinaryData &binaryData)
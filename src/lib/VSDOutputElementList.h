@@ -36,6 +36,7 @@
 #include <vector>
 #include <libwpd/libwpd.h>
 #include <libwpg/libwpg.h>
+#include "VSDPath.h"
 
 namespace libvisio
 {
@@ -52,7 +53,7 @@ public:
   void append(const VSDOutputElementList &elementList);
   void draw(libwpg::WPGPaintInterface *painter) const;
   void addStyle(const WPXPropertyList &propList, const WPXPropertyListVector &propListVec);
-  void addPath(const WPXPropertyListVector &propListVec);
+  void addPath(const VSDPath &path);
   void addGraphicObject(const WPXPropertyList &propList, const ::WPXBinaryData &binaryData);
   void addStartTextObject(const WPXPropertyList &propList, const WPXPropertyListVector &propListVec);
   void addStartTextLine(const WPXPropertyList &propList);
@@ -67,6 +68,10 @@ public:
   {
     return m_elements.empty();
   }
+  unsigned long size() const
+  {
+    return (unsigned long)m_elements.size();
+  }
 private:
   std::vector<VSDOutputElement *> m_elements;
 };
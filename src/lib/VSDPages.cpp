@@ -28,6 +28,7 @@
  * instead of those above.
  */
 
+#include <set>
 #include "VSDPages.h"
 #include "libvisio_utils.h"
 
@@ -74,8 +75,9 @@ void libvisio::VSDPage::draw(libwpg::WPGPaintInterface *painter) const
     m_pageElements.draw(painter);
 }
 
-libvisio::VSDPages::VSDPages()
-  : m_pages(), m_backgroundPages()
+libvisio::VSDPages::VSDPages(unsigned maxBackgroundDepth)
+  : m_pages(), m_backgroundPages(), m_maxBackgroundDepth(maxBackgroundDepth),
+    m_isBackgroundDepthExceeded(false)
 {
 }
 
@@ -125,13 +127,33 @@ void libvisio::VSDPages::_drawWithBackground(libwpg::WPGPaintInterface *painter,
   if (!painter)
     return;
 
-  if (page.m_backgroundPageID != MINUS_ONE)
+  // Follow the chain of the backgrounds down to the last one, stopping at
+  // a page that is in the chain already, then draw it from the bottom up
+  std::vector<const libvisio::VSDPage *> pages;
+  std::set<unsigned> pageIDs;
+  pages.push_back(&page);
+  pageIDs.insert(page.m_currentPageID);
+  for (unsigned backgroundPageID = page.m_backgroundPageID; backgroundPageID != MINUS_ONE;)
   {
-    std::map<unsigned, libvisio::VSDPage>::iterator iter = m_backgroundPages.find(page.m_backgroundPageID);
-    if (iter != m_backgroundPages.end())
-      _drawWithBackground(painter, iter->second);
+    if (m_maxBackgroundDepth && pages.size() > m_maxBackgroundDepth)
+    {
+      VSD_DEBUG_MSG(("VSDPages: more than %u background pages under page %u\n", m_maxBackgroundDepth, page.m_currentPageID));
+      m_isBackgroundDepthExceeded = true;
+      break;
+    }
+    if (!pageIDs.insert(backgroundPageID).second)
+    {
+      VSD_DEBUG_MSG(("VSDPages: the background pages of page %u loop\n", page.m_currentPageID));
+      break;
+    }
+    std::map<unsigned, libvisio::VSDPage>::const_iterator iter = m_backgroundPages.find(backgroundPageID);
+    if (iter == m_backgroundPages.end())
+      break;
+    pages.push_back(&iter->second);
+    backgroundPageID = iter->second.m_backgroundPageID;
   }
-  page.draw(painter);
+  for (std::vector<const libvisio::VSDPage *>::reverse_iterator iter = pages.rbegin(); iter != pages.rend(); ++iter)
+    (*iter)->draw(painter);
 }
 
 
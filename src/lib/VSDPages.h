@@ -55,15 +55,21 @@ public:
 class VSDPages
 {
 public:
-  VSDPages();
+  VSDPages(unsigned maxBackgroundDepth = 0);
   ~VSDPages();
   void addPage(const VSDPage &page);
   void addBackgroundPage(const VSDPage &page);
   void draw(libwpg::WPGPaintInterface *painter);
+  bool isBackgroundDepthExceeded() const
+  {
+    return m_isBackgroundDepthExceeded;
+  }
 private:
   void _drawWithBackground(libwpg::WPGPaintInterface *painter, const VSDPage &page);
   std::vector<VSDPage> m_pages;
   std::map<unsigned, VSDPage> m_backgroundPages;
+  unsigned m_maxBackgroundDepth;
+  bool m_isBackgroundDepthExceeded;
 };
 
 
@@ -47,7 +47,7 @@ libvisio::VSDParser::VSDParser(WPXInputStream *input, libwpg::WPGPaintInterface
     m_currentShapeLevel(0), m_currentShapeID(MINUS_ONE), m_extractStencils(false), m_colours(),
     m_isBackgroundPage(false), m_isShapeStarted(false), m_shadowOffsetX(0.0), m_shadowOffsetY(0.0),
     m_currentGeometryList(0), m_currentGeomListCount(0), m_fonts(), m_names(), m_namesMapMap(),
-    m_currentPageName()
+    m_currentPageName(), m_options()
 {}
 
 libvisio::VSDParser::~VSDParser()
@@ -141,11 +141,9 @@ bool libvisio::VSDParser::parseMain()
   m_input->seek(trailerPointer.Offset, WPX_SEEK_SET);
   VSDInternalStream trailerStream(m_input, trailerPointer.Length, compressed);
 
-  std::vector<std::map<unsigned, XForm> > groupXFormsSequence;
-  std::vector<std::map<unsigned, unsigned> > groupMembershipsSequence;
-  std::vector<std::list<unsigned> > documentPageShapeOrders;
+  std::vector<VSDShapeTable> documentShapeTables;
 
-  VSDStylesCollector stylesCollector(groupXFormsSequence, groupMembershipsSequence, documentPageShapeOrders);
+  VSDStylesCollector stylesCollector(documentShapeTables);
   m_collector = &stylesCollector;
   VSD_DEBUG_MSG(("VSDParser::parseMain 1st pass\n"));
   if (!parseDocument(&trailerStream, shift))
@@ -155,13 +153,12 @@ bool libvisio::VSDParser::parseMain()
 
   VSDStyles styles = stylesCollector.getStyleSheets();
 
-  VSDContentCollector contentCollector(m_painter, groupXFormsSequence, groupMembershipsSequence, documentPageShapeOrders, styles, m_stencils);
+  VSDContentCollector contentCollector(m_painter, documentShapeTables, styles, m_stencils, m_options);
   m_collector = &contentCollector;
   VSD_DEBUG_MSG(("VSDParser::parseMain 2nd pass\n"));
-  if (!parseDocument(&trailerStream, shift))
-    return false;
-
-  return true;
+  const bool isParsed = parseDocument(&trailerStream, shift);
+  m_options.setExceededLimits(contentCollector.getExceededLimits());
+  return isParsed;
 }
 
 bool libvisio::VSDParser::parseDocument(WPXInputStream *input, unsigned shift)
@@ -183,6 +180,16 @@ bool libvisio::VSDParser::extractStencils()
   return parseMain();
 }
 
+void libvisio::VSDParser::setRenderingOptions(const VSDRenderingOptions &options)
+{
+  m_options = options;
+}
+
+unsigned libvisio::VSDParser::getExceededLimits() const
+{
+  return m_options.getExceededLimits();
+}
+
 void libvisio::VSDParser::readPointer(WPXInputStream *input, Pointer &ptr)
 {
   ptr.Type = readU32(input);
@@ -625,6 +632,8 @@ void libvisio::VSDParser::_flushShape()
   for (std::map<unsigned, VSDName>::const_iterator iterName = m_shape.m_names.begin(); iterName != m_shape.m_names.end(); ++iterName)
     m_collector->collectName(iterName->first, m_currentShapeLevel+2, iterName->second.m_data, iterName->second.m_format);
 
+  m_collector->collectShapeGeometries(m_currentShapeLevel+2, m_shape.m_geometries);
+
   if (m_shape.m_foreign && m_shape.m_foreign->data.size())
     m_collector->collectForeignData(m_currentShapeLevel+1, m_shape.m_foreign->data);
 
@@ -636,7 +645,7 @@ void libvisio::VSDParser::_flushShape()
 
 
   for (std::map<unsigned, VSDGeometryList>::const_iterator iterGeom = m_shape.m_geometries.begin(); iterGeom != m_shape.m_geometries.end(); ++iterGeom)
-    iterGeom->second.handle(m_collector);
+    m_collector->collectGeometryList(m_currentShapeLevel+2, iterGeom->second);
 
   m_collector->collectDefaultCharStyle(m_shape.m_charStyle.charCount, m_shape.m_charStyle.font, m_shape.m_charStyle.colour,
                                        m_shape.m_charStyle.size, m_shape.m_charStyle.bold, m_shape.m_charStyle.italic, m_shape.m_charStyle.underline,
@@ -1439,11 +1448,10 @@ void libvisio::VSDParser::readShapeData(WPXInputStream *input)
       points.push_back(std::pair<double, double>(x, y));
     }
 
-    PolylineData data;
+    PolylineData &data = m_shape.m_polylineData[m_header.id];
     data.xType = xType;
     data.yType = yType;
-    data.points = points;
-    m_shape.m_polylineData[m_header.id] = data;
+    data.points.swap(points);
   }
 
   // NURBS data
@@ -1472,15 +1480,14 @@ void libvisio::VSDParser::readShapeData(WPXInputStream *input)
       controlPoints.push_back(std::pair<double, double>(controlX, controlY));
     }
 
-    NURBSData data;
+    NURBSData &data = m_shape.m_nurbsData[m_header.id];
     data.lastKnot = lastKnot;
     data.degree = degree;
     data.xType = xType;
     data.yType = yType;
-    data.knots = knotVector;
-    data.weights = weights;
-    data.points = controlPoints;
-    m_shape.m_nurbsData[m_header.id] = data;
+    data.knots.swap(knotVector);
+    data.weights.swap(weights);
+    data.points.swap(controlPoints);
   }
 }
 
@@ -39,6 +39,7 @@
 #include <libwpd/libwpd.h>
 #include <libwpd-stream/libwpd-stream.h>
 #include <libwpg/libwpg.h>
+#include <libvisio/libvisio.h>
 #include "VSDTypes.h"
 #include "VSDGeometryList.h"
 #include "VSDFieldList.h"
@@ -72,6 +73,8 @@ public:
   virtual ~VSDParser();
   bool parseMain();
   bool extractStencils();
+  void setRenderingOptions(const VSDRenderingOptions &options);
+  unsigned getExceededLimits() const;
 
 protected:
   // reader functions
@@ -186,6 +189,8 @@ protected:
   std::map<unsigned, std::map<unsigned, VSDName> > m_namesMapMap;
   VSDName m_currentPageName;
 
+  VSDRenderingOptions m_options;
+
 private:
   VSDParser();
   VSDParser(const VSDParser &);
@@ -0,0 +1,78 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* libvisio
+ * Version: MPL 1.1 / GPLv2+ / LGPLv2+
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License or as specified alternatively below. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * Major Contributor(s):
+ * Copyright (C) 2012 Fridrich Strba <fridrich.strba@bluewin.ch>
+ *
+ *
+ * All Rights Reserved.
+ *
+ * For minor contributions see the git repository.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPLv2+"), or
+ * the GNU Lesser General Public License Version 2 or later (the "LGPLv2+"),
+ * in which case the provisions of the GPLv2+ or the LGPLv2+ are applicable
+ * instead of those above.
+ */
+
+
+#include "VSDPath.h"
+
+void libvisio::convertPath(const VSDPath &path, WPXPropertyListVector &propListVec)
+{
+  WPXPropertyList propList;
+  for (VSDPath::const_iterator it = path.begin(); it != path.end(); ++it)
+  {
+    propList.clear();
+    switch (it->action)
+    {
+    case VSD_PATH_MOVE_TO:
+      propList.insert("libwpg:path-action", "M");
+      break;
+    case VSD_PATH_LINE_TO:
+      propList.insert("libwpg:path-action", "L");
+      break;
+    case VSD_PATH_CUBIC_TO:
+      propList.insert("libwpg:path-action", "C");
+      propList.insert("svg:x1", it->x1);
+      propList.insert("svg:y1", it->y1);
+      propList.insert("svg:x2", it->x2);
+      propList.insert("svg:y2", it->y2);
+      break;
+    case VSD_PATH_QUADRATIC_TO:
+      propList.insert("libwpg:path-action", "Q");
+      propList.insert("svg:x1", it->x1);
+      propList.insert("svg:y1", it->y1);
+      break;
+    case VSD_PATH_ARC_TO:
+      propList.insert("libwpg:path-action", "A");
+      propList.insert("svg:rx", it->rx);
+      propList.insert("svg:ry", it->ry);
+      propList.insert("libwpg:rotate", it->rotate, WPX_GENERIC);
+      propList.insert("libwpg:large-arc", it->largeArc ? 1 : 0);
+      propList.insert("libwpg:sweep", it->sweep ? 1 : 0);
+      break;
+    default:
+      propList.insert("libwpg:path-action", "Z");
+      propListVec.append(propList);
+      continue;
+    }
+    propList.insert("svg:x", it->x);
+    propList.insert("svg:y", it->y);
+    propListVec.append(propList);
+  }
+}
+
+/* vim:set shiftwidth=2 softtabstop=2 expandtab: */
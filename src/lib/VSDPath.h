@@ -0,0 +1,97 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* libvisio
+ * Version: MPL 1.1 / GPLv2+ / LGPLv2+
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License or as specified alternatively below. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * Major Contributor(s):
+ * Copyright (C) 2012 Fridrich Strba <fridrich.strba@bluewin.ch>
+ *
+ *
+ * All Rights Reserved.
+ *
+ * For minor contributions see the git repository.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPLv2+"), or
+ * the GNU Lesser General Public License Version 2 or later (the "LGPLv2+"),
+ * in which case the provisions of the GPLv2+ or the LGPLv2+ are applicable
+ * instead of those above.
+ */
+
+
+#ifndef __VSDPATH_H__
+#define __VSDPATH_H__
+
+#include <vector>
+#include <libwpd/libwpd.h>
+
+namespace libvisio
+{
+
+enum VSDPathAction
+{
+  VSD_PATH_MOVE_TO,
+  VSD_PATH_LINE_TO,
+  VSD_PATH_CUBIC_TO,
+  VSD_PATH_QUADRATIC_TO,
+  VSD_PATH_ARC_TO,
+  VSD_PATH_CLOSE
+};
+
+// One command of a path, in output co-ordinates. The control points of
+// the Bezier curves share their place with the radii and the rotation
+// (in degrees) of the arcs.
+struct VSDPathElement
+{
+  VSDPathElement(VSDPathAction a = VSD_PATH_CLOSE, double px = 0.0, double py = 0.0)
+    : action(a), largeArc(false), sweep(false), x(px), y(py), x1(0.0), y1(0.0), x2(0.0), y2(0.0) {}
+  VSDPathAction action;
+  bool largeArc;
+  bool sweep;
+  double x;
+  double y;
+  union
+  {
+    double x1;
+    double rx;
+  };
+  union
+  {
+    double y1;
+    double ry;
+  };
+  union
+  {
+    double x2;
+    double rotate;
+  };
+  double y2;
+};
+
+typedef std::vector<VSDPathElement> VSDPath;
+
+// Converts the path to the property lists libwpg painters take
+void convertPath(const VSDPath &path, WPXPropertyListVector &propListVec);
+
+// Implemented by the painters that take paths in the typed form, which
+// spares the conversion of every path to property lists
+class VSDPathPainter
+{
+public:
+  virtual ~VSDPathPainter() {}
+  virtual void drawPath(const VSDPath &path) = 0;
+};
+
+} // namespace libvisio
+
+#endif // __VSDPATH_H__
+/* vim:set shiftwidth=2 softtabstop=2 expandtab: */
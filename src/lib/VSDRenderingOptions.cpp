@@ -0,0 +1,202 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* libvisio
+ * Version: MPL 1.1 / GPLv2+ / LGPLv2+
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License or as specified alternatively below. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * Major Contributor(s):
+ * Copyright (C) 2012 Fridrich Strba <fridrich.strba@bluewin.ch>
+ *
+ *
+ * All Rights Reserved.
+ *
+ * For minor contributions see the git repository.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPLv2+"), or
+ * the GNU Lesser General Public License Version 2 or later (the "LGPLv2+"),
+ * in which case the provisions of the GPLv2+ or the LGPLv2+ are applicable
+ * instead of those above.
+ */
+
+
+#include <libvisio/libvisio.h>
+
+namespace libvisio
+{
+class VSDRenderingOptionsImpl
+{
+public:
+  VSDRenderingOptionsImpl() : m_flatteningTolerance(0.0), m_simplificationTolerance(0.0),
+    m_maxCurveDegree(0), m_maxVertexCount(0), m_maxGroupDepth(0), m_maxBackgroundDepth(0), m_maxElementCount(0),
+    m_exceededLimits(0), m_shapeCulling(false), m_viewportX(0.0), m_viewportY(0.0), m_viewportWidth(0.0), m_viewportHeight(0.0) {}
+  ~VSDRenderingOptionsImpl() {}
+  double m_flatteningTolerance;
+  double m_simplificationTolerance;
+  unsigned m_maxCurveDegree;
+  unsigned long m_maxVertexCount;
+  unsigned m_maxGroupDepth;
+  unsigned m_maxBackgroundDepth;
+  unsigned long m_maxElementCount;
+  unsigned m_exceededLimits;
+  bool m_shapeCulling;
+  double m_viewportX;
+  double m_viewportY;
+  double m_viewportWidth;
+  double m_viewportHeight;
+};
+
+} // namespace libvisio
+
+libvisio::VSDRenderingOptions::VSDRenderingOptions()
+  : m_pImpl(new VSDRenderingOptionsImpl())
+{
+}
+
+libvisio::VSDRenderingOptions::VSDRenderingOptions(const VSDRenderingOptions &options)
+  : m_pImpl(new VSDRenderingOptionsImpl(*(options.m_pImpl)))
+{
+}
+
+libvisio::VSDRenderingOptions::~VSDRenderingOptions()
+{
+  delete m_pImpl;
+}
+
+libvisio::VSDRenderingOptions &libvisio::VSDRenderingOptions::operator=(const VSDRenderingOptions &options)
+{
+  // Check for self-assignment
+  if (this == &options)
+    return *this;
+  *m_pImpl = *(options.m_pImpl);
+  return *this;
+}
+
+void libvisio::VSDRenderingOptions::setFlatteningTolerance(double tolerance)
+{
+  // anything that is not a positive number turns the adaptive flattening off
+  m_pImpl->m_flatteningTolerance = tolerance > 0.0 ? tolerance : 0.0;
+}
+
+double libvisio::VSDRenderingOptions::getFlatteningTolerance() const
+{
+  return m_pImpl->m_flatteningTolerance;
+}
+
+void libvisio::VSDRenderingOptions::setSimplificationTolerance(double tolerance)
+{
+  m_pImpl->m_simplificationTolerance = tolerance > 0.0 ? tolerance : 0.0;
+}
+
+double libvisio::VSDRenderingOptions::getSimplificationTolerance() const
+{
+  return m_pImpl->m_simplificationTolerance;
+}
+
+void libvisio::VSDRenderingOptions::setMaximalCurveDegree(unsigned degree)
+{
+  m_pImpl->m_maxCurveDegree = degree;
+}
+
+unsigned libvisio::VSDRenderingOptions::getMaximalCurveDegree() const
+{
+  return m_pImpl->m_maxCurveDegree;
+}
+
+void libvisio::VSDRenderingOptions::setMaximalVertexCount(unsigned long count)
+{
+  m_pImpl->m_maxVertexCount = count;
+}
+
+unsigned long libvisio::VSDRenderingOptions::getMaximalVertexCount() const
+{
+  return m_pImpl->m_maxVertexCount;
+}
+
+void libvisio::VSDRenderingOptions::setMaximalGroupDepth(unsigned depth)
+{
+  m_pImpl->m_maxGroupDepth = depth;
+}
+
+unsigned libvisio::VSDRenderingOptions::getMaximalGroupDepth() const
+{
+  return m_pImpl->m_maxGroupDepth;
+}
+
+void libvisio::VSDRenderingOptions::setMaximalBackgroundDepth(unsigned depth)
+{
+  m_pImpl->m_maxBackgroundDepth = depth;
+}
+
+unsigned libvisio::VSDRenderingOptions::getMaximalBackgroundDepth() const
+{
+  return m_pImpl->m_maxBackgroundDepth;
+}
+
+void libvisio::VSDRenderingOptions::setMaximalElementCount(unsigned long count)
+{
+  m_pImpl->m_maxElementCount = count;
+}
+
+unsigned long libvisio::VSDRenderingOptions::getMaximalElementCount() const
+{
+  return m_pImpl->m_maxElementCount;
+}
+
+void libvisio::VSDRenderingOptions::setExceededLimits(unsigned limits)
+{
+  m_pImpl->m_exceededLimits = limits;
+}
+
+unsigned libvisio::VSDRenderingOptions::getExceededLimits() const
+{
+  return m_pImpl->m_exceededLimits;
+}
+
+void libvisio::VSDRenderingOptions::setShapeCulling(bool culling)
+{
+  m_pImpl->m_shapeCulling = culling;
+}
+
+bool libvisio::VSDRenderingOptions::getShapeCulling() const
+{
+  return m_pImpl->m_shapeCulling;
+}
+
+void libvisio::VSDRenderingOptions::setViewport(double x, double y, double width, double height)
+{
+  m_pImpl->m_viewportX = x;
+  m_pImpl->m_viewportY = y;
+  m_pImpl->m_viewportWidth = width > 0.0 ? width : 0.0;
+  m_pImpl->m_viewportHeight = height > 0.0 ? height : 0.0;
+}
+
+double libvisio::VSDRenderingOptions::getViewportX() const
+{
+  return m_pImpl->m_viewportX;
+}
+
+double libvisio::VSDRenderingOptions::getViewportY() const
+{
+  return m_pImpl->m_viewportY;
+}
+
+double libvisio::VSDRenderingOptions::getViewportWidth() const
+{
+  return m_pImpl->m_viewportWidth;
+}
+
+double libvisio::VSDRenderingOptions::getViewportHeight() const
+{
+  return m_pImpl->m_viewportHeight;
+}
+
+/* vim:set shiftwidth=2 softtabstop=2 expandtab: */
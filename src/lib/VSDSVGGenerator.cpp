@@ -29,6 +29,7 @@
  */
 
 #include "VSDSVGGenerator.h"
+#include "libvisio_utils.h"
 #include <locale.h>
 #include <sstream>
 #include <string>
@@ -406,42 +407,86 @@ void libvisio::VSDSVGGenerator::drawPolySomething(const ::WPXPropertyListVector
 
 void libvisio::VSDSVGGenerator::drawPath(const ::WPXPropertyListVector &path)
 {
-  m_outputSink << "<svg:path d=\" ";
-  bool isClosed = false;
-  unsigned i=0;
-  for(i=0; i < path.count(); i++)
+  VSDPath typedPath;
+  typedPath.reserve(path.count());
+  for (unsigned i = 0; i < path.count(); i++)
   {
     WPXPropertyList propList = path[i];
-    if (propList["libwpg:path-action"] && propList["libwpg:path-action"]->getStr() == "M")
+    if (!propList["libwpg:path-action"])
+      continue;
+    const WPXString action = propList["libwpg:path-action"]->getStr();
+    VSDPathElement element;
+    if (action == "M")
+      element.action = VSD_PATH_MOVE_TO;
+    else if (action == "L")
+      element.action = VSD_PATH_LINE_TO;
+    else if (action == "C")
     {
-      m_outputSink << "\nM";
-      m_outputSink << doubleToString(72*(propList["svg:x"]->getDouble())) << "," << doubleToString(72*(propList["svg:y"]->getDouble()));
+      element.action = VSD_PATH_CUBIC_TO;
+      element.x1 = propList["svg:x1"]->getDouble();
+      element.y1 = propList["svg:y1"]->getDouble();
+      element.x2 = propList["svg:x2"]->getDouble();
+      element.y2 = propList["svg:y2"]->getDouble();
     }
-    else if (propList["libwpg:path-action"] && propList["libwpg:path-action"]->getStr() == "L")
+    else if (action == "A")
     {
-      m_outputSink << "\nL";
-      m_outputSink << doubleToString(72*(propList["svg:x"]->getDouble())) << "," << doubleToString(72*(propList["svg:y"]->getDouble()));
+      element.action = VSD_PATH_ARC_TO;
+      element.rx = propList["svg:rx"]->getDouble();
+      element.ry = propList["svg:ry"]->getDouble();
+      element.rotate = propList["libwpg:rotate"] ? propList["libwpg:rotate"]->getDouble() : 0;
+      element.largeArc = propList["libwpg:large-arc"] ? propList["libwpg:large-arc"]->getInt() : true;
+      element.sweep = propList["libwpg:sweep"] ? propList["libwpg:sweep"]->getInt() : true;
     }
-    else if (propList["libwpg:path-action"] && propList["libwpg:path-action"]->getStr() == "C")
+    else if (action == "Z")
     {
-      m_outputSink << "\nC";
-      m_outputSink << doubleToString(72*(propList["svg:x1"]->getDouble())) << "," << doubleToString(72*(propList["svg:y1"]->getDouble())) << " ";
-      m_outputSink << doubleToString(72*(propList["svg:x2"]->getDouble())) << "," << doubleToString(72*(propList["svg:y2"]->getDouble())) << " ";
-      m_outputSink << doubleToString(72*(propList["svg:x"]->getDouble())) << "," << doubleToString(72*(propList["svg:y"]->getDouble()));
+      typedPath.push_back(element);
+      continue;
     }
-    else if (propList["libwpg:path-action"] && propList["libwpg:path-action"]->getStr() == "A")
+    else
+      continue;
+    element.x = propList["svg:x"]->getDouble();
+    element.y = propList["svg:y"]->getDouble();
+    typedPath.push_back(element);
+  }
+  drawPath(typedPath);
+}
+
+void libvisio::VSDSVGGenerator::drawPath(const VSDPath &path)
+{
+  m_outputSink << "<svg:path d=\" ";
+  bool isClosed = false;
+  for (VSDPath::const_iterator it = path.begin(); it != path.end(); ++it)
+  {
+    switch (it->action)
     {
+    case VSD_PATH_MOVE_TO:
+      m_outputSink << "\nM";
+      m_outputSink << doubleToString(72*(it->x)) << "," << doubleToString(72*(it->y));
+      break;
+    case VSD_PATH_LINE_TO:
+      m_outputSink << "\nL";
+      m_outputSink << doubleToString(72*(it->x)) << "," << doubleToString(72*(it->y));
+      break;
+    case VSD_PATH_CUBIC_TO:
+      m_outputSink << "\nC";
+      m_outputSink << doubleToString(72*(it->x1)) << "," << doubleToString(72*(it->y1)) << " ";
+      m_outputSink << doubleToString(72*(it->x2)) << "," << doubleToString(72*(it->y2)) << " ";
+      m_outputSink << doubleToString(72*(it->x)) << "," << doubleToString(72*(it->y));
+      break;
+    case VSD_PATH_ARC_TO:
       m_outputSink << "\nA";
-      m_outputSink << doubleToString(72*(propList["svg:rx"]->getDouble())) << "," << doubleToString(72*(propList["svg:ry"]->getDouble())) << " ";
-      m_outputSink << doubleToString(propList["libwpg:rotate"] ? propList["libwpg:rotate"]->getDouble() : 0) << " ";
-      m_outputSink << (propList["libwpg:large-arc"] ? propList["libwpg:large-arc"]->getInt() : 1) << ",";
-      m_outputSink << (propList["libwpg:sweep"] ? propList["libwpg:sweep"]->getInt() : 1) << " ";
-      m_outputSink << doubleToString(72*(propList["svg:x"]->getDouble())) << "," << doubleToString(72*(propList["svg:y"]->getDouble()));
-    }
-    else if (propList["libwpg:path-action"] && propList["libwpg:path-action"]->getStr() == "Z")
-    {
+      m_outputSink << doubleToString(72*(it->rx)) << "," << doubleToString(72*(it->ry)) << " ";
+      m_outputSink << doubleToString(it->rotate) << " ";
+      m_outputSink << (it->largeArc ? 1 : 0) << ",";
+      m_outputSink << (it->sweep ? 1 : 0) << " ";
+      m_outputSink << doubleToString(72*(it->x)) << "," << doubleToString(72*(it->y));
+      break;
+    case VSD_PATH_CLOSE:
       isClosed = true;
       m_outputSink << "\nZ";
+      break;
+    default:
+      break;
     }
   }
 
@@ -454,7 +499,6 @@ void libvisio::VSDSVGGenerator::drawGraphicObject(const ::WPXPropertyList &propL
 {
   if (!propList["libwpg:mime-type"] || propList["libwpg:mime-type"]->getStr().len() <= 0)
     return;
-  WPXString base64 = binaryData.getBase64Data();
   m_outputSink << "<svg:image ";
   if (propList["svg:x"] && propList["svg:y"] && propList["svg:width"] && propList["svg:height"])
   {
@@ -486,7 +530,7 @@ void libvisio::VSDSVGGenerator::drawGraphicObject(const ::WPXPropertyList &propL
     m_outputSink << "\" ";
   }
   m_outputSink << "xlink:href=\"data:" << propList["libwpg:mime-type"]->getStr().cstr() << ";base64,";
-  m_outputSink << base64.cstr();
+  writeBase64(m_outputSink, binaryData);
   m_outputSink << "\" />\n";
 }
 
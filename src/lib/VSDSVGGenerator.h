@@ -37,11 +37,12 @@
 #include <libwpd/libwpd.h>
 #include <libwpg/libwpg.h>
 #include <libvisio/libvisio.h>
+#include "VSDPath.h"
 
 namespace libvisio
 {
 
-class VSDSVGGenerator : public libwpg::WPGPaintInterface
+class VSDSVGGenerator : public libwpg::WPGPaintInterface, public VSDPathPainter
 {
 public:
   VSDSVGGenerator(VSDStringVector &vec);
@@ -61,6 +62,7 @@ public:
   void drawPolyline(const ::WPXPropertyListVector &vertices);
   void drawPolygon(const ::WPXPropertyListVector &vertices);
   void drawPath(const ::WPXPropertyListVector &path);
+  void drawPath(const VSDPath &path);
   void drawGraphicObject(const ::WPXPropertyList &propList, const ::WPXBinaryData &binaryData);
   void startTextObject(const ::WPXPropertyList &propList, const ::WPXPropertyListVector &path);
   void endTextObject();
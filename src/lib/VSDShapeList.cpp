@@ -65,17 +65,20 @@ libvisio::VSDShapeList::~VSDShapeList()
 void libvisio::VSDShapeList::addShapeId(unsigned id, unsigned shapeId)
 {
   m_elements[id] = shapeId;
+  m_shapesOrder.clear();
 }
 
 void libvisio::VSDShapeList::addShapeId(unsigned shapeId)
 {
   m_elements[shapeId] = shapeId;
   m_elementsOrder.push_back(shapeId);
+  m_shapesOrder.clear();
 }
 
 void libvisio::VSDShapeList::setElementsOrder(const std::vector<unsigned> &elementsOrder)
 {
   m_elementsOrder = elementsOrder;
+  m_shapesOrder.clear();
 }
 
 const std::vector<unsigned> &libvisio::VSDShapeList::getShapesOrder()
@@ -0,0 +1,146 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* libvisio
+ * Version: MPL 1.1 / GPLv2+ / LGPLv2+
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License or as specified alternatively below. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * Major Contributor(s):
+ * Copyright (C) 2012 Fridrich Strba <fridrich.strba@bluewin.ch>
+ *
+ *
+ * All Rights Reserved.
+ *
+ * For minor contributions see the git repository.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPLv2+"), or
+ * the GNU Lesser General Public License Version 2 or later (the "LGPLv2+"),
+ * in which case the provisions of the GPLv2+ or the LGPLv2+ are applicable
+ * instead of those above.
+ */
+
+
+#include "VSDShapeTable.h"
+
+libvisio::VSDShapeTable::VSDShapeTable() :
+  m_indices(), m_shapeIds(), m_parents(), m_xforms(), m_hasXForm(), m_order(),
+  m_pageShapesOrder(), m_groupShapesOrders()
+{
+}
+
+void libvisio::VSDShapeTable::clear()
+{
+  m_indices.clear();
+  m_shapeIds.clear();
+  m_parents.clear();
+  m_xforms.clear();
+  m_hasXForm.clear();
+  m_order.clear();
+  m_pageShapesOrder.clear();
+  m_groupShapesOrders.clear();
+}
+
+void libvisio::VSDShapeTable::swap(VSDShapeTable &shapeTable)
+{
+  m_indices.swap(shapeTable.m_indices);
+  m_shapeIds.swap(shapeTable.m_shapeIds);
+  m_parents.swap(shapeTable.m_parents);
+  m_xforms.swap(shapeTable.m_xforms);
+  m_hasXForm.swap(shapeTable.m_hasXForm);
+  m_order.swap(shapeTable.m_order);
+  m_pageShapesOrder.swap(shapeTable.m_pageShapesOrder);
+  m_groupShapesOrders.swap(shapeTable.m_groupShapesOrders);
+}
+
+unsigned libvisio::VSDShapeTable::_addIndex(unsigned shapeId)
+{
+  std::map<unsigned, unsigned>::iterator iter = m_indices.lower_bound(shapeId);
+  if (iter != m_indices.end() && iter->first == shapeId)
+    return iter->second;
+  const unsigned index = (unsigned)m_shapeIds.size();
+  m_indices.insert(iter, std::make_pair(shapeId, index));
+  m_shapeIds.push_back(shapeId);
+  m_parents.push_back(MINUS_ONE);
+  m_xforms.push_back(XForm());
+  m_hasXForm.push_back(false);
+  return index;
+}
+
+// Until finish() is called, the parents are kept as shape ids.
+void libvisio::VSDShapeTable::addShape(unsigned shapeId, unsigned parentId)
+{
+  const unsigned index = _addIndex(shapeId);
+  if (parentId && parentId != MINUS_ONE)
+    m_parents[index] = parentId;
+}
+
+void libvisio::VSDShapeTable::setXForm(unsigned shapeId, const XForm &xform)
+{
+  const unsigned index = _addIndex(shapeId);
+  m_xforms[index] = xform;
+  m_hasXForm[index] = true;
+}
+
+void libvisio::VSDShapeTable::setShapesOrder(unsigned groupId, const std::list<unsigned> &shapeIds)
+{
+  m_groupShapesOrders[groupId] = shapeIds;
+}
+
+void libvisio::VSDShapeTable::setPageShapesOrder(const std::list<unsigned> &shapeIds)
+{
+  m_pageShapesOrder = shapeIds;
+}
+
+void libvisio::VSDShapeTable::finish()
+{
+  for (unsigned i = 0; i < m_parents.size(); ++i)
+  {
+    if (m_parents[i] != MINUS_ONE)
+    {
+      const unsigned parent = _addIndex(m_parents[i]);
+      m_parents[i] = parent;
+    }
+  }
+
+  // Expand the order of the page depth first, every group at most once,
+  // so that orders naming groups that are not on the page are dropped.
+  m_order.clear();
+  std::vector<std::list<unsigned> > pending(1);
+  pending.back().swap(m_pageShapesOrder);
+  while (!pending.empty())
+  {
+    if (pending.back().empty())
+    {
+      pending.pop_back();
+      continue;
+    }
+    const unsigned shapeId = pending.back().front();
+    pending.back().pop_front();
+    m_order.push_back(_addIndex(shapeId));
+    std::map<unsigned, std::list<unsigned> >::iterator iter = m_groupShapesOrders.find(shapeId);
+    if (iter != m_groupShapesOrders.end())
+    {
+      pending.push_back(std::list<unsigned>());
+      pending.back().swap(iter->second);
+      m_groupShapesOrders.erase(iter);
+    }
+  }
+  m_groupShapesOrders.clear();
+}
+
+unsigned libvisio::VSDShapeTable::getIndex(unsigned shapeId) const
+{
+  std::map<unsigned, unsigned>::const_iterator iter = m_indices.find(shapeId);
+  if (iter != m_indices.end())
+    return iter->second;
+  return MINUS_ONE;
+}
+/* vim:set shiftwidth=2 softtabstop=2 expandtab: */
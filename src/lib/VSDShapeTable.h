@@ -0,0 +1,100 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* libvisio
+ * Version: MPL 1.1 / GPLv2+ / LGPLv2+
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License or as specified alternatively below. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * Major Contributor(s):
+ * Copyright (C) 2012 Fridrich Strba <fridrich.strba@bluewin.ch>
+ *
+ *
+ * All Rights Reserved.
+ *
+ * For minor contributions see the git repository.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPLv2+"), or
+ * the GNU Lesser General Public License Version 2 or later (the "LGPLv2+"),
+ * in which case the provisions of the GPLv2+ or the LGPLv2+ are applicable
+ * instead of those above.
+ */
+
+
+#ifndef __VSDSHAPETABLE_H__
+#define __VSDSHAPETABLE_H__
+
+#include <vector>
+#include <map>
+#include <list>
+#include "VSDTypes.h"
+
+namespace libvisio
+{
+
+// The shapes of one page under dense local indices, from 0 up: their ids,
+// groups, xforms and z-order, in arrays. The styles pass fills it by shape
+// ids and calls finish() at the end of the page; the content pass then
+// looks every shape up once and works with its index.
+class VSDShapeTable
+{
+public:
+  VSDShapeTable();
+  void clear();
+  void swap(VSDShapeTable &shapeTable);
+
+  void addShape(unsigned shapeId, unsigned parentId);
+  void setXForm(unsigned shapeId, const XForm &xform);
+  void setShapesOrder(unsigned groupId, const std::list<unsigned> &shapeIds);
+  void setPageShapesOrder(const std::list<unsigned> &shapeIds);
+  void finish();
+
+  unsigned size() const
+  {
+    return (unsigned)m_shapeIds.size();
+  }
+  unsigned getIndex(unsigned shapeId) const;
+  unsigned getShapeId(unsigned index) const
+  {
+    return m_shapeIds[index];
+  }
+  // the index of the group of the shape or MINUS_ONE
+  unsigned getParent(unsigned index) const
+  {
+    return m_parents[index];
+  }
+  const XForm *getXForm(unsigned index) const
+  {
+    return m_hasXForm[index] ? &m_xforms[index] : 0;
+  }
+  // the indices of the shapes of the page in the order of drawing, the
+  // shapes of every group right after the group
+  const std::vector<unsigned> &getShapesOrder() const
+  {
+    return m_order;
+  }
+
+private:
+  unsigned _addIndex(unsigned shapeId);
+
+  std::map<unsigned, unsigned> m_indices;
+  std::vector<unsigned> m_shapeIds;
+  std::vector<unsigned> m_parents;
+  std::vector<XForm> m_xforms;
+  std::vector<bool> m_hasXForm;
+  std::vector<unsigned> m_order;
+  std::list<unsigned> m_pageShapesOrder;
+  std::map<unsigned, std::list<unsigned> > m_groupShapesOrders;
+};
+
+} // namespace libvisio
+
+#endif // __VSDSHAPETABLE_H__
+/* vim:set shiftwidth=2 softtabstop=2 expandtab: */
@@ -33,22 +33,15 @@
 #include "VSDStylesCollector.h"
 
 libvisio::VSDStylesCollector::VSDStylesCollector(
-  std::vector<std::map<unsigned, XForm> > &groupXFormsSequence,
-  std::vector<std::map<unsigned, unsigned> > &groupMembershipsSequence,
-  std::vector<std::list<unsigned> > &documentPageShapeOrders
+  std::vector<VSDShapeTable> &documentShapeTables
 ) :
   m_currentLevel(0), m_isShapeStarted(false),
   m_shadowOffsetX(0.0), m_shadowOffsetY(0.0),
-  m_currentShapeId(0), m_groupXForms(), m_groupMemberships(),
-  m_groupXFormsSequence(groupXFormsSequence),
-  m_groupMembershipsSequence(groupMembershipsSequence),
-  m_pageShapeOrder(), m_documentPageShapeOrders(documentPageShapeOrders),
-  m_groupShapeOrder(), m_shapeList(), m_currentStyleSheet(0), m_styles(),
+  m_currentShapeId(0), m_shapeTable(), m_documentShapeTables(documentShapeTables),
+  m_shapeList(), m_currentStyleSheet(0), m_styles(),
   m_currentShapeLevel(0)
 {
-  m_groupXFormsSequence.clear();
-  m_groupMembershipsSequence.clear();
-  m_documentPageShapeOrders.clear();
+  m_documentShapeTables.clear();
 }
 
 void libvisio::VSDStylesCollector::collectEllipticalArcTo(unsigned /* id */, unsigned level, double /* x3 */, double /* y3 */,
@@ -118,8 +111,8 @@ void libvisio::VSDStylesCollector::collectArcTo(unsigned /* id */, unsigned leve
 
 void libvisio::VSDStylesCollector::collectNURBSTo(unsigned /* id */, unsigned level, double /* x2 */, double /* y2 */,
     unsigned char /* xType */, unsigned char /* yType */, unsigned /* degree */,
-    std::vector<std::pair<double, double> > /* controlPoints */,
-    std::vector<double> /* knotVector */, std::vector<double> /* weights */)
+    const std::vector<std::pair<double, double> > & /* controlPoints */,
+    const std::vector<double> & /* knotVector */, const std::vector<double> & /* weights */)
 {
   _handleLevelChange(level);
 }
@@ -199,15 +192,26 @@ void libvisio::VSDStylesCollector::collectRelQuadBezTo(unsigned /* id */, unsign
 }
 
 void libvisio::VSDStylesCollector::collectShapeData(unsigned /* id */, unsigned level, unsigned char /* xType */, unsigned char /* yType */,
-    unsigned /* degree */, double /*lastKnot*/, std::vector<std::pair<double, double> > /* controlPoints */,
-    std::vector<double> /* knotVector */, std::vector<double> /* weights */)
+    unsigned /* degree */, double /*lastKnot*/, const std::vector<std::pair<double, double> > & /* controlPoints */,
+    const std::vector<double> & /* knotVector */, const std::vector<double> & /* weights */)
 {
   _handleLevelChange(level);
 }
 
 void libvisio::VSDStylesCollector::collectShapeData(unsigned /* id */, unsigned level, unsigned char /* xType */, unsigned char /* yType */,
-    std::vector<std::pair<double, double> > /* points */)
+    const std::vector<std::pair<double, double> > & /* points */)
+{
+  _handleLevelChange(level);
+}
+
+void libvisio::VSDStylesCollector::collectShapeGeometries(unsigned level, const std::map<unsigned, VSDGeometryList> & /* geometries */)
+{
+  _handleLevelChange(level);
+}
+
+void libvisio::VSDStylesCollector::collectGeometryList(unsigned level, const VSDGeometryList & /* geometryList */)
 {
+  // The rows carry nothing the styles pass needs
   _handleLevelChange(level);
 }
 
@@ -215,7 +219,7 @@ void libvisio::VSDStylesCollector::collectXFormData(unsigned level, const XForm
 {
   _handleLevelChange(level);
   if (m_isShapeStarted)
-    m_groupXForms[m_currentShapeId] = xform;
+    m_shapeTable.setXForm(m_currentShapeId, xform);
 }
 
 void libvisio::VSDStylesCollector::collectTxtXForm(unsigned level, const XForm & /* txtxform */)
@@ -256,8 +260,7 @@ void libvisio::VSDStylesCollector::collectShape(unsigned id, unsigned level, uns
   m_currentShapeLevel = level;
   m_currentShapeId = id;
   m_isShapeStarted = true;
-  if (parent && parent != MINUS_ONE)
-    m_groupMemberships[m_currentShapeId] = parent;
+  m_shapeTable.addShape(m_currentShapeId, parent);
 }
 
 void libvisio::VSDStylesCollector::collectMisc(unsigned level, const VSDMisc & /* misc */)
@@ -397,31 +400,15 @@ void libvisio::VSDStylesCollector::collectNumericField(unsigned /* id */, unsign
 
 void libvisio::VSDStylesCollector::startPage(unsigned /* pageId */)
 {
-  m_groupXForms.clear();
-  m_groupMemberships.clear();
-  m_pageShapeOrder.clear();
-  m_groupShapeOrder.clear();
+  m_shapeTable.clear();
 }
 
 void libvisio::VSDStylesCollector::endPage()
 {
   _handleLevelChange(0);
-  m_groupXFormsSequence.push_back(m_groupXForms);
-  m_groupMembershipsSequence.push_back(m_groupMemberships);
-
-  while (!m_groupShapeOrder.empty())
-  {
-    for (std::list<unsigned>::iterator j = m_pageShapeOrder.begin(); j != m_pageShapeOrder.end();)
-    {
-      std::map<unsigned, std::list<unsigned> >::iterator iter = m_groupShapeOrder.find(*j++);
-      if (m_groupShapeOrder.end() != iter)
-      {
-        m_pageShapeOrder.splice(j, iter->second, iter->second.begin(), iter->second.end());
-        m_groupShapeOrder.erase(iter);
-      }
-    }
-  }
-  m_documentPageShapeOrders.push_back(m_pageShapeOrder);
+  m_shapeTable.finish();
+  m_documentShapeTables.push_back(VSDShapeTable());
+  m_documentShapeTables.back().swap(m_shapeTable);
 }
 
 void libvisio::VSDStylesCollector::_handleLevelChange(unsigned level)
@@ -440,9 +427,9 @@ void libvisio::VSDStylesCollector::_flushShapeList()
     return;
 
   if (m_isShapeStarted)
-    m_groupShapeOrder[m_currentShapeId] = m_shapeList;
+    m_shapeTable.setShapesOrder(m_currentShapeId, m_shapeList);
   else
-    m_pageShapeOrder = m_shapeList;
+    m_shapeTable.setPageShapesOrder(m_shapeList);
 
   m_shapeList.clear();
 }
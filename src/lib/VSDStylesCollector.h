@@ -37,6 +37,7 @@
 #include "VSDCollector.h"
 #include "VSDParser.h"
 #include "libvisio_utils.h"
+#include "VSDShapeTable.h"
 #include "VSDStyles.h"
 
 namespace libvisio
@@ -45,11 +46,7 @@ namespace libvisio
 class VSDStylesCollector : public VSDCollector
 {
 public:
-  VSDStylesCollector(
-    std::vector<std::map<unsigned, XForm> > &groupXFormsSequence,
-    std::vector<std::map<unsigned, unsigned> > &groupMembershipsSequence,
-    std::vector<std::list<unsigned> > &documentPageShapeOrders
-  );
+  VSDStylesCollector(std::vector<VSDShapeTable> &documentShapeTables);
   virtual ~VSDStylesCollector() {}
 
   void collectEllipticalArcTo(unsigned id, unsigned level, double x3, double y3, double x2, double y2, double angle, double ecc);
@@ -76,16 +73,18 @@ public:
   void collectLineTo(unsigned id, unsigned level, double x, double y);
   void collectArcTo(unsigned id, unsigned level, double x2, double y2, double bow);
   void collectNURBSTo(unsigned id, unsigned level, double x2, double y2, unsigned char xType, unsigned char yType,
-                      unsigned degree, std::vector<std::pair<double, double> > controlPoints,
-                      std::vector<double> knotVector, std::vector<double> weights);
+                      unsigned degree, const std::vector<std::pair<double, double> > &controlPoints,
+                      const std::vector<double> &knotVector, const std::vector<double> &weights);
   void collectNURBSTo(unsigned id, unsigned level, double x2, double y2, double knot, double knotPrev, double weight, double weightPrev, unsigned dataID);
   void collectNURBSTo(unsigned id, unsigned level, double x2, double y2, double knot, double knotPrev, double weight, double weightPrev, const NURBSData &data);
   void collectPolylineTo(unsigned id, unsigned level, double x, double y, unsigned char xType, unsigned char yType, const std::vector<std::pair<double, double> > &points);
   void collectPolylineTo(unsigned id, unsigned level, double x, double y, unsigned dataID);
   void collectPolylineTo(unsigned id, unsigned level, double x, double y, const PolylineData &data);
   void collectShapeData(unsigned id, unsigned level, unsigned char xType, unsigned char yType, unsigned degree, double lastKnot,
-                        std::vector<std::pair<double, double> > controlPoints, std::vector<double> knotVector, std::vector<double> weights);
-  void collectShapeData(unsigned id, unsigned level, unsigned char xType, unsigned char yType, std::vector<std::pair<double, double> > points);
+                        const std::vector<std::pair<double, double> > &controlPoints, const std::vector<double> &knotVector, const std::vector<double> &weights);
+  void collectShapeData(unsigned id, unsigned level, unsigned char xType, unsigned char yType, const std::vector<std::pair<double, double> > &points);
+  void collectShapeGeometries(unsigned level, const std::map<unsigned, VSDGeometryList> &geometries);
+  void collectGeometryList(unsigned level, const VSDGeometryList &geometryList);
   void collectXFormData(unsigned level, const XForm &xform);
   void collectTxtXForm(unsigned level, const XForm &txtxform);
   void collectShapesOrder(unsigned id, unsigned level, const std::vector<unsigned> &shapeIds);
@@ -195,13 +194,8 @@ private:
   double m_shadowOffsetY;
 
   unsigned m_currentShapeId;
-  std::map<unsigned, XForm> m_groupXForms;
-  std::map<unsigned, unsigned> m_groupMemberships;
-  std::vector<std::map<unsigned, XForm> > &m_groupXFormsSequence;
-  std::vector<std::map<unsigned, unsigned> > &m_groupMembershipsSequence;
-  std::list<unsigned> m_pageShapeOrder;
-  std::vector<std::list<unsigned> > &m_documentPageShapeOrders;
-  std::map<unsigned, std::list<unsigned> > m_groupShapeOrder;
+  VSDShapeTable m_shapeTable;
+  std::vector<VSDShapeTable> &m_documentShapeTables;
   std::list<unsigned> m_shapeList;
 
   unsigned m_currentStyleSheet;
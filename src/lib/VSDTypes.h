@@ -31,6 +31,8 @@
 #ifndef VSDTYPES_H
 #define VSDTYPES_H
 
+#include <string.h>
+#include <list>
 #include <vector>
 #include <libwpd/libwpd.h>
 
@@ -62,6 +64,77 @@ struct XForm
 
 };
 
+// An affine transformation: x' = xx*x + xy*y + x0, y' = yx*x + yy*y + y0
+struct XFormMatrix
+{
+  double xx;
+  double xy;
+  double yx;
+  double yy;
+  double x0;
+  double y0;
+  XFormMatrix() : xx(1.0), xy(0.0), yx(0.0), yy(1.0), x0(0.0), y0(0.0) {}
+};
+
+// Identifies a NURBS row of a master shape, as drawn at a given size and
+// output scale. The numbers are compared by their bit patterns, which
+// orders all of them, NaNs included.
+struct CurveCacheKey
+{
+  CurveCacheKey()
+    : master(0), geometry(0), row(0), width(0.0), height(0.0), scale(0.0) {}
+  const void *master;
+  unsigned geometry;
+  unsigned row;
+  // the size of the shape, for co-ordinates given as percentages only
+  double width;
+  double height;
+  double scale;
+  bool operator<(const CurveCacheKey &key) const
+  {
+    if (master != key.master)
+      return master < key.master;
+    if (geometry != key.geometry)
+      return geometry < key.geometry;
+    if (row != key.row)
+      return row < key.row;
+    int cmp = memcmp(&width, &key.width, sizeof(double));
+    if (!cmp)
+      cmp = memcmp(&height, &key.height, sizeof(double));
+    if (!cmp)
+      cmp = memcmp(&scale, &key.scale, sizeof(double));
+    return cmp < 0;
+  }
+};
+
+// The points of a cached NURBS, in shape co-ordinates, with the data they
+// were computed from. Instances may override the cells of a master row,
+// so a row is only drawn from the cache when its data is still the same.
+struct CurveCacheEntry
+{
+  CurveCacheEntry()
+    : x2(0.0), y2(0.0), startX(0.0), startY(0.0), xType(0), yType(0), degree(0),
+      controlPoints(), knots(), weights(), points(), order() {}
+  double x2;
+  double y2;
+  double startX;
+  double startY;
+  unsigned char xType;
+  unsigned char yType;
+  unsigned degree;
+  std::vector<std::pair<double, double> > controlPoints;
+  std::vector<double> knots;
+  std::vector<double> weights;
+  std::vector<std::pair<double, double> > points;
+  // the position of the key in the order of use
+  std::list<CurveCacheKey>::iterator order;
+  // the number of doubles held
+  unsigned long size() const
+  {
+    return 2 * (controlPoints.size() + points.size()) + knots.size() + weights.size();
+  }
+};
+
 // Utilities
 struct ChunkHeader
 {
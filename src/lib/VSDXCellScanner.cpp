@@ -0,0 +1,313 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* libvisio
+ * Version: MPL 1.1 / GPLv2+ / LGPLv2+
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License or as specified alternatively below. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * Major Contributor(s):
+ * Copyright (C) 2012 Fridrich Strba <fridrich.strba@bluewin.ch>
+ *
+ *
+ * All Rights Reserved.
+ *
+ * For minor contributions see the git repository.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPLv2+"), or
+ * the GNU Lesser General Public License Version 2 or later (the "LGPLv2+"),
+ * in which case the provisions of the GPLv2+ or the LGPLv2+ are applicable
+ * instead of those above.
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <libxml/xmlstring.h>
+#include "VSDXCellScanner.h"
+#include "VSDXMLHelper.h"
+#include "VSDXMLTokenMap.h"
+
+namespace
+{
+
+// The longest cell name that is looked up; no token is that long
+#define VSD_MAX_CELL_NAME 64
+
+bool isBlank(unsigned char c)
+{
+  return ' ' == c || '\t' == c || '\n' == c || '\r' == c;
+}
+
+const unsigned char *skipBlanks(const unsigned char *p, const unsigned char *end)
+{
+  while (p < end && isBlank(*p))
+    ++p;
+  return p;
+}
+
+bool isBlankRange(const unsigned char *p, const unsigned char *end)
+{
+  return skipBlanks(p, end) == end;
+}
+
+bool startsWith(const unsigned char *p, const unsigned char *end, const char *s)
+{
+  const size_t length = strlen(s);
+  return (size_t)(end - p) >= length && !memcmp(p, s, length);
+}
+
+// Whether the XML declaration at the start of the part, if any, leaves the
+// part in UTF-8; p is moved past the declaration.
+bool checkDeclaration(const unsigned char *&p, const unsigned char *end)
+{
+  // UTF-8 byte order mark
+  if (startsWith(p, end, "\xef\xbb\xbf"))
+    p += 3;
+  if (!startsWith(p, end, "<?xml"))
+    return true;
+  const unsigned char *declEnd = p;
+  while (declEnd < end && !startsWith(declEnd, end, "?>"))
+    ++declEnd;
+  if (declEnd == end)
+    return false;
+  const unsigned char *q = p;
+  p = declEnd + 2;
+  for (; q < declEnd && !startsWith(q, declEnd, "encoding"); ++q)
+    ;
+  if (q == declEnd)
+    return true;
+  q = skipBlanks(q + 8, declEnd);
+  if (q == declEnd || '=' != *q)
+    return false;
+  q = skipBlanks(q + 1, declEnd);
+  if (q == declEnd || ('"' != *q && '\'' != *q))
+    return false;
+  const unsigned char quote = *q++;
+  const char *utf8 = "utf-8";
+  for (; *utf8; ++utf8, ++q)
+  {
+    if (q == declEnd || (*q | 0x20) != (unsigned char)*utf8)
+      return false;
+  }
+  return q < declEnd && quote == *q;
+}
+
+extern "C" {
+
+  static int vsdxCellScannerReadFunc(void *context, char *buffer, int len)
+  {
+    if (!context || !buffer || len < 0)
+      return -1;
+    return ((libvisio::VSDXCellScanner *)context)->read(buffer, len);
+  }
+
+} // extern "C"
+
+} // anonymous namespace
+
+libvisio::VSDXCellScanner::VSDXCellScanner()
+  : m_end(0), m_cells(), m_runs(), m_readPos(0), m_readRun(0), m_placeholder(), m_placeholderPos(0),
+    m_value(), m_cell(0), m_cellEnd(0)
+{
+}
+
+bool libvisio::VSDXCellScanner::scan(const unsigned char *data, unsigned long size)
+{
+  m_cells.clear();
+  m_runs.clear();
+  m_readPos = data;
+  m_readRun = 0;
+  m_placeholder.clear();
+  m_placeholderPos = 0;
+  m_cell = m_cellEnd = 0;
+
+  const unsigned char *const end = data + size;
+  m_end = end;
+  const unsigned char *p = data;
+  if (!checkDeclaration(p, end))
+    return false;
+
+  // the end of the last cell of the current run, if there is one
+  const unsigned char *runEnd = 0;
+  while (p < end)
+  {
+    // memchr is about the fastest search for one character there is
+    const unsigned char *tag = (const unsigned char *)memchr(p, '<', (size_t)(end - p));
+    if (!tag)
+      break;
+    if (tag + 1 < end && ('!' == tag[1] || '?' == tag[1]))
+      return false;
+    if (runEnd && !isBlankRange(runEnd, tag))
+      runEnd = 0;
+    const unsigned char *cellEnd = scanCell(tag, end);
+    if (cellEnd)
+    {
+      if (!runEnd)
+      {
+        Run run;
+        run.start = tag;
+        run.cell = m_cells.size() - 1;
+        m_runs.push_back(run);
+      }
+      m_runs.back().end = runEnd = p = cellEnd;
+      continue;
+    }
+    runEnd = 0;
+    // the placeholders must not be confused with anything in the part
+    if (startsWith(tag + 1, end, "CellRun"))
+      return false;
+    p = tag + 1;
+  }
+  return !m_cells.empty();
+}
+
+xmlTextReaderPtr libvisio::VSDXCellScanner::createReader(int options)
+{
+  return xmlReaderForCallback(vsdxCellScannerReadFunc, (void *)this, 0, 0, options);
+}
+
+int libvisio::VSDXCellScanner::read(char *buffer, int len)
+{
+  int numBytesRead = 0;
+  while (numBytesRead < len)
+  {
+    if (m_placeholderPos < m_placeholder.len())
+    {
+      const int length = std::min(len - numBytesRead, m_placeholder.len() - m_placeholderPos);
+      memcpy(buffer + numBytesRead, m_placeholder.cstr() + m_placeholderPos, length);
+      m_placeholderPos += length;
+      numBytesRead += length;
+      continue;
+    }
+    const unsigned char *next = m_readRun < m_runs.size() ? m_runs[m_readRun].start : m_end;
+    if (m_readPos == next)
+    {
+      if (m_readPos == m_end)
+        break;
+      m_placeholder.sprintf("<CellRun R=\"%lu\"/>", m_readRun);
+      m_placeholderPos = 0;
+      m_readPos = m_runs[m_readRun++].end;
+      continue;
+    }
+    const int length = (int)std::min((unsigned long)(len - numBytesRead), (unsigned long)(next - m_readPos));
+    memcpy(buffer + numBytesRead, m_readPos, length);
+    m_readPos += length;
+    numBytesRead += length;
+  }
+  return numBytesRead;
+}
+
+// Reads the plain cell at p; returns the end of it, or 0 if there is no
+// plain cell there.
+const unsigned char *libvisio::VSDXCellScanner::scanCell(const unsigned char *p, const unsigned char *end)
+{
+  if (!startsWith(p, end, "<Cell") || p + 5 == end || !isBlank(p[5]))
+    return 0;
+  p += 5;
+
+  xmlChar name[VSD_MAX_CELL_NAME];
+  bool hasName = false;
+  const unsigned char *value = 0;
+  const unsigned char *valueEnd = 0;
+  while (true)
+  {
+    p = skipBlanks(p, end);
+    if (p == end || '>' == *p)
+      return 0;
+    if ('/' == *p)
+      break;
+
+    const unsigned char *attribute = p;
+    while (p < end && '=' != *p && '/' != *p && '>' != *p && !isBlank(*p))
+      ++p;
+    const size_t attributeLength = (size_t)(p - attribute);
+    p = skipBlanks(p, end);
+    if (p == end || '=' != *p)
+      return 0;
+    p = skipBlanks(p + 1, end);
+    if (p == end || ('"' != *p && '\'' != *p))
+      return 0;
+    const unsigned char *first = p + 1;
+    const unsigned char *last = (const unsigned char *)memchr(first, *p, (size_t)(end - first));
+    if (!last)
+      return 0;
+    // references are expanded and blanks normalised by libxml2 alone
+    for (const unsigned char *q = first; q < last; ++q)
+    {
+      if ('&' == *q || '<' == *q || '\t' == *q || '\n' == *q || '\r' == *q)
+        return 0;
+    }
+    p = last + 1;
+    if (p < end && !isBlank(*p) && '/' != *p && '>' != *p)
+      return 0;
+
+    if (1 == attributeLength && 'N' == *attribute)
+    {
+      const size_t length = (size_t)(last - first);
+      if (length >= VSD_MAX_CELL_NAME)
+        return 0;
+      memcpy(name, first, length);
+      name[length] = 0;
+      hasName = true;
+    }
+    else if (1 == attributeLength && 'V' == *attribute)
+    {
+      value = first;
+      valueEnd = last;
+    }
+  }
+  if (!hasName || !startsWith(p, end, "/>"))
+    return 0;
+
+  Cell cell;
+  cell.tokenId = VSDXMLTokenMap::getTokenId(name);
+  cell.value = value;
+  cell.valueLength = (unsigned long)(valueEnd - value);
+  m_cells.push_back(cell);
+  return p + 2;
+}
+
+bool libvisio::VSDXCellScanner::startRun(xmlTextReaderPtr reader)
+{
+  if (XML_READER_TYPE_ELEMENT != xmlTextReaderNodeType(reader)
+      || !xmlStrEqual(xmlTextReaderConstName(reader), BAD_CAST("CellRun")))
+    return false;
+  const xmlChar *index = getConstAttribute(reader, "R");
+  if (!index)
+    return false;
+  const unsigned long run = (unsigned long)xmlStringToLong(index);
+  if (run >= m_runs.size())
+    return false;
+  m_cell = m_runs[run].cell;
+  m_cellEnd = run + 1 < m_runs.size() ? m_runs[run + 1].cell : m_cells.size();
+  return true;
+}
+
+bool libvisio::VSDXCellScanner::nextCell()
+{
+  if (!isInRun())
+    return false;
+  if (++m_cell < m_cellEnd)
+    return true;
+  m_cell = m_cellEnd = 0;
+  return false;
+}
+
+const xmlChar *libvisio::VSDXCellScanner::getValue()
+{
+  const Cell &cell = m_cells[m_cell];
+  if (!cell.value)
+    return 0;
+  m_value.assign(cell.value, cell.value + cell.valueLength);
+  m_value.push_back(0);
+  return &m_value[0];
+}
+
+/* vim:set shiftwidth=2 softtabstop=2 expandtab: */
@@ -0,0 +1,118 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* libvisio
+ * Version: MPL 1.1 / GPLv2+ / LGPLv2+
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License or as specified alternatively below. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * Major Contributor(s):
+ * Copyright (C) 2012 Fridrich Strba <fridrich.strba@bluewin.ch>
+ *
+ *
+ * All Rights Reserved.
+ *
+ * For minor contributions see the git repository.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPLv2+"), or
+ * the GNU Lesser General Public License Version 2 or later (the "LGPLv2+"),
+ * in which case the provisions of the GPLv2+ or the LGPLv2+ are applicable
+ * instead of those above.
+ */
+
+#ifndef __VSDXCELLSCANNER_H__
+#define __VSDXCELLSCANNER_H__
+
+#include <vector>
+#include <libwpd/libwpd.h>
+#include <libxml/xmlreader.h>
+
+namespace libvisio
+{
+
+// Reads the plain cells of a VSDX part without libxml2. A cell is plain
+// when it is an empty Cell element with an N attribute, and no attribute
+// value holds a reference or a character that libxml2 would normalise.
+// The part is scanned where it is. libxml2 reads it through the scanner,
+// which hands it out with one <CellRun R="index"/> element in place of
+// each run of plain cells; when the reader gets to that element, the
+// cells of the run are taken from here instead.
+class VSDXCellScanner
+{
+public:
+  VSDXCellScanner();
+
+  // false if the part has no plain cells, or has anything the scanner does
+  // not handle: a document type, comments, CDATA sections, processing
+  // instructions or an encoding other than UTF-8. Such a part is read by
+  // libxml2 as it is. The part must outlive the reader.
+  bool scan(const unsigned char *data, unsigned long size);
+  // A reader of the scanned part, to be freed with xmlFreeTextReader
+  xmlTextReaderPtr createReader(int options);
+  // Copies up to len bytes of the rest of the part, as libxml2 reads it,
+  // to buffer; 0 at the end of the part
+  int read(char *buffer, int len);
+
+  // Starts the run of the placeholder the reader is on, if it is on one
+  bool startRun(xmlTextReaderPtr reader);
+  // Goes to the next cell of the current run; false at the end of it
+  bool nextCell();
+  bool isInRun() const
+  {
+    return m_cell < m_cellEnd;
+  }
+  // The token of the N attribute and the V attribute of the current cell
+  int getTokenId() const
+  {
+    return m_cells[m_cell].tokenId;
+  }
+  const xmlChar *getValue();
+
+private:
+  VSDXCellScanner(const VSDXCellScanner &);
+  VSDXCellScanner &operator=(const VSDXCellScanner &);
+
+  const unsigned char *scanCell(const unsigned char *p, const unsigned char *end);
+
+  struct Cell
+  {
+    int tokenId;
+    // the V attribute in the part, or 0 if there is none
+    const unsigned char *value;
+    unsigned long valueLength;
+  };
+
+  struct Run
+  {
+    // where the cells of the run are in the part
+    const unsigned char *start;
+    const unsigned char *end;
+    // index of the first cell of the run
+    unsigned long cell;
+  };
+
+  const unsigned char *m_end;
+  std::vector<Cell> m_cells;
+  std::vector<Run> m_runs;
+  // what is left of the part to read, and of the last placeholder
+  const unsigned char *m_readPos;
+  unsigned long m_readRun;
+  WPXString m_placeholder;
+  int m_placeholderPos;
+  // the value of the current cell, with a terminating zero
+  std::vector<xmlChar> m_value;
+  unsigned long m_cell;
+  unsigned long m_cellEnd;
+};
+
+} // namespace libvisio
+
+#endif // __VSDXCELLSCANNER_H__
+/* vim:set shiftwidth=2 softtabstop=2 expandtab: */
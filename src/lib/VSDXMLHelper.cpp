@@ -28,16 +28,17 @@
  */
 
 #include <string.h>
-#include <errno.h>
 #include <limits.h>
 #include <sstream>
 #include <istream>
+#include <locale>
 #include <vector>
 #include <boost/algorithm/string.hpp>
 #include <libxml/xmlIO.h>
 #include <libxml/xmlstring.h>
 #include <libwpd-stream/libwpd-stream.h>
 #include "VSDXMLHelper.h"
+#include "VSDInternalStream.h"
 #include "libvisio_utils.h"
 
 
@@ -96,100 +97,564 @@ extern "C" {
 
 } // extern "C"
 
-} // anonymous namespace
+static std::string getTargetBaseDirectory(const char *target)
+{
+  std::string str(target);
+  std::string::size_type position = str.find_last_of('/');
+  if (position == std::string::npos)
+    position = 0;
+  str.erase(position ? position+1 : position);
+  return str;
+}
 
-// xmlTextReader helper function
+static std::string getRelationshipsForTarget(const char *target)
+{
+  std::string relStr(target ? target : "");
+  std::string::size_type position = relStr.find_last_of('/');
+  if (position == std::string::npos)
+    position = 0;
+  relStr.insert(position ? position+1 : position, "_rels/");
+  relStr.append(".rels");
+  return relStr;
+}
 
-xmlTextReaderPtr libvisio::xmlReaderForStream(WPXInputStream *input, const char *URL, const char *encoding, int options)
+static libvisio::VSDXRelationshipType getRelationshipTypeId(const std::string &type)
 {
-  xmlTextReaderPtr reader = xmlReaderForIO(vsdxInputReadFunc, vsdxInputCloseFunc, (void *)input, URL, encoding, options);
-  xmlTextReaderSetErrorHandler(reader, vsdxReaderErrorFunc, 0);
-  return reader;
+  static const char visioPrefix[] = "http://schemas.microsoft.com/visio/2010/relationships/";
+  static const char officePrefix[] = "http://schemas.openxmlformats.org/officeDocument/2006/relationships/";
+
+  if (!type.compare(0, sizeof(visioPrefix) - 1, visioPrefix))
+  {
+    const char *name = type.c_str() + sizeof(visioPrefix) - 1;
+    if (!strcmp(name, "document"))
+      return libvisio::VSDX_REL_DOCUMENT;
+    if (!strcmp(name, "masters"))
+      return libvisio::VSDX_REL_MASTERS;
+    if (!strcmp(name, "master"))
+      return libvisio::VSDX_REL_MASTER;
+    if (!strcmp(name, "pages"))
+      return libvisio::VSDX_REL_PAGES;
+    if (!strcmp(name, "page"))
+      return libvisio::VSDX_REL_PAGE;
+  }
+  else if (!type.compare(0, sizeof(officePrefix) - 1, officePrefix))
+  {
+    const char *name = type.c_str() + sizeof(officePrefix) - 1;
+    if (!strcmp(name, "theme"))
+      return libvisio::VSDX_REL_THEME;
+    if (!strcmp(name, "image"))
+      return libvisio::VSDX_REL_IMAGE;
+    if (!strcmp(name, "oleObject"))
+      return libvisio::VSDX_REL_OLE_OBJECT;
+  }
+  return libvisio::VSDX_REL_UNKNOWN;
 }
 
-libvisio::Colour libvisio::xmlStringToColour(const xmlChar *s)
+
+// Numeric values are parsed straight from the attribute or element text,
+// always with '.' as the decimal point, whatever the locale of the process.
+
+static bool isXmlSpace(xmlChar c)
 {
-  if (xmlStrEqual(s, BAD_CAST("Themed")))
-    return libvisio::Colour();
-  std::string str((const char *)s);
-  if (str[0] == '#')
+  return ' ' == c || '\t' == c || '\n' == c || '\r' == c || '\f' == c || '\v' == c;
+}
+
+static int hexDigitValue(xmlChar c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// Powers of ten that a double represents exactly
+static const double exactPowersOfTen[] =
+{
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define VSD_MAX_EXACT_POWER_OF_TEN 22
+#define VSD_MAX_EXACT_MANTISSA (((uint64_t)1) << 53)
+#define VSD_MAX_MANTISSA_DIGITS 19
+
+// 5^q for q in [VSD_MIN_POWER_OF_FIVE, VSD_MAX_POWER_OF_FIVE], normalized and
+// truncated to 128 bits, most significant 32-bit word first
+#define VSD_MIN_POWER_OF_FIVE -64
+#define VSD_MAX_POWER_OF_FIVE 64
+static const uint32_t powersOfFive[][4] =
+{
+  { 0xa87fea27, 0xa539e9a5, 0x3f2398d7, 0x47b36224 }, // 5^-64
+  { 0xd29fe4b1, 0x8e88640e, 0x8eec7f0d, 0x19a03aad }, // 5^-63
+  { 0x83a3eeee, 0xf9153e89, 0x1953cf68, 0x300424ac }, // 5^-62
+  { 0xa48ceaaa, 0xb75a8e2b, 0x5fa8c342, 0x3c052dd7 }, // 5^-61
+  { 0xcdb02555, 0x653131b6, 0x3792f412, 0xcb06794d }, // 5^-60
+  { 0x808e1755, 0x5f3ebf11, 0xe2bbd88b, 0xbee40bd0 }, // 5^-59
+  { 0xa0b19d2a, 0xb70e6ed6, 0x5b6aceae, 0xae9d0ec4 }, // 5^-58
+  { 0xc8de0475, 0x64d20a8b, 0xf245825a, 0x5a445275 }, // 5^-57
+  { 0xfb158592, 0xbe068d2e, 0xeed6e2f0, 0xf0d56712 }, // 5^-56
+  { 0x9ced737b, 0xb6c4183d, 0x55464dd6, 0x9685606b }, // 5^-55
+  { 0xc428d05a, 0xa4751e4c, 0xaa97e14c, 0x3c26b886 }, // 5^-54
+  { 0xf5330471, 0x4d9265df, 0xd53dd99f, 0x4b3066a8 }, // 5^-53
+  { 0x993fe2c6, 0xd07b7fab, 0xe546a803, 0x8efe4029 }, // 5^-52
+  { 0xbf8fdb78, 0x849a5f96, 0xde985204, 0x72bdd033 }, // 5^-51
+  { 0xef73d256, 0xa5c0f77c, 0x963e6685, 0x8f6d4440 }, // 5^-50
+  { 0x95a86376, 0x27989aad, 0xdde70013, 0x79a44aa8 }, // 5^-49
+  { 0xbb127c53, 0xb17ec159, 0x5560c018, 0x580d5d52 }, // 5^-48
+  { 0xe9d71b68, 0x9dde71af, 0xaab8f01e, 0x6e10b4a6 }, // 5^-47
+  { 0x92267121, 0x62ab070d, 0xcab39613, 0x04ca70e8 }, // 5^-46
+  { 0xb6b00d69, 0xbb55c8d1, 0x3d607b97, 0xc5fd0d22 }, // 5^-45
+  { 0xe45c10c4, 0x2a2b3b05, 0x8cb89a7d, 0xb77c506a }, // 5^-44
+  { 0x8eb98a7a, 0x9a5b04e3, 0x77f3608e, 0x92adb242 }, // 5^-43
+  { 0xb267ed19, 0x40f1c61c, 0x55f038b2, 0x37591ed3 }, // 5^-42
+  { 0xdf01e85f, 0x912e37a3, 0x6b6c46de, 0xc52f6688 }, // 5^-41
+  { 0x8b61313b, 0xbabce2c6, 0x2323ac4b, 0x3b3da015 }, // 5^-40
+  { 0xae397d8a, 0xa96c1b77, 0xabec975e, 0x0a0d081a }, // 5^-39
+  { 0xd9c7dced, 0x53c72255, 0x96e7bd35, 0x8c904a21 }, // 5^-38
+  { 0x881cea14, 0x545c7575, 0x7e50d641, 0x77da2e54 }, // 5^-37
+  { 0xaa242499, 0x697392d2, 0xdde50bd1, 0xd5d0b9e9 }, // 5^-36
+  { 0xd4ad2dbf, 0xc3d07787, 0x955e4ec6, 0x4b44e864 }, // 5^-35
+  { 0x84ec3c97, 0xda624ab4, 0xbd5af13b, 0xef0b113e }, // 5^-34
+  { 0xa6274bbd, 0xd0fadd61, 0xecb1ad8a, 0xeacdd58e }, // 5^-33
+  { 0xcfb11ead, 0x453994ba, 0x67de18ed, 0xa5814af2 }, // 5^-32
+  { 0x81ceb32c, 0x4b43fcf4, 0x80eacf94, 0x8770ced7 }, // 5^-31
+  { 0xa2425ff7, 0x5e14fc31, 0xa1258379, 0xa94d028d }, // 5^-30
+  { 0xcad2f7f5, 0x359a3b3e, 0x096ee458, 0x13a04330 }, // 5^-29
+  { 0xfd87b5f2, 0x8300ca0d, 0x8bca9d6e, 0x188853fc }, // 5^-28
+  { 0x9e74d1b7, 0x91e07e48, 0x775ea264, 0xcf55347e }, // 5^-27
+  { 0xc6120625, 0x76589dda, 0x95364afe, 0x032a819e }, // 5^-26
+  { 0xf79687ae, 0xd3eec551, 0x3a83ddbd, 0x83f52205 }, // 5^-25
+  { 0x9abe14cd, 0x44753b52, 0xc4926a96, 0x72793543 }, // 5^-24
+  { 0xc16d9a00, 0x95928a27, 0x75b7053c, 0x0f178294 }, // 5^-23
+  { 0xf1c90080, 0xbaf72cb1, 0x5324c68b, 0x12dd6339 }, // 5^-22
+  { 0x971da050, 0x74da7bee, 0xd3f6fc16, 0xebca5e04 }, // 5^-21
+  { 0xbce50864, 0x92111aea, 0x88f4bb1c, 0xa6bcf585 }, // 5^-20
+  { 0xec1e4a7d, 0xb69561a5, 0x2b31e9e3, 0xd06c32e6 }, // 5^-19
+  { 0x9392ee8e, 0x921d5d07, 0x3aff322e, 0x62439fd0 }, // 5^-18
+  { 0xb877aa32, 0x36a4b449, 0x09befeb9, 0xfad487c3 }, // 5^-17
+  { 0xe69594be, 0xc44de15b, 0x4c2ebe68, 0x7989a9b4 }, // 5^-16
+  { 0x901d7cf7, 0x3ab0acd9, 0x0f9d3701, 0x4bf60a11 }, // 5^-15
+  { 0xb424dc35, 0x095cd80f, 0x538484c1, 0x9ef38c95 }, // 5^-14
+  { 0xe12e1342, 0x4bb40e13, 0x2865a5f2, 0x06b06fba }, // 5^-13
+  { 0x8cbccc09, 0x6f5088cb, 0xf93f87b7, 0x442e45d4 }, // 5^-12
+  { 0xafebff0b, 0xcb24aafe, 0xf78f69a5, 0x1539d749 }, // 5^-11
+  { 0xdbe6fece, 0xbdedd5be, 0xb573440e, 0x5a884d1c }, // 5^-10
+  { 0x89705f41, 0x36b4a597, 0x31680a88, 0xf8953031 }, // 5^-9
+  { 0xabcc7711, 0x8461cefc, 0xfdc20d2b, 0x36ba7c3e }, // 5^-8
+  { 0xd6bf94d5, 0xe57a42bc, 0x3d329076, 0x04691b4d }, // 5^-7
+  { 0x8637bd05, 0xaf6c69b5, 0xa63f9a49, 0xc2c1b110 }, // 5^-6
+  { 0xa7c5ac47, 0x1b478423, 0x0fcf80dc, 0x33721d54 }, // 5^-5
+  { 0xd1b71758, 0xe219652b, 0xd3c36113, 0x404ea4a9 }, // 5^-4
+  { 0x83126e97, 0x8d4fdf3b, 0x645a1cac, 0x083126ea }, // 5^-3
+  { 0xa3d70a3d, 0x70a3d70a, 0x3d70a3d7, 0x0a3d70a4 }, // 5^-2
+  { 0xcccccccc, 0xcccccccc, 0xcccccccc, 0xcccccccd }, // 5^-1
+  { 0x80000000, 0x00000000, 0x00000000, 0x00000000 }, // 5^0
+  { 0xa0000000, 0x00000000, 0x00000000, 0x00000000 }, // 5^1
+  { 0xc8000000, 0x00000000, 0x00000000, 0x00000000 }, // 5^2
+  { 0xfa000000, 0x00000000, 0x00000000, 0x00000000 }, // 5^3
+  { 0x9c400000, 0x00000000, 0x00000000, 0x00000000 }, // 5^4
+  { 0xc3500000, 0x00000000, 0x00000000, 0x00000000 }, // 5^5
+  { 0xf4240000, 0x00000000, 0x00000000, 0x00000000 }, // 5^6
+  { 0x98968000, 0x00000000, 0x00000000, 0x00000000 }, // 5^7
+  { 0xbebc2000, 0x00000000, 0x00000000, 0x00000000 }, // 5^8
+  { 0xee6b2800, 0x00000000, 0x00000000, 0x00000000 }, // 5^9
+  { 0x9502f900, 0x00000000, 0x00000000, 0x00000000 }, // 5^10
+  { 0xba43b740, 0x00000000, 0x00000000, 0x00000000 }, // 5^11
+  { 0xe8d4a510, 0x00000000, 0x00000000, 0x00000000 }, // 5^12
+  { 0x9184e72a, 0x00000000, 0x00000000, 0x00000000 }, // 5^13
+  { 0xb5e620f4, 0x80000000, 0x00000000, 0x00000000 }, // 5^14
+  { 0xe35fa931, 0xa0000000, 0x00000000, 0x00000000 }, // 5^15
+  { 0x8e1bc9bf, 0x04000000, 0x00000000, 0x00000000 }, // 5^16
+  { 0xb1a2bc2e, 0xc5000000, 0x00000000, 0x00000000 }, // 5^17
+  { 0xde0b6b3a, 0x76400000, 0x00000000, 0x00000000 }, // 5^18
+  { 0x8ac72304, 0x89e80000, 0x00000000, 0x00000000 }, // 5^19
+  { 0xad78ebc5, 0xac620000, 0x00000000, 0x00000000 }, // 5^20
+  { 0xd8d726b7, 0x177a8000, 0x00000000, 0x00000000 }, // 5^21
+  { 0x87867832, 0x6eac9000, 0x00000000, 0x00000000 }, // 5^22
+  { 0xa968163f, 0x0a57b400, 0x00000000, 0x00000000 }, // 5^23
+  { 0xd3c21bce, 0xcceda100, 0x00000000, 0x00000000 }, // 5^24
+  { 0x84595161, 0x401484a0, 0x00000000, 0x00000000 }, // 5^25
+  { 0xa56fa5b9, 0x9019a5c8, 0x00000000, 0x00000000 }, // 5^26
+  { 0xcecb8f27, 0xf4200f3a, 0x00000000, 0x00000000 }, // 5^27
+  { 0x813f3978, 0xf8940984, 0x40000000, 0x00000000 }, // 5^28
+  { 0xa18f07d7, 0x36b90be5, 0x50000000, 0x00000000 }, // 5^29
+  { 0xc9f2c9cd, 0x04674ede, 0xa4000000, 0x00000000 }, // 5^30
+  { 0xfc6f7c40, 0x45812296, 0x4d000000, 0x00000000 }, // 5^31
+  { 0x9dc5ada8, 0x2b70b59d, 0xf0200000, 0x00000000 }, // 5^32
+  { 0xc5371912, 0x364ce305, 0x6c280000, 0x00000000 }, // 5^33
+  { 0xf684df56, 0xc3e01bc6, 0xc7320000, 0x00000000 }, // 5^34
+  { 0x9a130b96, 0x3a6c115c, 0x3c7f4000, 0x00000000 }, // 5^35
+  { 0xc097ce7b, 0xc90715b3, 0x4b9f1000, 0x00000000 }, // 5^36
+  { 0xf0bdc21a, 0xbb48db20, 0x1e86d400, 0x00000000 }, // 5^37
+  { 0x96769950, 0xb50d88f4, 0x13144480, 0x00000000 }, // 5^38
+  { 0xbc143fa4, 0xe250eb31, 0x17d955a0, 0x00000000 }, // 5^39
+  { 0xeb194f8e, 0x1ae525fd, 0x5dcfab08, 0x00000000 }, // 5^40
+  { 0x92efd1b8, 0xd0cf37be, 0x5aa1cae5, 0x00000000 }, // 5^41
+  { 0xb7abc627, 0x050305ad, 0xf14a3d9e, 0x40000000 }, // 5^42
+  { 0xe596b7b0, 0xc643c719, 0x6d9ccd05, 0xd0000000 }, // 5^43
+  { 0x8f7e32ce, 0x7bea5c6f, 0xe4820023, 0xa2000000 }, // 5^44
+  { 0xb35dbf82, 0x1ae4f38b, 0xdda2802c, 0x8a800000 }, // 5^45
+  { 0xe0352f62, 0xa19e306e, 0xd50b2037, 0xad200000 }, // 5^46
+  { 0x8c213d9d, 0xa502de45, 0x4526f422, 0xcc340000 }, // 5^47
+  { 0xaf298d05, 0x0e4395d6, 0x9670b12b, 0x7f410000 }, // 5^48
+  { 0xdaf3f046, 0x51d47b4c, 0x3c0cdd76, 0x5f114000 }, // 5^49
+  { 0x88d8762b, 0xf324cd0f, 0xa5880a69, 0xfb6ac800 }, // 5^50
+  { 0xab0e93b6, 0xefee0053, 0x8eea0d04, 0x7a457a00 }, // 5^51
+  { 0xd5d238a4, 0xabe98068, 0x72a49045, 0x98d6d880 }, // 5^52
+  { 0x85a36366, 0xeb71f041, 0x47a6da2b, 0x7f864750 }, // 5^53
+  { 0xa70c3c40, 0xa64e6c51, 0x999090b6, 0x5f67d924 }, // 5^54
+  { 0xd0cf4b50, 0xcfe20765, 0xfff4b4e3, 0xf741cf6d }, // 5^55
+  { 0x82818f12, 0x81ed449f, 0xbff8f10e, 0x7a8921a4 }, // 5^56
+  { 0xa321f2d7, 0x226895c7, 0xaff72d52, 0x192b6a0d }, // 5^57
+  { 0xcbea6f8c, 0xeb02bb39, 0x9bf4f8a6, 0x9f764490 }, // 5^58
+  { 0xfee50b70, 0x25c36a08, 0x02f236d0, 0x4753d5b4 }, // 5^59
+  { 0x9f4f2726, 0x179a2245, 0x01d76242, 0x2c946590 }, // 5^60
+  { 0xc722f0ef, 0x9d80aad6, 0x424d3ad2, 0xb7b97ef5 }, // 5^61
+  { 0xf8ebad2b, 0x84e0d58b, 0xd2e08987, 0x65a7deb2 }, // 5^62
+  { 0x9b934c3b, 0x330c8577, 0x63cc55f4, 0x9f88eb2f }, // 5^63
+  { 0xc2781f49, 0xffcfa6d5, 0x3cbf6b71, 0xc76b25fb }  // 5^64
+};
+
+static uint64_t getPowerOfFiveWord(int q, unsigned word)
+{
+  const uint32_t *p = powersOfFive[q - VSD_MIN_POWER_OF_FIVE] + 2 * word;
+  return ((uint64_t)p[0] << 32) | p[1];
+}
+
+static void multiply(uint64_t a, uint64_t b, uint64_t &high, uint64_t &low)
+{
+  const uint64_t aLow = a & 0xffffffff;
+  const uint64_t aHigh = a >> 32;
+  const uint64_t bLow = b & 0xffffffff;
+  const uint64_t bHigh = b >> 32;
+  const uint64_t ll = aLow * bLow;
+  const uint64_t lh = aLow * bHigh;
+  const uint64_t hl = aHigh * bLow;
+  const uint64_t hh = aHigh * bHigh;
+  const uint64_t middle = (ll >> 32) + (lh & 0xffffffff) + (hl & 0xffffffff);
+  low = (middle << 32) | (ll & 0xffffffff);
+  high = hh + (lh >> 32) + (hl >> 32) + (middle >> 32);
+}
+
+// Computes the double nearest to mantissa * 10^exponent with the algorithm
+// of Eisel and Lemire (Lemire, "Number Parsing at a Gigabyte per Second").
+// The mantissa must be exact and non-zero.
+static bool computeDouble(uint64_t mantissa, int exponent, double &value)
+{
+  if (exponent < VSD_MIN_POWER_OF_FIVE || exponent > VSD_MAX_POWER_OF_FIVE || !mantissa)
+    return false;
+
+  int leadingZeros = 0;
+  while (!(mantissa & (((uint64_t)1) << 63)))
+  {
+    mantissa <<= 1;
+    ++leadingZeros;
+  }
+
+  uint64_t high = 0;
+  uint64_t low = 0;
+  multiply(mantissa, getPowerOfFiveWord(exponent, 0), high, low);
+  if (0x1ff == (high & 0x1ff))
+  {
+    uint64_t secondHigh = 0;
+    uint64_t secondLow = 0;
+    multiply(mantissa, getPowerOfFiveWord(exponent, 1), secondHigh, secondLow);
+    low += secondHigh;
+    if (secondHigh > low)
+      ++high;
+  }
+
+  const int upperBit = (int)(high >> 63);
+  const int shift = upperBit + 9;
+  uint64_t bits = high >> shift;
+  int power2 = (((152170 + 65536) * exponent) >> 16) + 63 + upperBit - leadingZeros + 1023;
+  if (power2 <= 0)
+    return false;
+
+  // exactly half-way between two doubles: round to even
+  if (low <= 1 && exponent >= -4 && exponent <= 23 && 1 == (bits & 3) && (bits << shift) == high)
+    bits &= ~((uint64_t)1);
+  bits += bits & 1;
+  bits >>= 1;
+  if (bits >= ((uint64_t)2) << 52)
   {
-    if (str.length() != 7)
+    bits = ((uint64_t)1) << 52;
+    ++power2;
+  }
+  bits &= ~(((uint64_t)1) << 52);
+  if (power2 >= 0x7ff)
+    return false;
+
+  union
+  {
+    uint64_t u;
+    double d;
+  } tmpUnion;
+  tmpUnion.u = bits | ((uint64_t)power2 << 52);
+  value = tmpUnion.d;
+  return true;
+}
+
+// Reads a decimal floating point number in the syntax of the "C" locale
+// and advances p past it. When both the digits and the power of ten are
+// exactly representable, one multiplication or division gives the correctly
+// rounded result; most other numbers are handled by computeDouble. The rare
+// numbers with more than 19 significant digits or a huge exponent are left
+// to the classic locale of the standard library.
+static bool scanDouble(const xmlChar *&p, double &value)
+{
+  while (isXmlSpace(*p))
+    ++p;
+  const xmlChar *const start = p;
+
+  bool negative = false;
+  if ('-' == *p || '+' == *p)
+    negative = ('-' == *p++);
+
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool hasDigits = false;
+  bool isExact = true;
+
+  for (; *p >= '0' && *p <= '9'; ++p)
+  {
+    hasDigits = true;
+    if (digits < VSD_MAX_MANTISSA_DIGITS)
     {
-      VSD_DEBUG_MSG(("Throwing XmlParserException\n"));
-      throw XmlParserException();
+      mantissa = mantissa * 10 + (*p - '0');
+      if (mantissa)
+        ++digits;
     }
     else
-      str.erase(str.begin());
+    {
+      ++exponent;
+      isExact = false;
+    }
   }
-  else
+  if ('.' == *p)
   {
-    VSD_DEBUG_MSG(("Throwing XmlParserException\n"));
-    throw XmlParserException();
+    for (++p; *p >= '0' && *p <= '9'; ++p)
+    {
+      hasDigits = true;
+      if (digits < VSD_MAX_MANTISSA_DIGITS)
+      {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa)
+          ++digits;
+        --exponent;
+      }
+      else
+        isExact = false;
+    }
   }
+  if (!hasDigits)
+    return false;
 
-  std::istringstream istr(str);
-  unsigned val = 0;
-  istr >> std::hex >> val;
+  // an exponent without digits is not a part of the number
+  const xmlChar *q = p;
+  if ('e' == *q || 'E' == *q)
+  {
+    ++q;
+    bool negativeExponent = false;
+    if ('-' == *q || '+' == *q)
+      negativeExponent = ('-' == *q++);
+    if (*q >= '0' && *q <= '9')
+    {
+      int explicitExponent = 0;
+      for (; *q >= '0' && *q <= '9'; ++q)
+      {
+        if (explicitExponent < 100000)
+          explicitExponent = explicitExponent * 10 + (*q - '0');
+      }
+      exponent += negativeExponent ? -explicitExponent : explicitExponent;
+      p = q;
+    }
+  }
 
-  return Colour((val & 0xff0000) >> 16, (val & 0xff00) >> 8, val & 0xff, 0);
+  if (!mantissa)
+    value = 0.0;
+  else if (isExact && mantissa <= VSD_MAX_EXACT_MANTISSA
+           && exponent >= -VSD_MAX_EXACT_POWER_OF_TEN && exponent <= VSD_MAX_EXACT_POWER_OF_TEN)
+  {
+    value = (double)mantissa;
+    if (exponent < 0)
+      value /= exactPowersOfTen[-exponent];
+    else
+      value *= exactPowersOfTen[exponent];
+  }
+  else if (!isExact || !computeDouble(mantissa, exponent, value))
+  {
+    std::istringstream istr(std::string((const char *)start, (const char *)p));
+    istr.imbue(std::locale::classic());
+    istr >> value;
+    return !istr.fail();
+  }
+
+  if (negative)
+    value = -value;
+  return true;
 }
 
-long libvisio::xmlStringToLong(const xmlChar *s)
+static bool parseDouble(const xmlChar *s, double &value)
 {
-  if (xmlStrEqual(s, BAD_CAST("Themed")))
-    return 0;
+  const xmlChar *p = s;
+  double tmpValue = 0.0;
+  if (!scanDouble(p, tmpValue) || *p)
+    return false;
+  value = tmpValue;
+  return true;
+}
 
-  char *end;
-  errno = 0;
-  long value = strtol((const char *)s, &end, 0);
+// Parses an integer with the same base prefixes that strtol accepts with
+// base 0: "0x" for hexadecimal and a leading "0" for octal.
+static bool parseLong(const xmlChar *s, long &value)
+{
+  const xmlChar *p = s;
+  while (isXmlSpace(*p))
+    ++p;
+
+  bool negative = false;
+  if ('-' == *p || '+' == *p)
+    negative = ('-' == *p++);
 
-  if ((ERANGE == errno && (LONG_MAX == value || LONG_MIN == value)) || (errno && !value))
+  unsigned base = 10;
+  if ('0' == p[0] && ('x' == p[1] || 'X' == p[1]) && hexDigitValue(p[2]) >= 0)
   {
-    VSD_DEBUG_MSG(("Throwing XmlParserException\n"));
-    throw XmlParserException();
+    base = 16;
+    p += 2;
   }
-  else if (*end)
+  else if ('0' == p[0])
+    base = 8;
+
+  const unsigned long limit = negative ? (unsigned long)LONG_MAX + 1 : (unsigned long)LONG_MAX;
+  unsigned long magnitude = 0;
+  const xmlChar *first = p;
+  for (; *p; ++p)
   {
-    VSD_DEBUG_MSG(("Throwing XmlParserException\n"));
-    throw XmlParserException();
+    int digit = hexDigitValue(*p);
+    if (digit < 0 || (unsigned)digit >= base)
+      break;
+    if (magnitude > (limit - digit) / base)
+      return false;
+    magnitude = magnitude * base + digit;
   }
+  if (p == first || *p)
+    return false;
+
+  value = negative ? -(long)(magnitude - 1) - 1 : (long)magnitude;
+  return true;
+}
+
+} // anonymous namespace
+
+// xmlTextReader helper function
+
+xmlTextReaderPtr libvisio::xmlReaderForStream(WPXInputStream *input, const char *URL, const char *encoding, int options)
+{
+  xmlTextReaderPtr reader = 0;
+  // Parts that are already in memory are parsed in place, instead of being
+  // copied to libxml2 through the read callback. The buffer stays owned by
+  // the stream, which outlives the reader.
+  VSDInternalStream *memoryInput = dynamic_cast<VSDInternalStream *>(input);
+  if (memoryInput)
+  {
+    const long offset = memoryInput->tell();
+    unsigned long numBytesRead = 0;
+    const unsigned char *buffer = memoryInput->read(memoryInput->getSize() - offset, numBytesRead);
+    if (buffer && numBytesRead && numBytesRead <= INT_MAX)
+      reader = xmlReaderForMemory((const char *)buffer, (int)numBytesRead, URL, encoding, options);
+    if (!reader)
+      memoryInput->seek(offset, WPX_SEEK_SET);
+  }
+  if (reader)
+    xmlTextReaderSetErrorHandler(reader, vsdxReaderErrorFunc, 0);
+  else
+    reader = xmlReaderForCallback(vsdxInputReadFunc, (void *)input, URL, encoding, options);
+  return reader;
+}
+
+xmlTextReaderPtr libvisio::xmlReaderForCallback(xmlInputReadCallback readFunc, void *context, const char *URL, const char *encoding, int options)
+{
+  xmlTextReaderPtr reader = xmlReaderForIO(readFunc, vsdxInputCloseFunc, context, URL, encoding, options);
+  if (reader)
+    xmlTextReaderSetErrorHandler(reader, vsdxReaderErrorFunc, 0);
+  return reader;
+}
 
+const xmlChar *libvisio::getConstAttribute(xmlTextReaderPtr reader, const char *name)
+{
+  const xmlChar *value = 0;
+  if (1 == xmlTextReaderMoveToAttribute(reader, BAD_CAST(name)))
+  {
+    value = xmlTextReaderConstValue(reader);
+    xmlTextReaderMoveToElement(reader);
+  }
   return value;
 }
 
-double libvisio::xmlStringToDouble(const xmlChar *s)
+int libvisio::skipElement(xmlTextReaderPtr reader)
 {
-  if (xmlStrEqual(s, BAD_CAST("Themed")))
-    return 0;
+  if (XML_READER_TYPE_ELEMENT != xmlTextReaderNodeType(reader) || xmlTextReaderIsEmptyElement(reader))
+    return 1;
+  // The end tag is the first one back at the depth of the element
+  const int depth = xmlTextReaderDepth(reader);
+  int ret = 1;
+  do
+  {
+    ret = xmlTextReaderRead(reader);
+  }
+  while (1 == ret && (XML_READER_TYPE_END_ELEMENT != xmlTextReaderNodeType(reader) || depth != xmlTextReaderDepth(reader)));
+  return ret;
+}
 
-  char *end;
-  std::string doubleStr((const char *)s);
+libvisio::Colour libvisio::xmlStringToColour(const xmlChar *s)
+{
+  if (xmlStrEqual(s, BAD_CAST("Themed")))
+    return libvisio::Colour();
+  if ('#' != s[0] || 7 != xmlStrlen(s))
+  {
+    VSD_DEBUG_MSG(("Throwing XmlParserException\n"));
+    throw XmlParserException();
+  }
 
-#ifndef __ANDROID__
-  std::string decimalPoint(localeconv()->decimal_point);
-#else
-  std::string decimalPoint(".");
-#endif
-  if (!decimalPoint.empty() && decimalPoint != ".")
+  unsigned val = 0;
+  for (const xmlChar *p = s + 1; *p; ++p)
   {
-    if (!doubleStr.empty())
-    {
-      std::string::size_type pos;
-      while ((pos = doubleStr.find(".")) != std::string::npos)
-        doubleStr.replace(pos,1,decimalPoint);
-    }
+    int digit = hexDigitValue(*p);
+    if (digit < 0)
+      break;
+    val = (val << 4) | (unsigned)digit;
   }
 
-  errno = 0;
-  double value = strtod(doubleStr.c_str(), &end);
+  return Colour((val & 0xff0000) >> 16, (val & 0xff00) >> 8, val & 0xff, 0);
+}
 
-  if ((ERANGE == errno) || (errno && !value))
+long libvisio::xmlStringToLong(const xmlChar *s)
+{
+  if (xmlStrEqual(s, BAD_CAST("Themed")) || !*s)
+    return 0;
+
+  long value = 0;
+  if (!parseLong(s, value))
   {
     VSD_DEBUG_MSG(("Throwing XmlParserException\n"));
     throw XmlParserException();
   }
-  else if (*end)
+
+  return value;
+}
+
+double libvisio::xmlStringToDouble(const xmlChar *s)
+{
+  if (xmlStrEqual(s, BAD_CAST("Themed")) || !*s)
+    return 0;
+
+  double value = 0.0;
+  if (!parseDouble(s, value))
   {
     VSD_DEBUG_MSG(("Throwing XmlParserException\n"));
     throw XmlParserException();
@@ -198,6 +663,15 @@ double libvisio::xmlStringToDouble(const xmlChar *s)
   return value;
 }
 
+bool libvisio::xmlScanDouble(const xmlChar *&s, double &value)
+{
+  const xmlChar *p = s;
+  if (!scanDouble(p, value))
+    return false;
+  s = p;
+  return true;
+}
+
 bool libvisio::xmlStringToBool(const xmlChar *s)
 {
   if (xmlStrEqual(s, BAD_CAST("Themed")))
@@ -222,7 +696,7 @@ bool libvisio::xmlStringToBool(const xmlChar *s)
 // VSDXRelationship
 
 libvisio::VSDXRelationship::VSDXRelationship(xmlTextReaderPtr reader)
-  : m_id(), m_type(), m_target()
+  : m_id(), m_type(), m_typeId(VSDX_REL_UNKNOWN), m_target()
 {
   if (reader)
     // TODO: check whether we are actually parsing "Relationship" element
@@ -238,12 +712,13 @@ libvisio::VSDXRelationship::VSDXRelationship(xmlTextReaderPtr reader)
       else if (xmlStrEqual(name, BAD_CAST("Target")))
         m_target = (const char *)value;
     }
+    m_typeId = getRelationshipTypeId(m_type);
     // VSD_DEBUG_MSG(("Relationship : %s type: %s target: %s\n", m_id.c_str(), m_type.c_str(), m_target.c_str()));
   }
 }
 
 libvisio::VSDXRelationship::VSDXRelationship()
-  : m_id(), m_type(), m_target()
+  : m_id(), m_type(), m_typeId(VSDX_REL_UNKNOWN), m_target()
 {
 }
 
@@ -267,7 +742,10 @@ void libvisio::VSDXRelationship::rebaseTarget(const char *baseDir)
   for (unsigned i = 0; i < segments.size(); ++i)
   {
     if (segments[i] == "..")
-      normalizedSegments.pop_back();
+    {
+      if (!normalizedSegments.empty())
+        normalizedSegments.pop_back();
+    }
     else if (segments[i] != "." && !segments[i].empty())
       normalizedSegments.push_back(segments[i]);
   }
@@ -320,7 +798,7 @@ libvisio::VSDXRelationships::VSDXRelationships(WPXInputStream *input)
             if (inRelationships)
             {
               VSDXRelationship relationship(reader);
-              m_relsByType[relationship.getType()] = relationship;
+              m_relsByType[relationship.getTypeId()] = relationship;
               m_relsById[relationship.getId()] = relationship;
             }
           }
@@ -332,24 +810,26 @@ libvisio::VSDXRelationships::VSDXRelationships(WPXInputStream *input)
   }
 }
 
+libvisio::VSDXRelationships::VSDXRelationships()
+  : m_relsByType(), m_relsById()
+{
+}
+
 libvisio::VSDXRelationships::~VSDXRelationships()
 {
 }
 
 void libvisio::VSDXRelationships::rebaseTargets(const char *baseDir)
 {
-  std::map<std::string, libvisio::VSDXRelationship>::iterator iter;
-  for (iter = m_relsByType.begin(); iter != m_relsByType.end(); ++iter)
+  for (std::map<VSDXRelationshipType, libvisio::VSDXRelationship>::iterator iter = m_relsByType.begin(); iter != m_relsByType.end(); ++iter)
     iter->second.rebaseTarget(baseDir);
-  for (iter = m_relsById.begin(); iter != m_relsById.end(); ++iter)
+  for (std::map<std::string, libvisio::VSDXRelationship>::iterator iter = m_relsById.begin(); iter != m_relsById.end(); ++iter)
     iter->second.rebaseTarget(baseDir);
 }
 
-const libvisio::VSDXRelationship *libvisio::VSDXRelationships::getRelationshipByType(const char *type) const
+const libvisio::VSDXRelationship *libvisio::VSDXRelationships::getRelationshipByType(VSDXRelationshipType type) const
 {
-  if (!type)
-    return 0;
-  std::map<std::string, libvisio::VSDXRelationship>::const_iterator iter = m_relsByType.find(type);
+  std::map<VSDXRelationshipType, libvisio::VSDXRelationship>::const_iterator iter = m_relsByType.find(type);
   if (iter != m_relsByType.end())
     return &(iter->second);
   return 0;
@@ -365,4 +845,154 @@ const libvisio::VSDXRelationship *libvisio::VSDXRelationships::getRelationshipBy
   return 0;
 }
 
+
+// VSDXPackage
+
+libvisio::VSDXPackage::VSDXPackage(WPXInputStream *input)
+  : m_input(input), m_rootRels(), m_partRels(), m_defaultContentTypes(), m_overrideContentTypes()
+{
+  if (!m_input || !m_input->isOLEStream())
+    return;
+
+  readContentTypes();
+
+  WPXInputStream *relStream = m_input->getDocumentOLEStream("_rels/.rels");
+  m_input->seek(0, WPX_SEEK_SET);
+  if (!relStream)
+    return;
+  m_rootRels = VSDXRelationships(relStream);
+  delete relStream;
+
+  const VSDXRelationship *rel = m_rootRels.getRelationshipByType(VSDX_REL_DOCUMENT);
+  if (rel)
+    loadRelationships(rel->getTarget());
+}
+
+libvisio::VSDXPackage::~VSDXPackage()
+{
+}
+
+const libvisio::VSDXRelationships &libvisio::VSDXPackage::getRelationships(const std::string &partName)
+{
+  std::map<std::string, VSDXRelationships>::const_iterator iter = m_partRels.find(partName);
+  if (iter == m_partRels.end())
+  {
+    // a part that is not reachable from the document part; read it now
+    loadRelationships(partName);
+    iter = m_partRels.find(partName);
+  }
+  return iter->second;
+}
+
+const std::string libvisio::VSDXPackage::getContentType(const std::string &partName) const
+{
+  std::map<std::string, std::string>::const_iterator iter = m_overrideContentTypes.find(partName);
+  if (iter != m_overrideContentTypes.end())
+    return iter->second;
+
+  std::string::size_type position = partName.find_last_of("./");
+  if (position == std::string::npos || partName[position] != '.')
+    return std::string();
+  iter = m_defaultContentTypes.find(boost::algorithm::to_lower_copy(partName.substr(position + 1)));
+  if (iter != m_defaultContentTypes.end())
+    return iter->second;
+  return std::string();
+}
+
+void libvisio::VSDXPackage::getTargets(std::vector<std::string> &targets, VSDXRelationshipType type) const
+{
+  for (std::map<std::string, VSDXRelationships>::const_iterator iter = m_partRels.begin(); iter != m_partRels.end(); ++iter)
+  {
+    const std::map<std::string, VSDXRelationship> &rels = iter->second.getRelationshipsById();
+    for (std::map<std::string, VSDXRelationship>::const_iterator relIter = rels.begin(); relIter != rels.end(); ++relIter)
+    {
+      if (type == relIter->second.getTypeId())
+        targets.push_back(relIter->second.getTarget());
+    }
+  }
+}
+
+void libvisio::VSDXPackage::readContentTypes()
+{
+  WPXInputStream *stream = m_input->getDocumentOLEStream("[Content_Types].xml");
+  m_input->seek(0, WPX_SEEK_SET);
+  if (!stream)
+    return;
+
+  xmlTextReaderPtr reader = xmlReaderForStream(stream, 0, 0, XML_PARSE_NOBLANKS|XML_PARSE_NOENT|XML_PARSE_NONET|XML_PARSE_RECOVER);
+  if (reader)
+  {
+    int ret = xmlTextReaderRead(reader);
+    while (1 == ret)
+    {
+      if (XML_READER_TYPE_ELEMENT == xmlTextReaderNodeType(reader))
+      {
+        const xmlChar *name = xmlTextReaderConstName(reader);
+        bool isDefault = xmlStrEqual(name, BAD_CAST("Default"));
+        if (isDefault || xmlStrEqual(name, BAD_CAST("Override")))
+        {
+          xmlChar *key = xmlTextReaderGetAttribute(reader, BAD_CAST(isDefault ? "Extension" : "PartName"));
+          xmlChar *contentType = xmlTextReaderGetAttribute(reader, BAD_CAST("ContentType"));
+          if (key && contentType)
+          {
+            if (isDefault)
+              m_defaultContentTypes[boost::algorithm::to_lower_copy(std::string((const char *)key))] = (const char *)contentType;
+            else
+              // part names are absolute in the content types, but relative everywhere else
+              m_overrideContentTypes[(const char *)key + ('/' == key[0] ? 1 : 0)] = (const char *)contentType;
+          }
+          if (key)
+            xmlFree(key);
+          if (contentType)
+            xmlFree(contentType);
+        }
+      }
+      ret = xmlTextReaderRead(reader);
+    }
+    xmlFreeTextReader(reader);
+  }
+  delete stream;
+}
+
+void libvisio::VSDXPackage::loadRelationships(const std::string &partName)
+{
+  std::vector<std::string> pending(1, partName);
+  while (!pending.empty())
+  {
+    const std::string name = pending.back();
+    pending.pop_back();
+    if (m_partRels.find(name) != m_partRels.end())
+      continue;
+
+    VSDXRelationships &rels = m_partRels[name];
+    WPXInputStream *relStream = m_input->getDocumentOLEStream(getRelationshipsForTarget(name.c_str()).c_str());
+    m_input->seek(0, WPX_SEEK_SET);
+    if (!relStream)
+      continue;
+    rels = VSDXRelationships(relStream);
+    delete relStream;
+    rels.rebaseTargets(getTargetBaseDirectory(name.c_str()).c_str());
+
+    // Follow the relationships to the parts that have a structure of
+    // their own; binary parts like images have no relationships.
+    for (std::map<std::string, VSDXRelationship>::const_iterator iter = rels.getRelationshipsById().begin();
+         iter != rels.getRelationshipsById().end(); ++iter)
+    {
+      switch (iter->second.getTypeId())
+      {
+      case VSDX_REL_DOCUMENT:
+      case VSDX_REL_MASTERS:
+      case VSDX_REL_MASTER:
+      case VSDX_REL_PAGES:
+      case VSDX_REL_PAGE:
+      case VSDX_REL_THEME:
+        pending.push_back(iter->second.getTarget());
+        break;
+      default:
+        break;
+      }
+    }
+  }
+}
+
 /* vim:set shiftwidth=2 softtabstop=2 expandtab: */
@@ -47,12 +47,36 @@ xmlTextReaderPtr xmlReaderForStream(WPXInputStream *input,
                                     const char *encoding,
                                     int options);
 
+// create an xmlTextReader pointer over what a read callback hands out
+// needs to be freed using xmlTextReaderFree function.
+
+xmlTextReaderPtr xmlReaderForCallback(xmlInputReadCallback readFunc,
+                                      void *context,
+                                      const char *URL,
+                                      const char *encoding,
+                                      int options);
+
+// get the value of an attribute of the current node without copying it;
+// the value is only valid until the reader moves to another node.
+
+const xmlChar *getConstAttribute(xmlTextReaderPtr reader, const char *name);
+
+// pass over the content of the current element without looking at it; the
+// reader is left on the end tag, so the next read gets the following node.
+
+int skipElement(xmlTextReaderPtr reader);
+
 Colour xmlStringToColour(const xmlChar *s);
 
 long xmlStringToLong(const xmlChar *s);
 
 double xmlStringToDouble(const xmlChar *s);
 
+// read a number from the start of s, after any blanks, and advance s past
+// it; s is left as it was if there is no number there.
+
+bool xmlScanDouble(const xmlChar *&s, double &value);
+
 bool xmlStringToBool(const xmlChar *s);
 
 
@@ -60,6 +84,19 @@ class VSDCollector;
 
 // Helper classes to properly handle OPC relationships
 
+enum VSDXRelationshipType
+{
+  VSDX_REL_UNKNOWN = 0,
+  VSDX_REL_DOCUMENT,
+  VSDX_REL_MASTERS,
+  VSDX_REL_MASTER,
+  VSDX_REL_PAGES,
+  VSDX_REL_PAGE,
+  VSDX_REL_THEME,
+  VSDX_REL_IMAGE,
+  VSDX_REL_OLE_OBJECT
+};
+
 class VSDXRelationship
 {
 public:
@@ -69,15 +106,19 @@ public:
 
   void rebaseTarget(const char *baseDir);
 
-  const std::string getId() const
+  const std::string &getId() const
   {
     return m_id;
   }
-  const std::string getType() const
+  const std::string &getType() const
   {
     return m_type;
   }
-  const std::string getTarget() const
+  VSDXRelationshipType getTypeId() const
+  {
+    return m_typeId;
+  }
+  const std::string &getTarget() const
   {
     return m_target;
   }
@@ -85,6 +126,7 @@ public:
 private:
   std::string m_id;
   std::string m_type;
+  VSDXRelationshipType m_typeId;
   std::string m_target;
 };
 
@@ -92,12 +134,17 @@ class VSDXRelationships
 {
 public:
   VSDXRelationships(WPXInputStream *input);
+  VSDXRelationships();
   ~VSDXRelationships();
 
   void rebaseTargets(const char *baseDir);
 
-  const VSDXRelationship *getRelationshipByType(const char *type) const;
+  const VSDXRelationship *getRelationshipByType(VSDXRelationshipType type) const;
   const VSDXRelationship *getRelationshipById(const char *id) const;
+  const std::map<std::string, VSDXRelationship> &getRelationshipsById() const
+  {
+    return m_relsById;
+  }
 
   bool empty() const
   {
@@ -105,10 +152,43 @@ public:
   }
 
 private:
-  std::map<std::string, VSDXRelationship> m_relsByType;
+  std::map<VSDXRelationshipType, VSDXRelationship> m_relsByType;
   std::map<std::string, VSDXRelationship> m_relsById;
 };
 
+// The structure of an OPC package: its content types and the graph of
+// relationships between its parts, with the targets already resolved to
+// the names of the package entries. It is read once, when the package is
+// opened, and shared by all the passes over the document.
+
+class VSDXPackage
+{
+public:
+  VSDXPackage(WPXInputStream *input);
+  ~VSDXPackage();
+
+  const VSDXRelationships &getRootRelationships() const
+  {
+    return m_rootRels;
+  }
+  const VSDXRelationships &getRelationships(const std::string &partName);
+  const std::string getContentType(const std::string &partName) const;
+  void getTargets(std::vector<std::string> &targets, VSDXRelationshipType type) const;
+
+private:
+  VSDXPackage(const VSDXPackage &);
+  VSDXPackage &operator=(const VSDXPackage &);
+
+  void readContentTypes();
+  void loadRelationships(const std::string &partName);
+
+  WPXInputStream *m_input;
+  VSDXRelationships m_rootRels;
+  std::map<std::string, VSDXRelationships> m_partRels;
+  std::map<std::string, std::string> m_defaultContentTypes;
+  std::map<std::string, std::string> m_overrideContentTypes;
+};
+
 } // namespace libvisio
 
 #endif // __VSDXMLHELPER_H__
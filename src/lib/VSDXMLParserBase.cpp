@@ -28,11 +28,11 @@
  */
 
 #include <string.h>
+#include <limits.h>
 #include <libxml/xmlIO.h>
 #include <libxml/xmlstring.h>
 #include <libwpd-stream/libwpd-stream.h>
 #include <boost/algorithm/string.hpp>
-#include <boost/spirit/include/classic.hpp>
 #include "VSDXMLParserBase.h"
 #include "libvisio_utils.h"
 #include "VSDContentCollector.h"
@@ -41,6 +41,98 @@
 #include "VSDXMLHelper.h"
 #include "VSDXMLTokenMap.h"
 
+namespace
+{
+
+// Scanners for the NURBS() and POLYLINE() formulas. Blanks may surround
+// every item of a formula, and the commas between the numbers may be left
+// out.
+
+void skipFormulaSpaces(const xmlChar *&p)
+{
+  while (' ' == *p || ('\t' <= *p && '\r' >= *p))
+    ++p;
+}
+
+bool scanFormulaChar(const xmlChar *&p, char c)
+{
+  skipFormulaSpaces(p);
+  if (c != *p)
+    return false;
+  ++p;
+  return true;
+}
+
+bool scanFormulaStart(const xmlChar *&p, const char *name)
+{
+  skipFormulaSpaces(p);
+  const int length = (int)strlen(name);
+  if (xmlStrncmp(p, BAD_CAST(name), length))
+    return false;
+  p += length;
+  return scanFormulaChar(p, '(');
+}
+
+bool scanFormulaEnd(const xmlChar *&p)
+{
+  if (!scanFormulaChar(p, ')'))
+    return false;
+  skipFormulaSpaces(p);
+  return !*p;
+}
+
+bool isFormulaEnd(const xmlChar *&p)
+{
+  skipFormulaSpaces(p);
+  return ')' == *p;
+}
+
+bool scanFormulaNumber(const xmlChar *&p, double &value, bool separated = true)
+{
+  if (separated)
+    scanFormulaChar(p, ',');
+  skipFormulaSpaces(p);
+  return libvisio::xmlScanDouble(p, value);
+}
+
+bool scanFormulaInteger(const xmlChar *&p, int &value)
+{
+  scanFormulaChar(p, ',');
+  skipFormulaSpaces(p);
+  const xmlChar *q = p;
+  bool negative = false;
+  if ('-' == *q || '+' == *q)
+    negative = ('-' == *q++);
+  if (*q < '0' || *q > '9')
+    return false;
+  const unsigned long limit = negative ? (unsigned long)INT_MAX + 1 : (unsigned long)INT_MAX;
+  unsigned long magnitude = 0;
+  for (; *q >= '0' && *q <= '9'; ++q)
+  {
+    magnitude = magnitude * 10 + (*q - '0');
+    if (magnitude > limit)
+      return false;
+  }
+  value = negative ? -(int)(magnitude - 1) - 1 : (int)magnitude;
+  p = q;
+  return true;
+}
+
+// The number of groups of groupSize numbers left in a formula, when all of
+// them are separated by commas; it falls short when commas are left out.
+unsigned countFormulaGroups(const xmlChar *p, unsigned groupSize)
+{
+  unsigned commas = 0;
+  for (; *p; ++p)
+  {
+    if (',' == *p)
+      ++commas;
+  }
+  return commas / groupSize;
+}
+
+} // anonymous namespace
+
 
 libvisio::VSDXMLParserBase::VSDXMLParserBase()
   : m_collector(), m_stencils(), m_currentStencil(0), m_shape(),
@@ -49,7 +141,7 @@ libvisio::VSDXMLParserBase::VSDXMLParserBase()
     m_currentShapeLevel(0), m_colours(), m_fieldList(), m_shapeList(),
     m_currentBinaryData(), m_shapeStack(), m_shapeLevelStack(),
     m_isShapeStarted(false), m_isPageStarted(false), m_currentGeometryList(0),
-    m_currentGeometryListIndex(MINUS_ONE), m_fonts()
+    m_currentGeometryListIndex(MINUS_ONE), m_fonts(), m_tokenCache(), m_options()
 {
   initColours();
 }
@@ -60,6 +152,70 @@ libvisio::VSDXMLParserBase::~VSDXMLParserBase()
     delete m_currentStencil;
 }
 
+void libvisio::VSDXMLParserBase::setRenderingOptions(const VSDRenderingOptions &options)
+{
+  m_options = options;
+}
+
+unsigned libvisio::VSDXMLParserBase::getExceededLimits() const
+{
+  return m_options.getExceededLimits();
+}
+
+int libvisio::VSDXMLParserBase::readNextNode(xmlTextReaderPtr reader)
+{
+  return xmlTextReaderRead(reader);
+}
+
+int libvisio::VSDXMLParserBase::getNodeType(xmlTextReaderPtr reader)
+{
+  return xmlTextReaderNodeType(reader);
+}
+
+// VSDXMLTokenCache
+
+libvisio::VSDXMLTokenCache::VSDXMLTokenCache()
+  : m_reader(0)
+{
+  reset();
+}
+
+void libvisio::VSDXMLTokenCache::reset()
+{
+  for (unsigned i = 0; i < VSD_TOKEN_CACHE_SIZE; ++i)
+  {
+    m_entries[i].name = 0;
+    m_entries[i].tokenId = XML_TOKEN_INVALID;
+  }
+  m_reader = 0;
+}
+
+int libvisio::VSDXMLTokenCache::getTokenId(xmlTextReaderPtr reader)
+{
+  const xmlChar *name = xmlTextReaderConstName(reader);
+  if (!name)
+    return XML_TOKEN_INVALID;
+  if (reader != m_reader)
+  {
+    reset();
+    m_reader = reader;
+  }
+
+  const size_t address = (size_t)name;
+  Entry &entry = m_entries[((address >> 3) ^ (address >> 11)) % VSD_TOKEN_CACHE_SIZE];
+  if (entry.name == name)
+    return entry.tokenId;
+
+  int tokenId = VSDXMLTokenMap::getTokenId(name);
+  // only the names owned by the dictionary keep their address
+  if (xmlTextReaderConstString(reader, name) == name)
+  {
+    entry.name = name;
+    entry.tokenId = tokenId;
+  }
+  return tokenId;
+}
+
 // Common functions
 
 void libvisio::VSDXMLParserBase::readGeometry(xmlTextReaderPtr reader)
@@ -75,7 +231,7 @@ void libvisio::VSDXMLParserBase::readGeometry(xmlTextReaderPtr reader)
 
   if (xmlTextReaderIsEmptyElement(reader))
   {
-    xmlChar *delString = xmlTextReaderGetAttribute(reader, BAD_CAST("Del"));
+    const xmlChar *delString = getConstAttribute(reader, "Del");
     if (delString)
     {
       if (xmlStringToBool(delString))
@@ -83,7 +239,6 @@ void libvisio::VSDXMLParserBase::readGeometry(xmlTextReaderPtr reader)
         m_currentGeometryList->clear();
         m_shape.m_geometries.erase(ix);
       }
-      xmlFree(delString);
     }
     return;
   }
@@ -94,13 +249,13 @@ void libvisio::VSDXMLParserBase::readGeometry(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readGeometry: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -188,12 +343,11 @@ void libvisio::VSDXMLParserBase::readMoveTo(xmlTextReaderPtr reader)
 
   if (xmlTextReaderIsEmptyElement(reader))
   {
-    xmlChar *delString = xmlTextReaderGetAttribute(reader, BAD_CAST("Del"));
+    const xmlChar *delString = getConstAttribute(reader, "Del");
     if (delString)
     {
       if (xmlStringToBool(delString))
         m_currentGeometryList->addEmpty(ix, level);
-      xmlFree(delString);
     }
     return;
   }
@@ -203,13 +357,13 @@ void libvisio::VSDXMLParserBase::readMoveTo(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readMoveTo: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -239,12 +393,11 @@ void libvisio::VSDXMLParserBase::readLineTo(xmlTextReaderPtr reader)
 
   if (xmlTextReaderIsEmptyElement(reader))
   {
-    xmlChar *delString = xmlTextReaderGetAttribute(reader, BAD_CAST("Del"));
+    const xmlChar *delString = getConstAttribute(reader, "Del");
     if (delString)
     {
       if (xmlStringToBool(delString))
         m_currentGeometryList->addEmpty(ix, level);
-      xmlFree(delString);
     }
     return;
   }
@@ -254,13 +407,13 @@ void libvisio::VSDXMLParserBase::readLineTo(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readLineTo: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -290,12 +443,11 @@ void libvisio::VSDXMLParserBase::readArcTo(xmlTextReaderPtr reader)
 
   if (xmlTextReaderIsEmptyElement(reader))
   {
-    xmlChar *delString = xmlTextReaderGetAttribute(reader, BAD_CAST("Del"));
+    const xmlChar *delString = getConstAttribute(reader, "Del");
     if (delString)
     {
       if (xmlStringToBool(delString))
         m_currentGeometryList->addEmpty(ix, level);
-      xmlFree(delString);
     }
     return;
   }
@@ -306,13 +458,13 @@ void libvisio::VSDXMLParserBase::readArcTo(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readArcTo: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -345,12 +497,11 @@ void libvisio::VSDXMLParserBase::readEllipticalArcTo(xmlTextReaderPtr reader)
 
   if (xmlTextReaderIsEmptyElement(reader))
   {
-    xmlChar *delString = xmlTextReaderGetAttribute(reader, BAD_CAST("Del"));
+    const xmlChar *delString = getConstAttribute(reader, "Del");
     if (delString)
     {
       if (xmlStringToBool(delString))
         m_currentGeometryList->addEmpty(ix, level);
-      xmlFree(delString);
     }
     return;
   }
@@ -364,13 +515,13 @@ void libvisio::VSDXMLParserBase::readEllipticalArcTo(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readEllipticalArcTo: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -412,12 +563,11 @@ void libvisio::VSDXMLParserBase::readEllipse(xmlTextReaderPtr reader)
 
   if (xmlTextReaderIsEmptyElement(reader))
   {
-    xmlChar *delString = xmlTextReaderGetAttribute(reader, BAD_CAST("Del"));
+    const xmlChar *delString = getConstAttribute(reader, "Del");
     if (delString)
     {
       if (xmlStringToBool(delString))
         m_currentGeometryList->addEmpty(ix, level);
-      xmlFree(delString);
     }
     return;
   }
@@ -431,13 +581,13 @@ void libvisio::VSDXMLParserBase::readEllipse(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readEllipse: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -479,12 +629,11 @@ void libvisio::VSDXMLParserBase::readNURBSTo(xmlTextReaderPtr reader)
 
   if (xmlTextReaderIsEmptyElement(reader))
   {
-    xmlChar *delString = xmlTextReaderGetAttribute(reader, BAD_CAST("Del"));
+    const xmlChar *delString = getConstAttribute(reader, "Del");
     if (delString)
     {
       if (xmlStringToBool(delString))
         m_currentGeometryList->addEmpty(ix, level);
-      xmlFree(delString);
     }
     return;
   }
@@ -499,13 +648,13 @@ void libvisio::VSDXMLParserBase::readNURBSTo(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readNURBSTo: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -551,12 +700,11 @@ void libvisio::VSDXMLParserBase::readPolylineTo(xmlTextReaderPtr reader)
 
   if (xmlTextReaderIsEmptyElement(reader))
   {
-    xmlChar *delString = xmlTextReaderGetAttribute(reader, BAD_CAST("Del"));
+    const xmlChar *delString = getConstAttribute(reader, "Del");
     if (delString)
     {
       if (xmlStringToBool(delString))
         m_currentGeometryList->addEmpty(ix, level);
-      xmlFree(delString);
     }
     return;
   }
@@ -567,13 +715,13 @@ void libvisio::VSDXMLParserBase::readPolylineTo(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readPolylineTo: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -606,12 +754,11 @@ void libvisio::VSDXMLParserBase::readInfiniteLine(xmlTextReaderPtr reader)
 
   if (xmlTextReaderIsEmptyElement(reader))
   {
-    xmlChar *delString = xmlTextReaderGetAttribute(reader, BAD_CAST("Del"));
+    const xmlChar *delString = getConstAttribute(reader, "Del");
     if (delString)
     {
       if (xmlStringToBool(delString))
         m_currentGeometryList->addEmpty(ix, level);
-      xmlFree(delString);
     }
     return;
   }
@@ -623,13 +770,13 @@ void libvisio::VSDXMLParserBase::readInfiniteLine(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readInfiniteLine: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -665,12 +812,11 @@ void libvisio::VSDXMLParserBase::readRelEllipticalArcTo(xmlTextReaderPtr reader)
 
   if (xmlTextReaderIsEmptyElement(reader))
   {
-    xmlChar *delString = xmlTextReaderGetAttribute(reader, BAD_CAST("Del"));
+    const xmlChar *delString = getConstAttribute(reader, "Del");
     if (delString)
     {
       if (xmlStringToBool(delString))
         m_currentGeometryList->addEmpty(ix, level);
-      xmlFree(delString);
     }
     return;
   }
@@ -684,13 +830,13 @@ void libvisio::VSDXMLParserBase::readRelEllipticalArcTo(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readRelEllipticalArcTo: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -732,12 +878,11 @@ void libvisio::VSDXMLParserBase::readRelCubBezTo(xmlTextReaderPtr reader)
 
   if (xmlTextReaderIsEmptyElement(reader))
   {
-    xmlChar *delString = xmlTextReaderGetAttribute(reader, BAD_CAST("Del"));
+    const xmlChar *delString = getConstAttribute(reader, "Del");
     if (delString)
     {
       if (xmlStringToBool(delString))
         m_currentGeometryList->addEmpty(ix, level);
-      xmlFree(delString);
     }
     return;
   }
@@ -751,13 +896,13 @@ void libvisio::VSDXMLParserBase::readRelCubBezTo(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readRelCubBezTo: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -799,12 +944,11 @@ void libvisio::VSDXMLParserBase::readRelLineTo(xmlTextReaderPtr reader)
 
   if (xmlTextReaderIsEmptyElement(reader))
   {
-    xmlChar *delString = xmlTextReaderGetAttribute(reader, BAD_CAST("Del"));
+    const xmlChar *delString = getConstAttribute(reader, "Del");
     if (delString)
     {
       if (xmlStringToBool(delString))
         m_currentGeometryList->addEmpty(ix, level);
-      xmlFree(delString);
     }
     return;
   }
@@ -814,13 +958,13 @@ void libvisio::VSDXMLParserBase::readRelLineTo(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readRelLineTo: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -850,12 +994,11 @@ void libvisio::VSDXMLParserBase::readRelMoveTo(xmlTextReaderPtr reader)
 
   if (xmlTextReaderIsEmptyElement(reader))
   {
-    xmlChar *delString = xmlTextReaderGetAttribute(reader, BAD_CAST("Del"));
+    const xmlChar *delString = getConstAttribute(reader, "Del");
     if (delString)
     {
       if (xmlStringToBool(delString))
         m_currentGeometryList->addEmpty(ix, level);
-      xmlFree(delString);
     }
     return;
   }
@@ -865,13 +1008,13 @@ void libvisio::VSDXMLParserBase::readRelMoveTo(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readRelMoveTo: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -901,12 +1044,11 @@ void libvisio::VSDXMLParserBase::readRelQuadBezTo(xmlTextReaderPtr reader)
 
   if (xmlTextReaderIsEmptyElement(reader))
   {
-    xmlChar *delString = xmlTextReaderGetAttribute(reader, BAD_CAST("Del"));
+    const xmlChar *delString = getConstAttribute(reader, "Del");
     if (delString)
     {
       if (xmlStringToBool(delString))
         m_currentGeometryList->addEmpty(ix, level);
-      xmlFree(delString);
     }
     return;
   }
@@ -918,13 +1060,13 @@ void libvisio::VSDXMLParserBase::readRelQuadBezTo(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readRelQuadBezTo: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -954,32 +1096,18 @@ void libvisio::VSDXMLParserBase::readShape(xmlTextReaderPtr reader)
   m_isShapeStarted = true;
   m_currentShapeLevel = getElementDepth(reader);
 
-  xmlChar *idString = xmlTextReaderGetAttribute(reader, BAD_CAST("ID"));
-  xmlChar *masterPageString = xmlTextReaderGetAttribute(reader, BAD_CAST("Master"));
-  xmlChar *masterShapeString = xmlTextReaderGetAttribute(reader, BAD_CAST("MasterShape"));
-  xmlChar *lineStyleString = xmlTextReaderGetAttribute(reader, BAD_CAST("LineStyle"));
-  xmlChar *fillStyleString = xmlTextReaderGetAttribute(reader, BAD_CAST("FillStyle"));
-  xmlChar *textStyleString = xmlTextReaderGetAttribute(reader, BAD_CAST("TextStyle"));
-
-  unsigned id = idString ? (unsigned)xmlStringToLong(idString) : MINUS_ONE;
-  unsigned masterPage = masterPageString ? (unsigned)xmlStringToLong(masterPageString) : MINUS_ONE;
-  unsigned masterShape = masterShapeString ? (unsigned)xmlStringToLong(masterShapeString) : MINUS_ONE;
-  unsigned lineStyle = lineStyleString ? (unsigned)xmlStringToLong(lineStyleString) : MINUS_ONE;
-  unsigned fillStyle =  fillStyleString ? (unsigned)xmlStringToLong(fillStyleString) : MINUS_ONE;
-  unsigned textStyle =  textStyleString ? (unsigned)xmlStringToLong(textStyleString) : MINUS_ONE;
-
-  if (idString)
-    xmlFree(idString);
-  if (masterPageString)
-    xmlFree(masterPageString);
-  if (masterShapeString)
-    xmlFree(masterShapeString);
-  if (lineStyleString)
-    xmlFree(lineStyleString);
-  if (fillStyleString)
-    xmlFree(fillStyleString);
-  if (textStyleString)
-    xmlFree(textStyleString);
+  const xmlChar *value = getConstAttribute(reader, "ID");
+  unsigned id = value ? (unsigned)xmlStringToLong(value) : MINUS_ONE;
+  value = getConstAttribute(reader, "Master");
+  unsigned masterPage = value ? (unsigned)xmlStringToLong(value) : MINUS_ONE;
+  value = getConstAttribute(reader, "MasterShape");
+  unsigned masterShape = value ? (unsigned)xmlStringToLong(value) : MINUS_ONE;
+  value = getConstAttribute(reader, "LineStyle");
+  unsigned lineStyle = value ? (unsigned)xmlStringToLong(value) : MINUS_ONE;
+  value = getConstAttribute(reader, "FillStyle");
+  unsigned fillStyle = value ? (unsigned)xmlStringToLong(value) : MINUS_ONE;
+  value = getConstAttribute(reader, "TextStyle");
+  unsigned textStyle = value ? (unsigned)xmlStringToLong(value) : MINUS_ONE;
 
   if (masterPage != MINUS_ONE || masterShape != MINUS_ONE)
   {
@@ -993,6 +1121,8 @@ void libvisio::VSDXMLParserBase::readShape(xmlTextReaderPtr reader)
   if (m_isStencilStarted)
     m_currentStencil->setFirstShape(id);
 
+  if (MINUS_ONE != masterPage)
+    loadStencil(masterPage);
   const VSDStencil *tmpStencil = m_stencils.getStencil(masterPage);
   if (tmpStencil)
   {
@@ -1068,13 +1198,13 @@ void libvisio::VSDXMLParserBase::readColours(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readColours: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     if (XML_COLORENTRY == tokenId)
     {
@@ -1135,13 +1265,13 @@ void libvisio::VSDXMLParserBase::readText(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readText: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
     switch (tokenId)
     {
     case XML_CP:
@@ -1233,19 +1363,19 @@ void libvisio::VSDXMLParserBase::readCharIX(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readCharIX: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
     switch (tokenId)
     {
     case XML_FONT:
       if (XML_READER_TYPE_ELEMENT == tokenType)
       {
-        xmlChar *stringValue = readStringData(reader);
+        const xmlChar *stringValue = readStringData(reader);
         if (stringValue && !xmlStrEqual(stringValue, BAD_CAST("Themed")))
         {
           try
@@ -1262,8 +1392,6 @@ void libvisio::VSDXMLParserBase::readCharIX(xmlTextReaderPtr reader)
             font = VSDName(WPXBinaryData(stringValue, xmlStrlen(stringValue)), VSD_TEXT_UTF8);
           }
         }
-        if (stringValue)
-          xmlFree(stringValue);
       }
       break;
     case XML_COLOR:
@@ -1425,13 +1553,13 @@ void libvisio::VSDXMLParserBase::readParaIX(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readParaIX: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -1538,12 +1666,11 @@ void libvisio::VSDXMLParserBase::readSplineStart(xmlTextReaderPtr reader)
 
   if (xmlTextReaderIsEmptyElement(reader))
   {
-    xmlChar *delString = xmlTextReaderGetAttribute(reader, BAD_CAST("Del"));
+    const xmlChar *delString = getConstAttribute(reader, "Del");
     if (delString)
     {
       if (xmlStringToBool(delString))
         m_currentGeometryList->addEmpty(ix, level);
-      xmlFree(delString);
     }
     return;
   }
@@ -1557,13 +1684,13 @@ void libvisio::VSDXMLParserBase::readSplineStart(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readSplineStart: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -1605,12 +1732,11 @@ void libvisio::VSDXMLParserBase::readSplineKnot(xmlTextReaderPtr reader)
 
   if (xmlTextReaderIsEmptyElement(reader))
   {
-    xmlChar *delString = xmlTextReaderGetAttribute(reader, BAD_CAST("Del"));
+    const xmlChar *delString = getConstAttribute(reader, "Del");
     if (delString)
     {
       if (xmlStringToBool(delString))
         m_currentGeometryList->addEmpty(ix, level);
-      xmlFree(delString);
     }
     return;
   }
@@ -1621,13 +1747,13 @@ void libvisio::VSDXMLParserBase::readSplineKnot(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXMLParserBase::readSplineKnot: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -1748,23 +1874,17 @@ void libvisio::VSDXMLParserBase::_flushShape()
   for (std::map<unsigned, VSDName>::const_iterator iterName = m_shape.m_names.begin(); iterName != m_shape.m_names.end(); ++iterName)
     m_collector->collectName(iterName->first, m_currentShapeLevel+2, iterName->second.m_data, iterName->second.m_format);
 
+  m_collector->collectShapeGeometries(m_currentShapeLevel+2, m_shape.m_geometries);
+
   if (!m_shape.m_geometries.empty())
   {
     for (std::map<unsigned, VSDGeometryList>::iterator iter = m_shape.m_geometries.begin(); iter != m_shape.m_geometries.end(); ++iter)
       iter->second.resetLevel(m_currentShapeLevel+2);
-    std::vector<unsigned> tmpVector;
+    // the map keeps the geometry sections in the order of their indices
     for (std::map<unsigned, VSDGeometryList>::const_iterator iterGeom = m_shape.m_geometries.begin(); iterGeom != m_shape.m_geometries.end(); ++iterGeom)
-      tmpVector.push_back(iterGeom->first);
-    std::sort(tmpVector.begin(), tmpVector.end());
-
-    for (unsigned i = 0; i < tmpVector.size(); i++)
     {
-      std::map<unsigned, VSDGeometryList>::const_iterator iter = m_shape.m_geometries.find(tmpVector[i]);
-      if (iter != m_shape.m_geometries.end())
-      {
-        iter->second.handle(m_collector);
-        m_collector->collectUnhandledChunk(0, m_currentShapeLevel+1);
-      }
+      m_collector->collectGeometryList(m_currentShapeLevel+2, iterGeom->second);
+      m_collector->collectUnhandledChunk(0, m_currentShapeLevel+1);
     }
   }
 
@@ -1893,123 +2013,104 @@ void libvisio::VSDXMLParserBase::handleMasterEnd(xmlTextReaderPtr /* reader */)
 
 void libvisio::VSDXMLParserBase::skipMasters(xmlTextReaderPtr reader)
 {
-  int ret = 1;
-  int tokenId = XML_TOKEN_INVALID;
-  int tokenType = -1;
-  do
-  {
-    ret = xmlTextReaderRead(reader);
-    tokenId = getElementToken(reader);
-    tokenType = xmlTextReaderNodeType(reader);
-  }
-  while ((XML_MASTERS != tokenId || XML_READER_TYPE_END_ELEMENT != tokenType) && 1 == ret);
+  skipElement(reader);
 }
 
 void libvisio::VSDXMLParserBase::skipPages(xmlTextReaderPtr reader)
 {
-  int ret = 1;
-  int tokenId = XML_TOKEN_INVALID;
-  int tokenType = -1;
-  do
-  {
-    ret = xmlTextReaderRead(reader);
-    tokenId = getElementToken(reader);
-    tokenType = xmlTextReaderNodeType(reader);
-  }
-  while ((XML_PAGES != tokenId || XML_READER_TYPE_END_ELEMENT != tokenType) && 1 == ret);
+  skipElement(reader);
 }
 
 int libvisio::VSDXMLParserBase::readNURBSData(boost::optional<NURBSData> &data, xmlTextReaderPtr reader)
 {
-  using namespace ::boost::spirit::classic;
-
-  NURBSData tmpData;
+  // NURBS(lastKnot, degree, xType, yType, x1, y1, knot1, weight1, ...)
+  const xmlChar *p = readStringData(reader);
+  if (!p)
+    return -1;
 
-  bool bRes = false;
-  xmlChar *formula = readStringData(reader);
+  double lastKnot = 0.0;
+  int degree = 0;
+  int xType = 0;
+  int yType = 0;
+  if (!scanFormulaStart(p, "NURBS") || !scanFormulaNumber(p, lastKnot, false) || !scanFormulaInteger(p, degree)
+      || !scanFormulaInteger(p, xType) || !scanFormulaInteger(p, yType))
+    return -1;
 
-  if (formula)
+  std::vector<std::pair<double, double> > points;
+  std::vector<double> knots;
+  std::vector<double> weights;
+  const unsigned count = countFormulaGroups(p, 4);
+  points.reserve(count);
+  knots.reserve(count);
+  weights.reserve(count);
+  do
   {
-    std::pair<double, double> point;
-
-    bRes = parse((const char *)formula,
-                 //  Begin grammar
-                 (
-                   str_p("NURBS")
-                   >> '('
-                   >> real_p[assign_a(tmpData.lastKnot)] >> (',' | eps_p)
-                   >> int_p[assign_a(tmpData.degree)] >> (',' | eps_p)
-                   >> int_p[assign_a(tmpData.xType)] >> (',' | eps_p)
-                   >> int_p[assign_a(tmpData.yType)] >> (',' | eps_p) >>
-                   // array of points, weights and knots
-                   (list_p(
-                      (
-                        (real_p[assign_a(point.first)] >> (',' | eps_p) >>
-                         real_p[assign_a(point.second)])[push_back_a(tmpData.points,point)]
-                        >> (',' | eps_p) >>
-                        real_p[push_back_a(tmpData.knots)] >> (',' | eps_p) >>
-                        real_p[push_back_a(tmpData.weights)]), ',' | eps_p ))
-                 ) >> ')' >> end_p,
-                 //  End grammar
-                 space_p).full;
-
-    xmlFree(formula);
+    double x = 0.0;
+    double y = 0.0;
+    double knot = 0.0;
+    double weight = 0.0;
+    if (!scanFormulaNumber(p, x) || !scanFormulaNumber(p, y) || !scanFormulaNumber(p, knot) || !scanFormulaNumber(p, weight))
+      return -1;
+    points.push_back(std::make_pair(x, y));
+    knots.push_back(knot);
+    weights.push_back(weight);
   }
-
-  if( !bRes )
+  while (!isFormulaEnd(p));
+  if (!scanFormulaEnd(p))
     return -1;
-  data = tmpData;
+
+  data = NURBSData();
+  data->lastKnot = lastKnot;
+  data->degree = (unsigned)degree;
+  data->xType = (unsigned char)xType;
+  data->yType = (unsigned char)yType;
+  data->points.swap(points);
+  data->knots.swap(knots);
+  data->weights.swap(weights);
   return 1;
 }
 
 int libvisio::VSDXMLParserBase::readPolylineData(boost::optional<PolylineData> &data, xmlTextReaderPtr reader)
 {
-  using namespace ::boost::spirit::classic;
-
-  PolylineData tmpData;
+  // POLYLINE(xType, yType, x1, y1, ...)
+  const xmlChar *p = readStringData(reader);
+  if (!p)
+    return -1;
 
-  bool bRes = false;
-  xmlChar *formula = readStringData(reader);
+  int xType = 0;
+  int yType = 0;
+  if (!scanFormulaStart(p, "POLYLINE") || !scanFormulaInteger(p, xType) || !scanFormulaInteger(p, yType))
+    return -1;
 
-  if (formula)
+  std::vector<std::pair<double, double> > points;
+  points.reserve(countFormulaGroups(p, 2));
+  do
   {
-    std::pair<double, double> point;
-
-    bRes = parse((const char *)formula,
-                 //  Begin grammar
-                 (
-                   str_p("POLYLINE")
-                   >> '('
-                   >> int_p[assign_a(tmpData.xType)] >> (',' | eps_p)
-                   >> int_p[assign_a(tmpData.yType)] >> (',' | eps_p) >>
-                   // array of points
-                   (list_p(
-                      (
-                        (real_p[assign_a(point.first)] >> (',' | eps_p) >>
-                         real_p[assign_a(point.second)])[push_back_a(tmpData.points,point)]), ',' | eps_p ))
-                 ) >> ')' >> end_p,
-                 //  End grammar
-                 space_p).full;
-
-    xmlFree(formula);
+    double x = 0.0;
+    double y = 0.0;
+    if (!scanFormulaNumber(p, x) || !scanFormulaNumber(p, y))
+      return -1;
+    points.push_back(std::make_pair(x, y));
   }
-
-  if( !bRes )
+  while (!isFormulaEnd(p));
+  if (!scanFormulaEnd(p))
     return -1;
-  data = tmpData;
+
+  data = PolylineData();
+  data->xType = (unsigned char)xType;
+  data->yType = (unsigned char)yType;
+  data->points.swap(points);
   return 1;
 }
 
-
 int libvisio::VSDXMLParserBase::readDoubleData(double &value, xmlTextReaderPtr reader)
 {
-  xmlChar *stringValue = readStringData(reader);
+  const xmlChar *stringValue = readStringData(reader);
   if (stringValue)
   {
     VSD_DEBUG_MSG(("VSDXMLParserBase::readDoubleData stringValue %s\n", (const char *)stringValue));
     if (!xmlStrEqual(stringValue, BAD_CAST("Themed")))
       value = xmlStringToDouble(stringValue);
-    xmlFree(stringValue);
     return 1;
   }
   return -1;
@@ -2017,13 +2118,12 @@ int libvisio::VSDXMLParserBase::readDoubleData(double &value, xmlTextReaderPtr r
 
 int libvisio::VSDXMLParserBase::readDoubleData(boost::optional<double> &value, xmlTextReaderPtr reader)
 {
-  xmlChar *stringValue = readStringData(reader);
+  const xmlChar *stringValue = readStringData(reader);
   if (stringValue)
   {
     VSD_DEBUG_MSG(("VSDXMLParserBase::readDoubleData stringValue %s\n", (const char *)stringValue));
     if (!xmlStrEqual(stringValue, BAD_CAST("Themed")))
       value = xmlStringToDouble(stringValue);
-    xmlFree(stringValue);
     return 1;
   }
   return -1;
@@ -2031,13 +2131,12 @@ int libvisio::VSDXMLParserBase::readDoubleData(boost::optional<double> &value, x
 
 int libvisio::VSDXMLParserBase::readLongData(long &value, xmlTextReaderPtr reader)
 {
-  xmlChar *stringValue = readStringData(reader);
+  const xmlChar *stringValue = readStringData(reader);
   if (stringValue)
   {
     VSD_DEBUG_MSG(("VSDXMLParserBase::readLongData stringValue %s\n", (const char *)stringValue));
     if (!xmlStrEqual(stringValue, BAD_CAST("Themed")))
       value = xmlStringToLong(stringValue);
-    xmlFree(stringValue);
     return 1;
   }
   return -1;
@@ -2045,13 +2144,12 @@ int libvisio::VSDXMLParserBase::readLongData(long &value, xmlTextReaderPtr reade
 
 int libvisio::VSDXMLParserBase::readLongData(boost::optional<long> &value, xmlTextReaderPtr reader)
 {
-  xmlChar *stringValue = readStringData(reader);
+  const xmlChar *stringValue = readStringData(reader);
   if (stringValue)
   {
     VSD_DEBUG_MSG(("VSDXMLParserBase::readLongData stringValue %s\n", (const char *)stringValue));
     if (!xmlStrEqual(stringValue, BAD_CAST("Themed")))
       value = xmlStringToLong(stringValue);
-    xmlFree(stringValue);
     return 1;
   }
   return -1;
@@ -2059,13 +2157,12 @@ int libvisio::VSDXMLParserBase::readLongData(boost::optional<long> &value, xmlTe
 
 int libvisio::VSDXMLParserBase::readBoolData(bool &value, xmlTextReaderPtr reader)
 {
-  xmlChar *stringValue = readStringData(reader);
+  const xmlChar *stringValue = readStringData(reader);
   if (stringValue)
   {
     VSD_DEBUG_MSG(("VSDXMLParserBase::readBoolData stringValue %s\n", (const char *)stringValue));
     if (!xmlStrEqual(stringValue, BAD_CAST("Themed")))
       value = xmlStringToBool(stringValue);
-    xmlFree(stringValue);
     return 1;
   }
   return -1;
@@ -2073,13 +2170,12 @@ int libvisio::VSDXMLParserBase::readBoolData(bool &value, xmlTextReaderPtr reade
 
 int libvisio::VSDXMLParserBase::readBoolData(boost::optional<bool> &value, xmlTextReaderPtr reader)
 {
-  xmlChar *stringValue = readStringData(reader);
+  const xmlChar *stringValue = readStringData(reader);
   if (stringValue)
   {
     VSD_DEBUG_MSG(("VSDXMLParserBase::readBoolData stringValue %s\n", (const char *)stringValue));
     if (!xmlStrEqual(stringValue, BAD_CAST("Themed")))
       value = xmlStringToBool(stringValue);
-    xmlFree(stringValue);
     return 1;
   }
   return -1;
@@ -2113,24 +2209,15 @@ int libvisio::VSDXMLParserBase::readByteData(boost::optional<unsigned char> &val
 
 int libvisio::VSDXMLParserBase::readColourData(Colour &value, xmlTextReaderPtr reader)
 {
-  xmlChar *stringValue = readStringData(reader);
+  const xmlChar *stringValue = readStringData(reader);
   if (stringValue)
   {
     VSD_DEBUG_MSG(("VSDXMLParserBase::readColourData stringValue %s\n", (const char *)stringValue));
     if (!xmlStrEqual(stringValue, BAD_CAST("Themed")))
     {
-      try
-      {
-        Colour tmpColour = xmlStringToColour(stringValue);
-        value = tmpColour;
-      }
-      catch (const XmlParserException &)
-      {
-        xmlFree(stringValue);
-        throw XmlParserException();
-      }
+      Colour tmpColour = xmlStringToColour(stringValue);
+      value = tmpColour;
     }
-    xmlFree(stringValue);
     return 1;
   }
   return -1;
@@ -2138,7 +2225,7 @@ int libvisio::VSDXMLParserBase::readColourData(Colour &value, xmlTextReaderPtr r
 
 int libvisio::VSDXMLParserBase::readExtendedColourData(Colour &value, long &idx, xmlTextReaderPtr reader)
 {
-  xmlChar *stringValue = readStringData(reader);
+  const xmlChar *stringValue = readStringData(reader);
   if (stringValue)
   {
     VSD_DEBUG_MSG(("VSDXMLParserBase::readColourData stringValue %s\n", (const char *)stringValue));
@@ -2161,7 +2248,6 @@ int libvisio::VSDXMLParserBase::readExtendedColourData(Colour &value, long &idx,
           idx = -1;
       }
     }
-    xmlFree(stringValue);
     return 1;
   }
   return -1;
@@ -2184,12 +2270,9 @@ int libvisio::VSDXMLParserBase::readExtendedColourData(Colour &value, xmlTextRea
 unsigned libvisio::VSDXMLParserBase::getIX(xmlTextReaderPtr reader)
 {
   unsigned ix = MINUS_ONE;
-  xmlChar *ixString = xmlTextReaderGetAttribute(reader, BAD_CAST("IX"));
+  const xmlChar *ixString = getConstAttribute(reader, "IX");
   if (ixString)
-  {
     ix = (unsigned)xmlStringToLong(ixString);
-    xmlFree(ixString);
-  }
   return ix;
 }
 
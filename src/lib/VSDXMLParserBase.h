@@ -34,6 +34,7 @@
 #include <stack>
 #include <string>
 #include <boost/optional.hpp>
+#include <libvisio/libvisio.h>
 #include "VSDXMLHelper.h"
 #include "VSDCharacterList.h"
 #include "VSDParagraphList.h"
@@ -45,6 +46,28 @@ namespace libvisio
 
 class VSDCollector;
 
+// Within one xmlTextReader, element names are interned in the dictionary of
+// the reader, so the same name always comes as the same pointer. This maps
+// those pointers to tokens, falling back to the token map on a miss.
+class VSDXMLTokenCache
+{
+public:
+  VSDXMLTokenCache();
+  void reset();
+  int getTokenId(xmlTextReaderPtr reader);
+
+private:
+  enum { VSD_TOKEN_CACHE_SIZE = 256 };
+  struct Entry
+  {
+    const xmlChar *name;
+    int tokenId;
+  };
+
+  Entry m_entries[VSD_TOKEN_CACHE_SIZE];
+  xmlTextReaderPtr m_reader;
+};
+
 class VSDXMLParserBase
 {
 public:
@@ -52,6 +75,8 @@ public:
   virtual ~VSDXMLParserBase();
   virtual bool parseMain() = 0;
   virtual bool extractStencils() = 0;
+  void setRenderingOptions(const VSDRenderingOptions &options);
+  unsigned getExceededLimits() const;
 
 protected:
   // Protected data
@@ -78,6 +103,8 @@ protected:
   unsigned m_currentGeometryListIndex;
 
   std::map<unsigned, VSDName> m_fonts;
+  VSDXMLTokenCache m_tokenCache;
+  VSDRenderingOptions m_options;
 
   // Helper functions
 
@@ -97,13 +124,18 @@ protected:
   int readNURBSData(boost::optional<NURBSData> &data, xmlTextReaderPtr reader);
   int readPolylineData(boost::optional<PolylineData> &data, xmlTextReaderPtr reader);
 
-  virtual xmlChar *readStringData(xmlTextReaderPtr reader) = 0;
+  // the value is owned by the parser and valid until the next read
+  virtual const xmlChar *readStringData(xmlTextReaderPtr reader) = 0;
   unsigned getIX(xmlTextReaderPtr reader);
   virtual void _handleLevelChange(unsigned level);
   void _flushShape();
 
   virtual int getElementToken(xmlTextReaderPtr reader) = 0;
   virtual int getElementDepth(xmlTextReaderPtr reader) = 0;
+  // moving to the next node and its type; parsers that do not get every
+  // node from the reader override them
+  virtual int readNextNode(xmlTextReaderPtr reader);
+  virtual int getNodeType(xmlTextReaderPtr reader);
 
   // Functions reading the DiagramML document content
 
@@ -137,6 +169,9 @@ protected:
   void readSplineKnot(xmlTextReaderPtr reader);
 
   void readStencil(xmlTextReaderPtr reader);
+  // Makes sure that the master with the given ID is in m_stencils before
+  // it is used; parsers that read masters on demand override it.
+  virtual void loadStencil(unsigned /* id */) {}
 
   void handlePagesStart(xmlTextReaderPtr reader);
   void handlePagesEnd(xmlTextReaderPtr reader);
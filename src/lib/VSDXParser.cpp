@@ -36,38 +36,35 @@
 #include "libvisio_utils.h"
 #include "VSDContentCollector.h"
 #include "VSDStylesCollector.h"
+#include "VSDInternalStream.h"
+#include "VSDXCellScanner.h"
 #include "VSDZipStream.h"
 #include "VSDXMLHelper.h"
 #include "VSDXMLTokenMap.h"
 
 namespace
 {
-static std::string getTargetBaseDirectory(const char *target)
-{
-  std::string str(target);
-  std::string::size_type position = str.find_last_of('/');
-  if (position == std::string::npos)
-    position = 0;
-  str.erase(position ? position+1 : position);
-  return str;
-}
 
-std::string getRelationshipsForTarget(const char *target)
+// The foreign data format of a bitmap part of the given content type, or
+// 255 if the content type does not tell
+static unsigned getBitmapFormat(const std::string &contentType)
 {
-  std::string relStr(target ? target : "");
-  std::string::size_type position = relStr.find_last_of('/');
-  if (position == std::string::npos)
-    position = 0;
-  relStr.insert(position ? position+1 : position, "_rels/");
-  relStr.append(".rels");
-  return relStr;
+  if (contentType == "image/jpeg")
+    return 1;
+  if (contentType == "image/gif")
+    return 2;
+  if (contentType == "image/tiff")
+    return 3;
+  if (contentType == "image/png")
+    return 4;
+  return 255;
 }
 
 } // anonymous namespace
 
-
 libvisio::VSDXParser::VSDXParser(WPXInputStream *input, libwpg::WPGPaintInterface *painter)
-  : VSDXMLParserBase(), m_input(input), m_painter(painter), m_currentDepth(0), m_rels(0)
+  : VSDXMLParserBase(), m_input(0), m_package(0), m_painter(painter), m_currentDepth(0), m_rels(0),
+    m_masterParts(), m_parentParser(0), m_ownsInput(true), m_fastCellReading(false), m_cellScanner(0)
 {
   input->seek(0, WPX_SEEK_CUR);
   m_input = new VSDZipStream(input);
@@ -77,56 +74,66 @@ libvisio::VSDXParser::VSDXParser(WPXInputStream *input, libwpg::WPGPaintInterfac
       delete m_input;
     m_input = 0;
   }
+  else
+    m_package = new VSDXPackage(m_input);
+}
+
+// Parser of a single master part, borrowing the package of the parser
+// that references the master.
+libvisio::VSDXParser::VSDXParser(VSDZipStream *input, VSDXPackage *package)
+  : VSDXMLParserBase(), m_input(input), m_package(package), m_painter(0), m_currentDepth(0), m_rels(0),
+    m_masterParts(), m_parentParser(0), m_ownsInput(false), m_fastCellReading(false), m_cellScanner(0)
+{
 }
 
 libvisio::VSDXParser::~VSDXParser()
 {
+  if (!m_ownsInput)
+    return;
+  if (m_package)
+    delete m_package;
   if (m_input)
     delete m_input;
 }
 
 bool libvisio::VSDXParser::parseMain()
 {
-  if (!m_input)
+  if (!m_input || !m_package)
     return false;
 
-  WPXInputStream *tmpInput = 0;
   try
   {
-    tmpInput = m_input->getDocumentOLEStream("_rels/.rels");
-    if (!tmpInput)
-      return false;
-
-    libvisio::VSDXRelationships rootRels(tmpInput);
-    delete tmpInput;
-
     // Check whether the relationship points to a Visio document stream
-    const libvisio::VSDXRelationship *rel = rootRels.getRelationshipByType("http://schemas.microsoft.com/visio/2010/relationships/document");
+    const libvisio::VSDXRelationship *rel = m_package->getRootRelationships().getRelationshipByType(VSDX_REL_DOCUMENT);
     if (!rel)
       return false;
 
-    std::vector<std::map<unsigned, XForm> > groupXFormsSequence;
-    std::vector<std::map<unsigned, unsigned> > groupMembershipsSequence;
-    std::vector<std::list<unsigned> > documentPageShapeOrders;
+    // The parts that both passes read are inflated in one go. Masters, when
+    // rendering, and images and OLE objects are read once, so they are not.
+    std::vector<std::string> parts(1, rel->getTarget());
+    m_package->getTargets(parts, VSDX_REL_THEME);
+    m_package->getTargets(parts, VSDX_REL_MASTERS);
+    m_package->getTargets(parts, VSDX_REL_PAGES);
+    m_package->getTargets(parts, m_extractStencils ? VSDX_REL_MASTER : VSDX_REL_PAGE);
+    m_input->prefetch(parts);
+
+    std::vector<VSDShapeTable> documentShapeTables;
 
-    VSDStylesCollector stylesCollector(groupXFormsSequence, groupMembershipsSequence, documentPageShapeOrders);
+    VSDStylesCollector stylesCollector(documentShapeTables);
     m_collector = &stylesCollector;
     if (!parseDocument(m_input, rel->getTarget().c_str()))
       return false;
 
     VSDStyles styles = stylesCollector.getStyleSheets();
 
-    VSDContentCollector contentCollector(m_painter, groupXFormsSequence, groupMembershipsSequence, documentPageShapeOrders, styles, m_stencils);
+    VSDContentCollector contentCollector(m_painter, documentShapeTables, styles, m_stencils, m_options);
     m_collector = &contentCollector;
-    if (!parseDocument(m_input, rel->getTarget().c_str()))
-      return false;
-
-    return true;
+    const bool isParsed = parseDocument(m_input, rel->getTarget().c_str());
+    m_options.setExceededLimits(contentCollector.getExceededLimits());
+    return isParsed;
   }
   catch (...)
   {
-    if (tmpInput)
-      delete tmpInput;
     return false;
   }
 }
@@ -148,17 +155,12 @@ bool libvisio::VSDXParser::parseDocument(WPXInputStream *input, const char *name
   input->seek(0, WPX_SEEK_SET);
   if (!stream)
     return false;
-  WPXInputStream *relStream = input->getDocumentOLEStream(getRelationshipsForTarget(name).c_str());
-  input->seek(0, WPX_SEEK_SET);
-  VSDXRelationships rels(relStream);
-  if (relStream)
-    delete relStream;
-  rels.rebaseTargets(getTargetBaseDirectory(name).c_str());
+  const VSDXRelationships &rels = m_package->getRelationships(name);
 
-  const VSDXRelationship *rel = rels.getRelationshipByType("http://schemas.openxmlformats.org/officeDocument/2006/relationships/theme");
+  const VSDXRelationship *rel = rels.getRelationshipByType(VSDX_REL_THEME);
   if (rel)
   {
-    if (!parseTheme(input, rel->getTarget().c_str()))
+    if (!parsePart(input, rel->getTarget().c_str()))
     {
       VSD_DEBUG_MSG(("Could not parse theme\n"));
     }
@@ -167,20 +169,22 @@ bool libvisio::VSDXParser::parseDocument(WPXInputStream *input, const char *name
 
   processXmlDocument(stream, rels);
 
-  rel = rels.getRelationshipByType("http://schemas.microsoft.com/visio/2010/relationships/masters");
+  rel = rels.getRelationshipByType(VSDX_REL_MASTERS);
   if (rel)
   {
-    if (!parseMasters(input, rel->getTarget().c_str()))
+    if (!parsePart(input, rel->getTarget().c_str()))
     {
       VSD_DEBUG_MSG(("Could not parse masters\n"));
     }
     input->seek(0, WPX_SEEK_SET);
   }
 
-  rel = rels.getRelationshipByType("http://schemas.microsoft.com/visio/2010/relationships/pages");
+  // Stencils are extracted from the masters alone, so the pages part and
+  // everything it refers to are not even opened.
+  rel = m_extractStencils ? 0 : rels.getRelationshipByType(VSDX_REL_PAGES);
   if (rel)
   {
-    if (!parsePages(input, rel->getTarget().c_str()))
+    if (!parsePart(input, rel->getTarget().c_str()))
     {
       VSD_DEBUG_MSG(("Could not parse pages\n"));
     }
@@ -192,7 +196,7 @@ bool libvisio::VSDXParser::parseDocument(WPXInputStream *input, const char *name
   return true;
 }
 
-bool libvisio::VSDXParser::parseMasters(WPXInputStream *input, const char *name)
+bool libvisio::VSDXParser::parsePart(WPXInputStream *input, const char *name)
 {
   if (!input)
     return false;
@@ -200,128 +204,56 @@ bool libvisio::VSDXParser::parseMasters(WPXInputStream *input, const char *name)
   if (!input->isOLEStream())
     return false;
   WPXInputStream *stream = input->getDocumentOLEStream(name);
-  if (!stream)
-    return false;
-  WPXInputStream *relStream = input->getDocumentOLEStream(getRelationshipsForTarget(name).c_str());
   input->seek(0, WPX_SEEK_SET);
-  VSDXRelationships rels(relStream);
-  if (relStream)
-    delete relStream;
-  rels.rebaseTargets(getTargetBaseDirectory(name).c_str());
-
-  processXmlDocument(stream, rels);
-
-  delete stream;
-  return true;
-}
-
-bool libvisio::VSDXParser::parseMaster(WPXInputStream *input, const char *name)
-{
-  if (!input)
-    return false;
-  input->seek(0, WPX_SEEK_SET);
-  if (!input->isOLEStream())
-    return false;
-  WPXInputStream *stream = input->getDocumentOLEStream(name);
   if (!stream)
     return false;
-  WPXInputStream *relStream = input->getDocumentOLEStream(getRelationshipsForTarget(name).c_str());
-  input->seek(0, WPX_SEEK_SET);
-  VSDXRelationships rels(relStream);
-  if (relStream)
-    delete relStream;
-  rels.rebaseTargets(getTargetBaseDirectory(name).c_str());
 
-  processXmlDocument(stream, rels);
+  processXmlDocument(stream, m_package->getRelationships(name));
 
   delete stream;
   return true;
 }
 
-bool libvisio::VSDXParser::parsePages(WPXInputStream *input, const char *name)
-{
-  if (!input)
-    return false;
-  input->seek(0, WPX_SEEK_SET);
-  if (!input->isOLEStream())
-    return false;
-  WPXInputStream *stream = input->getDocumentOLEStream(name);
-  if (!stream)
-    return false;
-  WPXInputStream *relStream = input->getDocumentOLEStream(getRelationshipsForTarget(name).c_str());
-  input->seek(0, WPX_SEEK_SET);
-  VSDXRelationships rels(relStream);
-  if (relStream)
-    delete relStream;
-  rels.rebaseTargets(getTargetBaseDirectory(name).c_str());
-
-  processXmlDocument(stream, rels);
-
-  delete stream;
-  return true;
-}
-
-bool libvisio::VSDXParser::parsePage(WPXInputStream *input, const char *name)
-{
-  if (!input)
-    return false;
-  input->seek(0, WPX_SEEK_SET);
-  if (!input->isOLEStream())
-    return false;
-  WPXInputStream *stream = input->getDocumentOLEStream(name);
-  if (!stream)
-    return false;
-  WPXInputStream *relStream = input->getDocumentOLEStream(getRelationshipsForTarget(name).c_str());
-  input->seek(0, WPX_SEEK_SET);
-  VSDXRelationships rels(relStream);
-  if (relStream)
-    delete relStream;
-  rels.rebaseTargets(getTargetBaseDirectory(name).c_str());
-
-  processXmlDocument(stream, rels);
-
-  delete stream;
-  return true;
-}
-
-bool libvisio::VSDXParser::parseTheme(WPXInputStream *input, const char *name)
-{
-  if (!input)
-    return false;
-  input->seek(0, WPX_SEEK_SET);
-  if (!input->isOLEStream())
-    return false;
-  WPXInputStream *stream = input->getDocumentOLEStream(name);
-  if (!stream)
-    return false;
-  WPXInputStream *relStream = input->getDocumentOLEStream(getRelationshipsForTarget(name).c_str());
-  input->seek(0, WPX_SEEK_SET);
-  VSDXRelationships rels(relStream);
-  if (relStream)
-    delete relStream;
-  rels.rebaseTargets(getTargetBaseDirectory(name).c_str());
-
-  processXmlDocument(stream, rels);
-
-  delete stream;
-  return true;
-}
-
-void libvisio::VSDXParser::processXmlDocument(WPXInputStream *input, VSDXRelationships &rels)
+void libvisio::VSDXParser::processXmlDocument(WPXInputStream *input, const VSDXRelationships &rels)
 {
   if (!input)
     return;
 
   m_rels = &rels;
 
-  xmlTextReaderPtr reader = xmlReaderForStream(input, 0, 0, XML_PARSE_NOBLANKS|XML_PARSE_NOENT|XML_PARSE_NONET);
+  // The plain cells of a part that is in memory may be read by the cell
+  // scanner, and the rest of the part by libxml2. Parts are read within
+  // parts, so the scanner of the enclosing part is put back at the end.
+  VSDXCellScanner cellScanner;
+  xmlTextReaderPtr reader = 0;
+  VSDInternalStream *memoryInput = m_fastCellReading ? dynamic_cast<VSDInternalStream *>(input) : 0;
+  if (memoryInput)
+  {
+    const long offset = memoryInput->tell();
+    unsigned long numBytesRead = 0;
+    const unsigned char *buffer = memoryInput->read(memoryInput->getSize() - offset, numBytesRead);
+    if (buffer && numBytesRead && cellScanner.scan(buffer, numBytesRead))
+      reader = cellScanner.createReader(XML_PARSE_NOBLANKS|XML_PARSE_NOENT|XML_PARSE_NONET);
+    if (!reader)
+      memoryInput->seek(offset, WPX_SEEK_SET);
+  }
+  VSDXCellScanner *const enclosingCellScanner = m_cellScanner;
+  m_cellScanner = reader ? &cellScanner : 0;
+
+  if (!reader)
+    reader = xmlReaderForStream(input, 0, 0, XML_PARSE_NOBLANKS|XML_PARSE_NOENT|XML_PARSE_NONET);
   if (!reader)
+  {
+    m_cellScanner = enclosingCellScanner;
     return;
-  int ret = xmlTextReaderRead(reader);
+  }
+  // a new reader may reuse the addresses of a freed one
+  m_tokenCache.reset();
+  int ret = readNextNode(reader);
   while (1 == ret)
   {
-    int tokenId = VSDXMLTokenMap::getTokenId(xmlTextReaderConstName(reader));
-    int tokenType = xmlTextReaderNodeType(reader);
+    int tokenId = m_tokenCache.getTokenId(reader);
+    int tokenType = getNodeType(reader);
 
     switch (tokenId)
     {
@@ -334,25 +266,29 @@ void libvisio::VSDXParser::processXmlDocument(WPXInputStream *input, VSDXRelatio
           const VSDXRelationship *rel = rels.getRelationshipById((char *)id);
           if (rel)
           {
-            std::string type = rel->getType();
-            if (type == "http://schemas.microsoft.com/visio/2010/relationships/master")
-            {
-              m_currentDepth += xmlTextReaderDepth(reader);
-              parseMaster(m_input, rel->getTarget().c_str());
-              m_currentDepth -= xmlTextReaderDepth(reader);
-            }
-            else if (type == "http://schemas.microsoft.com/visio/2010/relationships/page")
+            switch (rel->getTypeId())
             {
+            case VSDX_REL_MASTER:
+              if (m_isStencilStarted && !m_extractStencils)
+              {
+                // Only remember where the master is; it is parsed by
+                // loadStencil when a shape refers to it for the first time.
+                m_masterParts[m_currentStencilID] = std::make_pair(rel->getTarget(), m_currentDepth + xmlTextReaderDepth(reader));
+                break;
+              }
+            // fall through
+            case VSDX_REL_PAGE:
               m_currentDepth += xmlTextReaderDepth(reader);
-              parsePage(m_input, rel->getTarget().c_str());
+              parsePart(m_input, rel->getTarget().c_str());
               m_currentDepth -= xmlTextReaderDepth(reader);
-            }
-            else if (type == "http://schemas.openxmlformats.org/officeDocument/2006/relationships/image")
-            {
+              break;
+            case VSDX_REL_IMAGE:
               extractBinaryData(m_input, rel->getTarget().c_str());
-            }
-            else
+              break;
+            default:
               processXmlNode(reader);
+              break;
+            }
           }
           xmlFree(id);
         }
@@ -362,9 +298,10 @@ void libvisio::VSDXParser::processXmlDocument(WPXInputStream *input, VSDXRelatio
       processXmlNode(reader);
       break;
     }
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
   }
   xmlFreeTextReader(reader);
+  m_cellScanner = enclosingCellScanner;
 }
 
 void libvisio::VSDXParser::processXmlNode(xmlTextReaderPtr reader)
@@ -372,7 +309,7 @@ void libvisio::VSDXParser::processXmlNode(xmlTextReaderPtr reader)
   if (!reader)
     return;
   int tokenId = getElementToken(reader);
-  int tokenType = xmlTextReaderNodeType(reader);
+  int tokenType = getNodeType(reader);
   _handleLevelChange((unsigned)getElementDepth(reader));
   switch (tokenId)
   {
@@ -497,7 +434,7 @@ void libvisio::VSDXParser::processXmlNode(xmlTextReaderPtr reader)
 #ifdef DEBUG
   const xmlChar *name = xmlTextReaderConstName(reader);
   const xmlChar *value = xmlTextReaderConstValue(reader);
-  int type = xmlTextReaderNodeType(reader);
+  int type = getNodeType(reader);
   int isEmptyElement = xmlTextReaderIsEmptyElement(reader);
 
   for (int i=0; i<getElementDepth(reader); ++i)
@@ -505,7 +442,7 @@ void libvisio::VSDXParser::processXmlNode(xmlTextReaderPtr reader)
     VSD_DEBUG_MSG((" "));
   }
   VSD_DEBUG_MSG(("%i %i %s", isEmptyElement, type, name ? (const char *)name : ""));
-  if (xmlTextReaderNodeType(reader) == 1)
+  if (getNodeType(reader) == 1)
   {
     while (xmlTextReaderMoveToNextAttribute(reader))
     {
@@ -524,6 +461,49 @@ void libvisio::VSDXParser::processXmlNode(xmlTextReaderPtr reader)
 #endif
 }
 
+void libvisio::VSDXParser::loadStencil(unsigned id)
+{
+  // A master that is an instance of another master gets it from the
+  // parser owning the masters, which loads it if it was not read yet
+  if (m_parentParser)
+  {
+    if (m_stencils.getStencil(id))
+      return;
+    m_parentParser->loadStencil(id);
+    const VSDStencil *stencil = m_parentParser->m_stencils.getStencil(id);
+    if (stencil)
+      m_stencils.addStencil(id, *stencil);
+    return;
+  }
+
+  std::map<unsigned, std::pair<std::string, int> >::iterator iter = m_masterParts.find(id);
+  if (iter == m_masterParts.end())
+    return;
+  const std::string name = iter->second.first;
+  const int depth = iter->second.second;
+  m_masterParts.erase(iter);
+
+  // The master is parsed by a parser of its own, so that the state of the
+  // shape being read is left alone; the level changes go to a scratch
+  // collector.
+  std::vector<VSDShapeTable> documentShapeTables;
+  VSDStylesCollector stylesCollector(documentShapeTables);
+
+  VSDXParser masterParser(m_input, m_package);
+  masterParser.m_parentParser = this;
+  masterParser.m_collector = &stylesCollector;
+  masterParser.m_colours = m_colours;
+  masterParser.m_fonts = m_fonts;
+  masterParser.m_fastCellReading = m_fastCellReading;
+  masterParser.m_currentDepth = depth;
+  masterParser.m_isStencilStarted = true;
+  masterParser.m_currentStencilID = id;
+  const VSDStencil *stencil = m_stencils.getStencil(id);
+  masterParser.m_currentStencil = stencil ? new VSDStencil(*stencil) : new VSDStencil();
+  if (masterParser.parsePart(m_input, name.c_str()))
+    m_stencils.addStencil(id, *masterParser.m_currentStencil);
+}
+
 #define VSDX_DATA_READ_SIZE 4096UL
 
 void libvisio::VSDXParser::extractBinaryData(WPXInputStream *input, const char *name)
@@ -548,9 +528,11 @@ void libvisio::VSDXParser::extractBinaryData(WPXInputStream *input, const char *
   VSD_DEBUG_MSG(("%s\n", m_currentBinaryData.getBase64Data().cstr()));
 }
 
-xmlChar *libvisio::VSDXParser::readStringData(xmlTextReaderPtr reader)
+const xmlChar *libvisio::VSDXParser::readStringData(xmlTextReaderPtr reader)
 {
-  xmlChar *stringValue = xmlTextReaderGetAttribute(reader, BAD_CAST("V"));
+  if (m_cellScanner && m_cellScanner->isInRun())
+    return m_cellScanner->getValue();
+  const xmlChar *stringValue = getConstAttribute(reader, "V");
   if (stringValue)
   {
     VSD_DEBUG_MSG(("VSDXParser::readStringData stringValue %s\n", (const char *)stringValue));
@@ -561,44 +543,40 @@ xmlChar *libvisio::VSDXParser::readStringData(xmlTextReaderPtr reader)
 
 int libvisio::VSDXParser::getElementToken(xmlTextReaderPtr reader)
 {
-  int tokenId = VSDXMLTokenMap::getTokenId(xmlTextReaderConstName(reader));
-  if (XML_READER_TYPE_END_ELEMENT == xmlTextReaderNodeType(reader))
-    return tokenId;
+  int elementToken = XML_TOKEN_INVALID;
+  return getElementToken(reader, elementToken);
+}
 
-  xmlChar *stringValue = 0;
+// Cells, rows and sections are identified by their N (or T) attribute;
+// elementToken gets the token of the element name itself.
+int libvisio::VSDXParser::getElementToken(xmlTextReaderPtr reader, int &elementToken)
+{
+  if (m_cellScanner && m_cellScanner->isInRun())
+  {
+    elementToken = XML_CELL;
+    return m_cellScanner->getTokenId();
+  }
+  elementToken = m_tokenCache.getTokenId(reader);
+  if (XML_READER_TYPE_END_ELEMENT == getNodeType(reader))
+    return elementToken;
 
-  switch (tokenId)
+  const xmlChar *stringValue = 0;
+
+  switch (elementToken)
   {
   case XML_CELL:
-    stringValue = xmlTextReaderGetAttribute(reader, BAD_CAST("N"));
-    if (stringValue)
-    {
-      tokenId = VSDXMLTokenMap::getTokenId(stringValue);
-      xmlFree(stringValue);
-    }
-    return tokenId;
+  case XML_SECTION:
+    stringValue = getConstAttribute(reader, "N");
+    break;
   case XML_ROW:
-    stringValue = xmlTextReaderGetAttribute(reader, BAD_CAST("N"));
+    stringValue = getConstAttribute(reader, "N");
     if (!stringValue)
-      stringValue = xmlTextReaderGetAttribute(reader, BAD_CAST("T"));
-    if (stringValue)
-    {
-      tokenId = VSDXMLTokenMap::getTokenId(stringValue);
-      xmlFree(stringValue);
-    }
-    return tokenId;
-  case XML_SECTION:
-    stringValue = xmlTextReaderGetAttribute(reader, BAD_CAST("N"));
-    if (stringValue)
-    {
-      tokenId = VSDXMLTokenMap::getTokenId(stringValue);
-      xmlFree(stringValue);
-    }
-    return tokenId;
+      stringValue = getConstAttribute(reader, "T");
+    break;
   default:
     break;
   }
-  return tokenId;
+  return stringValue ? VSDXMLTokenMap::getTokenId(stringValue) : elementToken;
 }
 
 void libvisio::VSDXParser::readPageSheetProperties(xmlTextReaderPtr reader)
@@ -616,13 +594,14 @@ void libvisio::VSDXParser::readPageSheetProperties(xmlTextReaderPtr reader)
   int tokenType = -1;
   do
   {
-    ret = xmlTextReaderRead(reader);
-    tokenId = getElementToken(reader);
+    ret = readNextNode(reader);
+    int tokenClass = XML_TOKEN_INVALID;
+    tokenId = getElementToken(reader, tokenClass);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXParser::readPageSheetProperties: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
     switch (tokenId)
     {
     case XML_PAGEWIDTH:
@@ -656,7 +635,10 @@ void libvisio::VSDXParser::readPageSheetProperties(xmlTextReaderPtr reader)
     case XML_SHDWTYPE:
     case XML_SHDWOBLIQUEANGLE:
     case XML_SHDWSCALEFACTOR:
+      break;
     default:
+      if (XML_SECTION == tokenClass && XML_READER_TYPE_ELEMENT == tokenType)
+        ret = skipSection(reader);
       break;
     }
   }
@@ -683,13 +665,13 @@ void libvisio::VSDXParser::readFonts(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXParser::readFonts: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
 
     if (XML_FACENAME == tokenId && XML_READER_TYPE_ELEMENT == tokenType)
     {
@@ -745,13 +727,14 @@ void libvisio::VSDXParser::readStyleProperties(xmlTextReaderPtr reader)
   int tokenType = -1;
   do
   {
-    ret = xmlTextReaderRead(reader);
-    tokenId = getElementToken(reader);
+    ret = readNextNode(reader);
+    int tokenClass = XML_TOKEN_INVALID;
+    tokenId = getElementToken(reader, tokenClass);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXParser::readLine: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
     switch (tokenId)
     {
     case XML_LINEWEIGHT:
@@ -866,7 +849,10 @@ void libvisio::VSDXParser::readStyleProperties(xmlTextReaderPtr reader)
     case XML_SHAPESHDWOBLIQUEANGLE:
     case XML_SHAPESHDWSCALEFACTOR:
     case XML_TEXTBKGNDTRANS:
+      break;
     default:
+      if (XML_SECTION == tokenClass && XML_READER_TYPE_ELEMENT == tokenType)
+        ret = skipSection(reader);
       break;
     }
   }
@@ -918,14 +904,14 @@ void libvisio::VSDXParser::readShapeProperties(xmlTextReaderPtr reader)
   int tokenType = -1;
   do
   {
-    ret = xmlTextReaderRead(reader);
-    tokenId = getElementToken(reader);
-    int tokenClass = VSDXMLTokenMap::getTokenId(xmlTextReaderConstName(reader));
+    ret = readNextNode(reader);
+    int tokenClass = XML_TOKEN_INVALID;
+    tokenId = getElementToken(reader, tokenClass);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXParser::readShapeProperties: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
     switch (tokenId)
     {
     case XML_PINX:
@@ -1206,13 +1192,13 @@ void libvisio::VSDXParser::readParagraph(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXParser::readParagraph: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
     if (XML_ROW == tokenId && XML_READER_TYPE_ELEMENT == tokenType)
       readParaIX(reader);
   }
@@ -1227,13 +1213,13 @@ void libvisio::VSDXParser::readCharacter(xmlTextReaderPtr reader)
 
   do
   {
-    ret = xmlTextReaderRead(reader);
+    ret = readNextNode(reader);
     tokenId = getElementToken(reader);
     if (XML_TOKEN_INVALID == tokenId)
     {
       VSD_DEBUG_MSG(("VSDXParser::readCharacter: unknown token %s\n", xmlTextReaderConstName(reader)));
     }
-    tokenType = xmlTextReaderNodeType(reader);
+    tokenType = getNodeType(reader);
     if (XML_ROW == tokenId && XML_READER_TYPE_ELEMENT == tokenType)
       readCharIX(reader);
   }
@@ -1242,10 +1228,12 @@ void libvisio::VSDXParser::readCharacter(xmlTextReaderPtr reader)
 
 void libvisio::VSDXParser::getBinaryData(xmlTextReaderPtr reader)
 {
-  const int ret = xmlTextReaderRead(reader);
-  int tokenId = VSDXMLTokenMap::getTokenId(xmlTextReaderConstName(reader));
-  int tokenType = xmlTextReaderNodeType(reader);
+  const int ret = readNextNode(reader);
+  int tokenId = m_tokenCache.getTokenId(reader);
+  int tokenType = getNodeType(reader);
 
+  if (!m_shape.m_foreign)
+    m_shape.m_foreign = new ForeignData();
   m_currentBinaryData.clear();
   if (1 == ret && XML_REL == tokenId && XML_READER_TYPE_ELEMENT == tokenType)
   {
@@ -1255,31 +1243,43 @@ void libvisio::VSDXParser::getBinaryData(xmlTextReaderPtr reader)
       const VSDXRelationship *rel = m_rels->getRelationshipById((char *)id);
       if (rel)
       {
-        if ("http://schemas.openxmlformats.org/officeDocument/2006/relationships/image" == rel->getType()
-            || "http://schemas.openxmlformats.org/officeDocument/2006/relationships/oleObject" == rel->getType())
+        if (VSDX_REL_IMAGE == rel->getTypeId() || VSDX_REL_OLE_OBJECT == rel->getTypeId())
           extractBinaryData(m_input, rel->getTarget().c_str());
+        // Bitmaps without a CompressionType are told apart by the content
+        // type of their part
+        if (VSDX_REL_IMAGE == rel->getTypeId() && m_shape.m_foreign->format == 255)
+          m_shape.m_foreign->format = getBitmapFormat(m_package->getContentType(rel->getTarget()));
       }
       xmlFree(id);
     }
   }
-  if (!m_shape.m_foreign)
-    m_shape.m_foreign = new ForeignData();
   m_shape.m_foreign->data = m_currentBinaryData;
 }
 
 int libvisio::VSDXParser::skipSection(xmlTextReaderPtr reader)
 {
-  int ret = 1;
-  int tokenId = XML_TOKEN_INVALID;
-  int tokenType = -1;
-  do
-  {
-    ret = xmlTextReaderRead(reader);
-    tokenId = getElementToken(reader);
-    tokenType = xmlTextReaderNodeType(reader);
-  }
-  while ((XML_SECTION != tokenId || XML_READER_TYPE_END_ELEMENT != tokenType) && 1 == ret);
+  return skipElement(reader);
+}
+
+// Within a run of plain cells, the reader stays on the placeholder of the
+// run while the cells are taken from the cell scanner.
+int libvisio::VSDXParser::readNextNode(xmlTextReaderPtr reader)
+{
+  if (!m_cellScanner)
+    return xmlTextReaderRead(reader);
+  if (m_cellScanner->nextCell())
+    return 1;
+  int ret = xmlTextReaderRead(reader);
+  if (1 == ret)
+    m_cellScanner->startRun(reader);
   return ret;
 }
 
+int libvisio::VSDXParser::getNodeType(xmlTextReaderPtr reader)
+{
+  if (m_cellScanner && m_cellScanner->isInRun())
+    return XML_READER_TYPE_ELEMENT;
+  return xmlTextReaderNodeType(reader);
+}
+
 /* vim:set shiftwidth=2 softtabstop=2 expandtab: */
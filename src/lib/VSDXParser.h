@@ -38,6 +38,8 @@ namespace libvisio
 {
 
 class VSDCollector;
+class VSDXCellScanner;
+class VSDZipStream;
 
 class VSDXParser : public VSDXMLParserBase
 {
@@ -51,31 +53,38 @@ public:
   virtual ~VSDXParser();
   bool parseMain();
   bool extractStencils();
+  // Reads the plain cells of the parts with a VSDXCellScanner, and only
+  // the rest of them with libxml2
+  void setFastCellReading(bool fast)
+  {
+    m_fastCellReading = fast;
+  }
 
 private:
+  VSDXParser(VSDZipStream *input, VSDXPackage *package);
   VSDXParser();
   VSDXParser(const VSDXParser &);
   VSDXParser &operator=(const VSDXParser &);
 
   // Helper functions
 
-  xmlChar *readStringData(xmlTextReaderPtr reader);
+  const xmlChar *readStringData(xmlTextReaderPtr reader);
 
   int getElementToken(xmlTextReaderPtr reader);
+  int getElementToken(xmlTextReaderPtr reader, int &elementToken);
   int getElementDepth(xmlTextReaderPtr reader);
+  int readNextNode(xmlTextReaderPtr reader);
+  int getNodeType(xmlTextReaderPtr reader);
 
   int skipSection(xmlTextReaderPtr reader);
 
   // Functions parsing the Visio 2013 OPC document structure
 
   bool parseDocument(WPXInputStream *input, const char *name);
-  bool parseMasters(WPXInputStream *input, const char *name);
-  bool parseMaster(WPXInputStream *input, const char *name);
-  bool parsePages(WPXInputStream *input, const char *name);
-  bool parsePage(WPXInputStream *input, const char *name);
-  bool parseTheme(WPXInputStream *input, const char *name);
-  void processXmlDocument(WPXInputStream *input, VSDXRelationships &rels);
+  bool parsePart(WPXInputStream *input, const char *name);
+  void processXmlDocument(WPXInputStream *input, const VSDXRelationships &rels);
   void processXmlNode(xmlTextReaderPtr reader);
+  void loadStencil(unsigned id);
 
   // Functions reading the Visio 2013 OPC document content
 
@@ -95,10 +104,19 @@ private:
 
   // Private data
 
-  WPXInputStream *m_input;
+  VSDZipStream *m_input;
+  VSDXPackage *m_package;
   libwpg::WPGPaintInterface *m_painter;
   int m_currentDepth;
-  VSDXRelationships *m_rels;
+  const VSDXRelationships *m_rels;
+  // masters that were not read yet: ID -> (part name, depth of its reference)
+  std::map<unsigned, std::pair<std::string, int> > m_masterParts;
+  // the parser that owns the masters, for the parser of a master
+  VSDXParser *m_parentParser;
+  bool m_ownsInput;
+  bool m_fastCellReading;
+  // the scanner of the plain cells of the part being read, if it has any
+  VSDXCellScanner *m_cellScanner;
 };
 
 } // namespace libvisio
@@ -33,6 +33,8 @@
 #include <string.h>
 #include <zlib.h>
 #include <map>
+#include <vector>
+#include <algorithm>
 #include <libwpd-stream/libwpd-stream.h>
 #include "VSDZipStream.h"
 #include "VSDInternalStream.h"
@@ -77,6 +79,14 @@ struct CentralDirectoryEnd
   ~CentralDirectoryEnd() {}
 };
 
+struct EntryOffsetLess
+{
+  bool operator()(const CentralDirectoryEntry *left, const CentralDirectoryEntry *right) const
+  {
+    return left->offset < right->offset;
+  }
+};
+
 } // anonymous namespace
 
 namespace libvisio
@@ -87,13 +97,15 @@ struct VSDZipStreamImpl
   WPXInputStream *m_input;
   unsigned m_cdir_offset;
   std::map<std::string, CentralDirectoryEntry> m_cdir;
+  std::map<std::string, std::vector<unsigned char> > m_prefetched;
   bool m_initialized;
   VSDZipStreamImpl(WPXInputStream *input)
-    : m_input(input), m_cdir_offset(0), m_cdir(), m_initialized(false) {}
+    : m_input(input), m_cdir_offset(0), m_cdir(), m_prefetched(), m_initialized(false) {}
   ~VSDZipStreamImpl() {}
 
   bool isZipStream();
   WPXInputStream *getSubstream(const char *name);
+  unsigned prefetch(const std::vector<std::string> &names);
 private:
   VSDZipStreamImpl(const VSDZipStreamImpl &);
   VSDZipStreamImpl &operator=(const VSDZipStreamImpl &);
@@ -103,6 +115,8 @@ private:
   bool readCentralDirectory(const CentralDirectoryEnd &end);
   bool readLocalFileHeader(LocalFileHeader &header);
   bool areHeadersConsistent(const LocalFileHeader &header, const CentralDirectoryEntry &entry);
+  std::map<std::string, CentralDirectoryEntry>::const_iterator findEntry(const char *name) const;
+  bool readEntryData(const CentralDirectoryEntry &entry, std::vector<unsigned char> &data);
 };
 
 } // namespace libvisio
@@ -155,6 +169,18 @@ WPXInputStream *libvisio::VSDZipStream::getDocumentOLEStream(const char *name)
   return m_pImpl->getSubstream(name);
 }
 
+unsigned libvisio::VSDZipStream::prefetch()
+{
+  return prefetch(std::vector<std::string>());
+}
+
+unsigned libvisio::VSDZipStream::prefetch(const std::vector<std::string> &names)
+{
+  if (!m_pImpl->isZipStream())
+    return 0;
+  return m_pImpl->prefetch(names);
+}
+
 #define CDIR_ENTRY_SIG 0x02014b50
 #define LOC_FILE_HEADER_SIG 0x04034b50
 #define CDIR_END_SIG 0x06054b50
@@ -263,68 +289,142 @@ bool libvisio::VSDZipStreamImpl::readCentralDirectory(const CentralDirectoryEnd
   return true;
 }
 
-WPXInputStream *libvisio::VSDZipStreamImpl::getSubstream(const char *name)
+std::map<std::string, CentralDirectoryEntry>::const_iterator libvisio::VSDZipStreamImpl::findEntry(const char *name) const
 {
-  if (m_cdir.empty())
-    return 0;
   std::map<std::string, CentralDirectoryEntry>::const_iterator iter = m_cdir.lower_bound(name);
   if (iter == m_cdir.end())
-    return 0;
+    return m_cdir.end();
   if (m_cdir.key_comp()(name, iter->first))
   {
     size_t name_length = strlen(name);
     if (iter->first.compare(0, name_length, name))
-      return 0;
+      return m_cdir.end();
   }
-  CentralDirectoryEntry entry = iter->second;
-  m_input->seek(entry.offset, WPX_SEEK_SET);
-  LocalFileHeader header;
-  if (!readLocalFileHeader(header))
+  return iter;
+}
+
+WPXInputStream *libvisio::VSDZipStreamImpl::getSubstream(const char *name)
+{
+  if (m_cdir.empty())
     return 0;
-  if (!areHeadersConsistent(header, entry))
+  std::map<std::string, CentralDirectoryEntry>::const_iterator iter = findEntry(name);
+  if (iter == m_cdir.end())
     return 0;
+
+  std::map<std::string, std::vector<unsigned char> >::const_iterator cached = m_prefetched.find(iter->first);
+  if (cached != m_prefetched.end())
+    return new VSDInternalStream(&cached->second);
+
+  CentralDirectoryEntry entry = iter->second;
   if (!entry.compression)
+  {
+    m_input->seek(entry.offset, WPX_SEEK_SET);
+    LocalFileHeader header;
+    if (!readLocalFileHeader(header))
+      return 0;
+    if (!areHeadersConsistent(header, entry))
+      return 0;
     return new VSDInternalStream(m_input, entry.compressed_size);
+  }
+  std::vector<unsigned char> data;
+  if (!readEntryData(entry, data))
+    return 0;
+  return new VSDInternalStream(data);
+}
+
+/* Inflates the requested entries (all of them if names is empty) in one
+ * forward sweep over the archive and keeps the results, so that the
+ * getSubstream calls of both parsing passes are served from memory.
+ * Returns the number of entries available from the cache afterwards.
+ */
+unsigned libvisio::VSDZipStreamImpl::prefetch(const std::vector<std::string> &names)
+{
+  std::vector<const CentralDirectoryEntry *> entries;
+  if (names.empty())
+  {
+    for (std::map<std::string, CentralDirectoryEntry>::const_iterator iter = m_cdir.begin(); iter != m_cdir.end(); ++iter)
+      entries.push_back(&iter->second);
+  }
   else
   {
-    int ret;
-    z_stream strm;
-
-    /* allocate inflate state */
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    strm.opaque = Z_NULL;
-    strm.avail_in = 0;
-    strm.next_in = Z_NULL;
-    ret = inflateInit2(&strm,-MAX_WBITS);
-    if (ret != Z_OK)
-      return 0;
+    for (std::vector<std::string>::const_iterator iter = names.begin(); iter != names.end(); ++iter)
+    {
+      std::map<std::string, CentralDirectoryEntry>::const_iterator entryIter = findEntry(iter->c_str());
+      if (entryIter != m_cdir.end())
+        entries.push_back(&entryIter->second);
+    }
+  }
+  // Visit the local headers in the order they are stored, so that the
+  // underlying stream is only ever read forward.
+  std::sort(entries.begin(), entries.end(), EntryOffsetLess());
 
-    unsigned long numBytesRead = 0;
-    const unsigned char *compressedData = m_input->read(entry.compressed_size, numBytesRead);
-    if (numBytesRead != entry.compressed_size)
-      return 0;
+  for (std::vector<const CentralDirectoryEntry *>::const_iterator iter = entries.begin(); iter != entries.end(); ++iter)
+  {
+    const CentralDirectoryEntry &entry = **iter;
+    if (m_prefetched.find(entry.filename) != m_prefetched.end())
+      continue;
+    std::vector<unsigned char> data;
+    if (readEntryData(entry, data))
+      m_prefetched[entry.filename].swap(data);
+  }
+  return m_prefetched.size();
+}
 
-    strm.avail_in = numBytesRead;
-    strm.next_in = (Bytef *)compressedData;
+bool libvisio::VSDZipStreamImpl::readEntryData(const CentralDirectoryEntry &entry, std::vector<unsigned char> &data)
+{
+  m_input->seek(entry.offset, WPX_SEEK_SET);
+  LocalFileHeader header;
+  if (!readLocalFileHeader(header))
+    return false;
+  if (!areHeadersConsistent(header, entry))
+    return false;
 
-    std::vector<unsigned char>data(entry.uncompressed_size);
+  unsigned long numBytesRead = 0;
+  const unsigned char *compressedData = m_input->read(entry.compressed_size, numBytesRead);
+  if (numBytesRead != entry.compressed_size)
+    return false;
 
-    strm.avail_out = entry.uncompressed_size;
-    strm.next_out = reinterpret_cast<Bytef *>(&data[0]);
-    ret = inflate(&strm, Z_FINISH);
-    switch (ret)
-    {
-    case Z_NEED_DICT:
-    case Z_DATA_ERROR:
-    case Z_MEM_ERROR:
-      (void)inflateEnd(&strm);
+  if (!entry.compression)
+  {
+    if (numBytesRead)
+      data.assign(compressedData, compressedData + numBytesRead);
+    else
       data.clear();
-      return 0;
-    }
+    return true;
+  }
+
+  int ret;
+  z_stream strm;
+
+  /* allocate inflate state */
+  strm.zalloc = Z_NULL;
+  strm.zfree = Z_NULL;
+  strm.opaque = Z_NULL;
+  strm.avail_in = 0;
+  strm.next_in = Z_NULL;
+  ret = inflateInit2(&strm,-MAX_WBITS);
+  if (ret != Z_OK)
+    return false;
+
+  strm.avail_in = numBytesRead;
+  strm.next_in = (Bytef *)compressedData;
+
+  data.resize(entry.uncompressed_size);
+
+  strm.avail_out = entry.uncompressed_size;
+  strm.next_out = reinterpret_cast<Bytef *>(&data[0]);
+  ret = inflate(&strm, Z_FINISH);
+  switch (ret)
+  {
+  case Z_NEED_DICT:
+  case Z_DATA_ERROR:
+  case Z_MEM_ERROR:
     (void)inflateEnd(&strm);
-    return new VSDInternalStream(data);
+    data.clear();
+    return false;
   }
+  (void)inflateEnd(&strm);
+  return true;
 }
 
 bool libvisio::VSDZipStreamImpl::readCentralDirectoryEnd(CentralDirectoryEnd &end)
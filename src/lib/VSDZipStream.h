@@ -31,6 +31,7 @@
 #define __VSDZIPSTREAM_H__
 
 #include <vector>
+#include <string>
 
 #include <libwpd-stream/libwpd-stream.h>
 
@@ -47,6 +48,13 @@ public:
   bool isOLEStream();
   WPXInputStream *getDocumentOLEStream(const char *);
 
+  // Inflates all, or only the named, entries up front and serves
+  // subsequent getDocumentOLEStream calls for them from memory. The
+  // streams returned for them read the cached data in place, so they must
+  // not outlive this stream.
+  unsigned prefetch();
+  unsigned prefetch(const std::vector<std::string> &names);
+
   const unsigned char *read(unsigned long numBytes, unsigned long &numBytesRead);
   int seek(long offset, WPX_SEEK_TYPE seekType);
   long tell();
@@ -152,7 +152,8 @@ static bool isBinaryVisioDocument(WPXInputStream *input)
   return false;
 }
 
-static bool parseBinaryVisioDocument(WPXInputStream *input, libwpg::WPGPaintInterface *painter, bool isStencilExtraction)
+static bool parseBinaryVisioDocument(WPXInputStream *input, libwpg::WPGPaintInterface *painter, bool isStencilExtraction,
+                                     libvisio::VSDRenderingOptions &options)
 {
   VSD_DEBUG_MSG(("Parsing Binary Visio Document\n"));
   input->seek(0, WPX_SEEK_SET);
@@ -190,10 +191,12 @@ static bool parseBinaryVisioDocument(WPXInputStream *input, libwpg::WPGPaintInte
     bool retValue = false;
     if (parser)
     {
+      parser->setRenderingOptions(options);
       if (isStencilExtraction)
         retValue = parser->extractStencils();
       else if (!isStencilExtraction)
         retValue = parser->parseMain();
+      options.setExceededLimits(parser->getExceededLimits());
     }
     else
     {
@@ -237,7 +240,7 @@ static bool isOpcVisioDocument(WPXInputStream *input)
     delete tmpInput;
 
     // Check whether the relationship points to a Visio document stream
-    const libvisio::VSDXRelationship *rel = rootRels.getRelationshipByType("http://schemas.microsoft.com/visio/2010/relationships/document");
+    const libvisio::VSDXRelationship *rel = rootRels.getRelationshipByType(libvisio::VSDX_REL_DOCUMENT);
     if (!rel)
       return false;
 
@@ -256,16 +259,17 @@ static bool isOpcVisioDocument(WPXInputStream *input)
   }
 }
 
-static bool parseOpcVisioDocument(WPXInputStream *input, libwpg::WPGPaintInterface *painter, bool isStencilExtraction)
+static bool parseOpcVisioDocument(WPXInputStream *input, libwpg::WPGPaintInterface *painter, bool isStencilExtraction,
+                                  libvisio::VSDRenderingOptions &options)
 {
   VSD_DEBUG_MSG(("Parsing Visio Document based on Open Packaging Convention\n"));
   input->seek(0, WPX_SEEK_SET);
   libvisio::VSDXParser parser(input, painter);
-  if (isStencilExtraction && parser.extractStencils())
-    return true;
-  else if (!isStencilExtraction && parser.parseMain())
-    return true;
-  return false;
+  parser.setRenderingOptions(options);
+  parser.setFastCellReading(true);
+  const bool retValue = isStencilExtraction ? parser.extractStencils() : parser.parseMain();
+  options.setExceededLimits(parser.getExceededLimits());
+  return retValue;
 }
 
 static bool isXmlVisioDocument(WPXInputStream *input)
@@ -324,16 +328,16 @@ static bool isXmlVisioDocument(WPXInputStream *input)
   }
 }
 
-static bool parseXmlVisioDocument(WPXInputStream *input, libwpg::WPGPaintInterface *painter, bool isStencilExtraction)
+static bool parseXmlVisioDocument(WPXInputStream *input, libwpg::WPGPaintInterface *painter, bool isStencilExtraction,
+                                  libvisio::VSDRenderingOptions &options)
 {
   VSD_DEBUG_MSG(("Parsing Visio DrawingML Document\n"));
   input->seek(0, WPX_SEEK_SET);
   libvisio::VDXParser parser(input, painter);
-  if (isStencilExtraction && parser.extractStencils())
-    return true;
-  else if (!isStencilExtraction && parser.parseMain())
-    return true;
-  return false;
+  parser.setRenderingOptions(options);
+  const bool retValue = isStencilExtraction ? parser.extractStencils() : parser.parseMain();
+  options.setExceededLimits(parser.getExceededLimits());
+  return retValue;
 }
 
 } // anonymous namespace
@@ -366,21 +370,36 @@ WPGPaintInterface class implementation when needed. This is often commonly calle
 */
 bool libvisio::VisioDocument::parse(::WPXInputStream *input, libwpg::WPGPaintInterface *painter)
 {
+  VSDRenderingOptions options;
+  return libvisio::VisioDocument::parse(input, painter, options);
+}
+
+/**
+Parses the input stream content like parse(), rendering it as the options ask.
+\param input The input stream
+\param painter A WPGPainterInterface implementation
+\param options The rendering options, e.g. the tolerance of curve flattening. On
+return, they tell which of their limits the document exceeded.
+\return A value that indicates whether the parsing was successful
+*/
+bool libvisio::VisioDocument::parse(::WPXInputStream *input, libwpg::WPGPaintInterface *painter, VSDRenderingOptions &options)
+{
+  options.setExceededLimits(0);
   if (isBinaryVisioDocument(input))
   {
-    if (parseBinaryVisioDocument(input, painter, false))
+    if (parseBinaryVisioDocument(input, painter, false, options))
       return true;
     return false;
   }
   if (isOpcVisioDocument(input))
   {
-    if (parseOpcVisioDocument(input, painter, false))
+    if (parseOpcVisioDocument(input, painter, false, options))
       return true;
     return false;
   }
   if (isXmlVisioDocument(input))
   {
-    if (parseXmlVisioDocument(input, painter, false))
+    if (parseXmlVisioDocument(input, painter, false, options))
       return true;
     return false;
   }
@@ -397,21 +416,37 @@ when needed.
 */
 bool libvisio::VisioDocument::parseStencils(::WPXInputStream *input, libwpg::WPGPaintInterface *painter)
 {
+  VSDRenderingOptions options;
+  return libvisio::VisioDocument::parseStencils(input, painter, options);
+}
+
+/**
+Parses the input stream content and extracts stencil pages like parseStencils(), rendering
+them as the options ask.
+\param input The input stream
+\param painter A WPGPainterInterface implementation
+\param options The rendering options, e.g. the tolerance of curve flattening. On
+return, they tell which of their limits the document exceeded.
+\return A value that indicates whether the parsing was successful
+*/
+bool libvisio::VisioDocument::parseStencils(::WPXInputStream *input, libwpg::WPGPaintInterface *painter, VSDRenderingOptions &options)
+{
+  options.setExceededLimits(0);
   if (isBinaryVisioDocument(input))
   {
-    if (parseBinaryVisioDocument(input, painter, true))
+    if (parseBinaryVisioDocument(input, painter, true, options))
       return true;
     return false;
   }
   if (isOpcVisioDocument(input))
   {
-    if (parseOpcVisioDocument(input, painter, true))
+    if (parseOpcVisioDocument(input, painter, true, options))
       return true;
     return false;
   }
   if (isXmlVisioDocument(input))
   {
-    if (parseXmlVisioDocument(input, painter, true))
+    if (parseXmlVisioDocument(input, painter, true, options))
       return true;
     return false;
   }
@@ -427,9 +462,24 @@ Provided as a convenience function for applications that support SVG internally.
 \return A value that indicates whether the SVG generation was successful.
 */
 bool libvisio::VisioDocument::generateSVG(::WPXInputStream *input, libvisio::VSDStringVector &output)
+{
+  VSDRenderingOptions options;
+  return libvisio::VisioDocument::generateSVG(input, output, options);
+}
+
+/**
+Parses the input stream content and generates a valid Scalable Vector Graphics like
+generateSVG(), rendering it as the options ask.
+\param input The input stream
+\param output The output string whose content is the resulting SVG
+\param options The rendering options, e.g. the tolerance of curve flattening. On
+return, they tell which of their limits the document exceeded.
+\return A value that indicates whether the SVG generation was successful.
+*/
+bool libvisio::VisioDocument::generateSVG(::WPXInputStream *input, libvisio::VSDStringVector &output, VSDRenderingOptions &options)
 {
   libvisio::VSDSVGGenerator generator(output);
-  bool result = libvisio::VisioDocument::parse(input, &generator);
+  bool result = libvisio::VisioDocument::parse(input, &generator, options);
   return result;
 }
 
@@ -442,9 +492,24 @@ Provided as a convenience function for applications that support SVG internally.
 \return A value that indicates whether the SVG generation was successful.
 */
 bool libvisio::VisioDocument::generateSVGStencils(::WPXInputStream *input, libvisio::VSDStringVector &output)
+{
+  VSDRenderingOptions options;
+  return libvisio::VisioDocument::generateSVGStencils(input, output, options);
+}
+
+/**
+Parses the input stream content and extracts stencil pages like generateSVGStencils(),
+rendering them as the options ask.
+\param input The input stream
+\param output The output string whose content is the resulting SVG
+\param options The rendering options, e.g. the tolerance of curve flattening. On
+return, they tell which of their limits the document exceeded.
+\return A value that indicates whether the SVG generation was successful.
+*/
+bool libvisio::VisioDocument::generateSVGStencils(::WPXInputStream *input, libvisio::VSDStringVector &output, VSDRenderingOptions &options)
 {
   libvisio::VSDSVGGenerator generator(output);
-  bool result = libvisio::VisioDocument::parseStencils(input, &generator);
+  bool result = libvisio::VisioDocument::parseStencils(input, &generator, options);
   return result;
 }
 /* vim:set shiftwidth=2 softtabstop=2 expandtab: */
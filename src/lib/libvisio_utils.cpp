@@ -28,13 +28,41 @@
  * instead of those above.
  */
 
+#include <ostream>
 #include <string>
 #include "VSDInternalStream.h"
 #include "libvisio_utils.h"
 
-#include <boost/archive/iterators/binary_from_base64.hpp>
-#include <boost/archive/iterators/remove_whitespace.hpp>
-#include <boost/archive/iterators/transform_width.hpp>
+#define VSD_BASE64_CHUNK_SIZE 3072
+
+namespace
+{
+
+static const char base64Digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// The value of every base64 digit; 0x40 marks whitespace and 0x80 anything
+// that ends the data, padding included.
+static const unsigned char base64Values[256] =
+{
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x40, 0x40, 0x40, 0x40, 0x40, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x40, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x3e, 0x80, 0x80, 0x80, 0x3f,
+  0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+  0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+};
+
+} // anonymous namespace
 
 uint8_t libvisio::readU8(WPXInputStream *input)
 {
@@ -125,15 +153,106 @@ double libvisio::readDouble(WPXInputStream *input)
 
 void libvisio::appendFromBase64(WPXBinaryData &data, const unsigned char *base64String, size_t base64StringLength)
 {
-  typedef boost::archive::iterators::transform_width<
-  boost::archive::iterators::binary_from_base64<
-  boost::archive::iterators::remove_whitespace< const char * > >, 8, 6 > base64_decoder;
+  // The data go to the destination through a fixed buffer, in chunks.
+  unsigned char buffer[VSD_BASE64_CHUNK_SIZE];
+  size_t length = 0;
+  unsigned quantum = 0;
+  unsigned digits = 0;
+
+  const unsigned char *p = base64String;
+  const unsigned char *const end = base64String + base64StringLength;
+  while (p != end)
+  {
+    if (!digits && end - p >= 4)
+    {
+      // Most of the data are runs of digits: take four at a time as long
+      // as none of them is whitespace or the end of the data.
+      const unsigned v0 = base64Values[p[0]];
+      const unsigned v1 = base64Values[p[1]];
+      const unsigned v2 = base64Values[p[2]];
+      const unsigned v3 = base64Values[p[3]];
+      if (!((v0 | v1 | v2 | v3) & 0xc0))
+      {
+        const unsigned value = (v0 << 18) | (v1 << 12) | (v2 << 6) | v3;
+        buffer[length++] = (unsigned char)(value >> 16);
+        buffer[length++] = (unsigned char)(value >> 8);
+        buffer[length++] = (unsigned char)value;
+        if (length == VSD_BASE64_CHUNK_SIZE)
+        {
+          data.append(buffer, length);
+          length = 0;
+        }
+        p += 4;
+        continue;
+      }
+    }
+
+    const unsigned value = base64Values[*p++];
+    if (value & 0x80)
+      break;
+    if (value & 0x40)
+      continue;
+    quantum = (quantum << 6) | value;
+    if (4 == ++digits)
+    {
+      buffer[length++] = (unsigned char)(quantum >> 16);
+      buffer[length++] = (unsigned char)(quantum >> 8);
+      buffer[length++] = (unsigned char)quantum;
+      if (length == VSD_BASE64_CHUNK_SIZE)
+      {
+        data.append(buffer, length);
+        length = 0;
+      }
+      quantum = 0;
+      digits = 0;
+    }
+  }
+
+  // a final group of two or three digits carries one or two bytes
+  if (2 == digits)
+    buffer[length++] = (unsigned char)(quantum >> 4);
+  else if (3 == digits)
+  {
+    buffer[length++] = (unsigned char)(quantum >> 10);
+    buffer[length++] = (unsigned char)(quantum >> 2);
+  }
+  if (length)
+    data.append(buffer, length);
+}
+
+void libvisio::writeBase64(std::ostream &stream, const WPXBinaryData &data)
+{
+  const unsigned char *p = data.getDataBuffer();
+  if (!p)
+    return;
+  const unsigned char *const end = p + data.size();
 
-  std::vector<unsigned char> buffer;
-  std::copy(base64_decoder(base64String), base64_decoder(base64String + base64StringLength), std::back_inserter(buffer));
+  char buffer[VSD_BASE64_CHUNK_SIZE];
+  size_t length = 0;
+  for (; end - p >= 3; p += 3)
+  {
+    const unsigned value = ((unsigned)p[0] << 16) | ((unsigned)p[1] << 8) | p[2];
+    buffer[length++] = base64Digits[value >> 18];
+    buffer[length++] = base64Digits[(value >> 12) & 0x3f];
+    buffer[length++] = base64Digits[(value >> 6) & 0x3f];
+    buffer[length++] = base64Digits[value & 0x3f];
+    if (length == VSD_BASE64_CHUNK_SIZE)
+    {
+      stream.write(buffer, length);
+      length = 0;
+    }
+  }
 
-  if (!buffer.empty())
-    data.append(&buffer[0], buffer.size());
+  if (end != p)
+  {
+    const unsigned value = ((unsigned)p[0] << 16) | (end - p > 1 ? (unsigned)p[1] << 8 : 0);
+    buffer[length++] = base64Digits[value >> 18];
+    buffer[length++] = base64Digits[(value >> 12) & 0x3f];
+    buffer[length++] = end - p > 1 ? base64Digits[(value >> 6) & 0x3f] : '=';
+    buffer[length++] = '=';
+  }
+  if (length)
+    stream.write(buffer, length);
 }
 
 const ::WPXString libvisio::getColourString(const Colour &c)
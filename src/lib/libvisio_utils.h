@@ -32,6 +32,7 @@
 #define __LIBVISIO_UTILS_H__
 
 #include <stdio.h>
+#include <iosfwd>
 #include "VSDTypes.h"
 
 #ifdef _MSC_VER
@@ -99,6 +100,7 @@ uint64_t readU64(WPXInputStream *input);
 double readDouble(WPXInputStream *input);
 
 void appendFromBase64(WPXBinaryData &data, const unsigned char *base64String, size_t base64StringLength);
+void writeBase64(std::ostream &stream, const WPXBinaryData &data);
 
 const ::WPXString getColourString(const Colour &c);
 
@@ -53,12 +53,16 @@ SLOFILES= \
 	$(SLO)$/VSDPages.obj \
 	$(SLO)$/VSDParagraphList.obj \
 	$(SLO)$/VSDParser.obj \
+	$(SLO)$/VSDPath.obj \
+	$(SLO)$/VSDRenderingOptions.obj \
 	$(SLO)$/VSDShapeList.obj \
+	$(SLO)$/VSDShapeTable.obj \
 	$(SLO)$/VSDStencils.obj \
 	$(SLO)$/VSDStringVector.obj \
 	$(SLO)$/VSDStylesCollector.obj \
 	$(SLO)$/VSDStyles.obj \
 	$(SLO)$/VSDSVGGenerator.obj \
+	$(SLO)$/VSDXCellScanner.obj \
 	$(SLO)$/VSDXMLHelper.obj \
 	$(SLO)$/VSDXMLParserBase.obj \
 	$(SLO)$/VSDXMLTokenMap.obj \
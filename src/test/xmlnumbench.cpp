@@ -0,0 +1,253 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* libvisio
+ * Version: MPL 1.1 / GPLv2+ / LGPLv2+
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License or as specified alternatively below. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * Major Contributor(s):
+ * Copyright (C) 2012 Fridrich Strba <fridrich.strba@bluewin.ch>
+ *
+ *
+ * All Rights Reserved.
+ *
+ * For minor contributions see the git repository.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPLv2+"), or
+ * the GNU Lesser General Public License Version 2 or later (the "LGPLv2+"),
+ * in which case the provisions of the GPLv2+ or the LGPLv2+ are applicable
+ * instead of those above.
+ */
+
+
+// Microbenchmark of the parsing of the numeric values of XML cells. It
+// checks that xmlStringToDouble and xmlStringToLong give the same values
+// as strtod and strtol in the C locale, then times them against the
+// string copying and locale dependent functions they replaced. The
+// replaced ones run in the locale of the environment, so that their
+// decimal point rewriting is timed as well where it is not '.'.
+
+#include <errno.h>
+#include <limits.h>
+#include <locale.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "VSDXMLHelper.h"
+
+namespace
+{
+
+int printUsage()
+{
+  printf("Usage: xmlnumbench [OPTION] [<count>]\n");
+  printf("\n");
+  printf("Parses <count> values of each kind, 1000000 by default, three times.\n");
+  printf("\n");
+  printf("Options:\n");
+  printf("--help                Shows this help message\n");
+  return -1;
+}
+
+double oldStringToDouble(const xmlChar *s)
+{
+  std::string doubleStr((const char *)s);
+  std::string decimalPoint(localeconv()->decimal_point);
+  if (!decimalPoint.empty() && decimalPoint != ".")
+  {
+    std::string::size_type pos;
+    while ((pos = doubleStr.find(".")) != std::string::npos)
+      doubleStr.replace(pos, 1, decimalPoint);
+  }
+  errno = 0;
+  return strtod(doubleStr.c_str(), 0);
+}
+
+long oldStringToLong(const xmlChar *s)
+{
+  errno = 0;
+  return strtol((const char *)s, 0, 0);
+}
+
+unsigned oldStringToColour(const xmlChar *s)
+{
+  std::string str((const char *)s);
+  str.erase(str.begin());
+  std::istringstream istr(str);
+  unsigned val = 0;
+  istr >> std::hex >> val;
+  return val;
+}
+
+// A uniform number in [0, 1)
+double random01()
+{
+  return rand() / (RAND_MAX + 1.0);
+}
+
+// Values written the ways Visio and other producers write them
+void makeDoubles(std::vector<std::string> &values, unsigned count)
+{
+  char buffer[64];
+  for (unsigned i = 0; i < count; ++i)
+  {
+    const double value = (random01() - 0.5) * pow(10.0, (double)(rand() % 12 - 6));
+    switch (i % 4)
+    {
+    case 0:
+      sprintf(buffer, "%.6f", value);
+      break;
+    case 1:
+      sprintf(buffer, "%.16g", value);
+      break;
+    case 2:
+      sprintf(buffer, "%.17g", value);
+      break;
+    default:
+      sprintf(buffer, "%.15e", value);
+      break;
+    }
+    values.push_back(buffer);
+  }
+}
+
+void makeLongs(std::vector<std::string> &values, unsigned count)
+{
+  char buffer[32];
+  for (unsigned i = 0; i < count; ++i)
+  {
+    sprintf(buffer, "%ld", (long)(rand() % 100000) - (i % 2 ? 0L : 50000L));
+    values.push_back(buffer);
+  }
+}
+
+void makeColours(std::vector<std::string> &values, unsigned count)
+{
+  char buffer[16];
+  for (unsigned i = 0; i < count; ++i)
+  {
+    sprintf(buffer, "#%06X", (unsigned)(random01() * 0x1000000));
+    values.push_back(buffer);
+  }
+}
+
+unsigned long checkDoubles(const std::vector<std::string> &values)
+{
+  unsigned long mismatches = 0;
+  for (size_t i = 0; i < values.size(); ++i)
+  {
+    const double expected = strtod(values[i].c_str(), 0);
+    const double value = libvisio::xmlStringToDouble(BAD_CAST(values[i].c_str()));
+    if (memcmp(&expected, &value, sizeof(double)))
+    {
+      if (!mismatches)
+        printf("%s: %.17g instead of %.17g\n", values[i].c_str(), value, expected);
+      ++mismatches;
+    }
+  }
+  return mismatches;
+}
+
+unsigned long checkLongs(const std::vector<std::string> &values)
+{
+  unsigned long mismatches = 0;
+  for (size_t i = 0; i < values.size(); ++i)
+  {
+    const long expected = strtol(values[i].c_str(), 0, 0);
+    const long value = libvisio::xmlStringToLong(BAD_CAST(values[i].c_str()));
+    if (expected != value)
+    {
+      if (!mismatches)
+        printf("%s: %ld instead of %ld\n", values[i].c_str(), value, expected);
+      ++mismatches;
+    }
+  }
+  return mismatches;
+}
+
+double seconds(clock_t start)
+{
+  return (clock() - start) / (double)CLOCKS_PER_SEC;
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+  unsigned count = 1000000;
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--help") || atoi(argv[i]) <= 0)
+      return printUsage();
+    count = (unsigned)atoi(argv[i]);
+  }
+
+  srand(1);
+  std::vector<std::string> doubles;
+  std::vector<std::string> longs;
+  std::vector<std::string> colours;
+  makeDoubles(doubles, count);
+  makeLongs(longs, count);
+  makeColours(colours, count);
+
+  const unsigned long mismatches = checkDoubles(doubles) + checkLongs(longs);
+  printf("%lu mismatches in %u doubles and %u integers\n", mismatches, count, count);
+
+  setlocale(LC_ALL, "");
+  printf("locale decimal point '%s'\n", localeconv()->decimal_point);
+
+  // the sums keep the calls from being optimized away
+  double sum = 0.0;
+  clock_t start = clock();
+  for (unsigned round = 0; round < 3; ++round)
+    for (size_t i = 0; i < doubles.size(); ++i)
+      sum += oldStringToDouble(BAD_CAST(doubles[i].c_str()));
+  const double oldDoubleTime = seconds(start);
+  start = clock();
+  for (unsigned round = 0; round < 3; ++round)
+    for (size_t i = 0; i < doubles.size(); ++i)
+      sum += libvisio::xmlStringToDouble(BAD_CAST(doubles[i].c_str()));
+  printf("doubles:  old %.3fs new %.3fs\n", oldDoubleTime, seconds(start));
+
+  long longSum = 0;
+  start = clock();
+  for (unsigned round = 0; round < 3; ++round)
+    for (size_t i = 0; i < longs.size(); ++i)
+      longSum += oldStringToLong(BAD_CAST(longs[i].c_str()));
+  const double oldLongTime = seconds(start);
+  start = clock();
+  for (unsigned round = 0; round < 3; ++round)
+    for (size_t i = 0; i < longs.size(); ++i)
+      longSum += libvisio::xmlStringToLong(BAD_CAST(longs[i].c_str()));
+  printf("integers: old %.3fs new %.3fs\n", oldLongTime, seconds(start));
+
+  unsigned colourSum = 0;
+  start = clock();
+  for (unsigned round = 0; round < 3; ++round)
+    for (size_t i = 0; i < colours.size(); ++i)
+      colourSum += oldStringToColour(BAD_CAST(colours[i].c_str()));
+  const double oldColourTime = seconds(start);
+  start = clock();
+  for (unsigned round = 0; round < 3; ++round)
+    for (size_t i = 0; i < colours.size(); ++i)
+      colourSum += libvisio::xmlStringToColour(BAD_CAST(colours[i].c_str())).b;
+  printf("colours:  old %.3fs new %.3fs\n", oldColourTime, seconds(start));
+
+  printf("(%g %ld %u)\n", sum, longSum, colourSum);
+  return mismatches ? 1 : 0;
+}
+
+/* vim:set shiftwidth=2 softtabstop=2 expandtab: */